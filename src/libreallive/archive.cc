@@ -35,10 +35,12 @@
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <algorithm>
 #include <cstring>
 #include <string>
 
 #include "libreallive/compression.h"
+#include "libreallive/scenario_cache.h"
 
 using boost::istarts_with;
 using boost::iends_with;
@@ -47,18 +49,30 @@ namespace fs = boost::filesystem;
 namespace libreallive {
 
 Archive::Archive(const std::string& filename)
-    : name_(filename), info_(filename, Read), second_level_xor_key_(NULL) {
+    : use_clock_(0),
+      scenario_budget_(0),
+      next_preload_(0),
+      stop_preloading_(false),
+      name_(filename),
+      info_(filename, Read),
+      second_level_xor_key_(NULL) {
   ReadTOC();
   ReadOverrides();
+  BuildSlots();
 }
 
 Archive::Archive(const std::string& filename, const std::string& regname)
-    : name_(filename),
+    : use_clock_(0),
+      scenario_budget_(0),
+      next_preload_(0),
+      stop_preloading_(false),
+      name_(filename),
       info_(filename, Read),
       second_level_xor_key_(NULL),
       regname_(regname) {
   ReadTOC();
   ReadOverrides();
+  BuildSlots();
 
   if (regname == "KEY\\CLANNAD_FV") {
     second_level_xor_key_ =
@@ -92,20 +106,203 @@ Archive::Archive(const std::string& filename, const std::string& regname)
   }
 }
 
-Archive::~Archive() {}
+Archive::~Archive() { StopPreloading(); }
 
 Scenario* Archive::GetScenario(int index) {
-  accessed_t::const_iterator at = accessed_.find(index);
-  if (at != accessed_.end())
-    return at->second.get();
-  scenarios_t::const_iterator st = scenarios_.find(index);
-  if (st != scenarios_.end()) {
-    Scenario* scene =
-        new Scenario(st->second, index, regname_, second_level_xor_key_);
-    accessed_[index].reset(scene);
-    return scene;
+  return LoadScenario(index, true);
+}
+
+uint64_t Archive::NextUseTick() {
+  // Only used to order scenarios for eviction, so two threads racing here and
+  // handing out the same tick is harmless, and cheaper than a locked add.
+  uint64_t tick = use_clock_.load(std::memory_order_relaxed) + 1;
+  use_clock_.store(tick, std::memory_order_relaxed);
+  return tick;
+}
+
+Scenario* Archive::LoadScenario(int index, bool touch) {
+  if (index < 0 || static_cast<size_t>(index) >= slots_.size())
+    return NULL;
+  ScenarioSlot& slot = slots_[index];
+
+  Scenario* loaded = slot.loaded.load(std::memory_order_acquire);
+  if (loaded) {
+    if (touch)
+      slot.last_used.store(NextUseTick(), std::memory_order_relaxed);
+    return loaded;
+  }
+
+  std::unique_lock<std::mutex> lock(accessed_mutex_);
+  while (true) {
+    if (slot.scenario) {
+      if (touch)
+        slot.last_used.store(NextUseTick(), std::memory_order_relaxed);
+      return slot.scenario.get();
+    }
+
+    // Someone else is already building this scenario; wait for them.
+    if (in_progress_.count(index) == 0)
+      break;
+    scenario_built_.wait(lock);
+  }
+
+  if (!slot.file.data)
+    return NULL;
+
+  // Parse outside the lock so that other scenarios can be handed out (and
+  // built) in parallel with this one.
+  in_progress_.insert(index);
+  lock.unlock();
+
+  std::unique_ptr<Scenario> scene;
+  try {
+    FilePos bytecode;
+    if (cache_)
+      bytecode = cache_->Find(index);
+    scene.reset(new Scenario(
+        slot.file, index, regname_, second_level_xor_key_, bytecode));
+  }
+  catch (...) {
+    lock.lock();
+    in_progress_.erase(index);
+    scenario_built_.notify_all();
+    throw;
+  }
+
+  const size_t memory_usage = scene->memory_usage();
+  lock.lock();
+  slot.scenario = std::move(scene);
+  slot.last_used.store(touch ? NextUseTick() : 0, std::memory_order_relaxed);
+  slot.memory_usage = memory_usage;
+  slot.loaded.store(slot.scenario.get(), std::memory_order_release);
+  in_progress_.erase(index);
+  scenario_built_.notify_all();
+  return slot.scenario.get();
+}
+
+void Archive::StartPreloading(int num_threads) {
+  StopPreloading();
+
+  if (num_threads <= 0) {
+    num_threads = std::max(
+        1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
   }
-  return NULL;
+
+  preload_queue_.clear();
+  for (auto const& scenario : scenarios_)
+    preload_queue_.push_back(scenario.first);
+  next_preload_ = 0;
+  stop_preloading_ = false;
+
+  num_threads =
+      std::min(num_threads, static_cast<int>(preload_queue_.size()));
+  for (int i = 0; i < num_threads; ++i)
+    preload_threads_.emplace_back(&Archive::PreloadWorker, this);
+}
+
+void Archive::WaitForPreload() {
+  for (auto& thread : preload_threads_)
+    thread.join();
+  preload_threads_.clear();
+}
+
+void Archive::PreloadAllScenarios(int num_threads) {
+  StartPreloading(num_threads);
+  WaitForPreload();
+}
+
+void Archive::UseScenarioCache(const std::string& path) {
+  const uint64_t key = ScenarioCache::KeyFor(scenarios_, regname_);
+  std::unique_ptr<ScenarioCache> cache(new ScenarioCache(path, key));
+  if (!cache->valid()) {
+    std::map<int, std::vector<char>> bytecode;
+    for (auto const& scenario : scenarios_) {
+      try {
+        DecompressScenario(scenario.second, regname_, second_level_xor_key_,
+                           &bytecode[scenario.first]);
+      }
+      catch (...) {
+        // Left out of the cache; GetScenario() will report the error if the
+        // VM ever gets there.
+        bytecode.erase(scenario.first);
+      }
+    }
+
+    if (!ScenarioCache::Write(path, key, bytecode))
+      return;
+
+    cache.reset(new ScenarioCache(path, key));
+    if (!cache->valid())
+      return;
+  }
+
+  cache_ = std::move(cache);
+}
+
+bool Archive::IsScenarioLoaded(int index) const {
+  if (index < 0 || static_cast<size_t>(index) >= slots_.size())
+    return false;
+  return slots_[index].loaded.load(std::memory_order_acquire) != NULL;
+}
+
+void Archive::set_scenario_budget(size_t bytes) {
+  scenario_budget_ = bytes;
+}
+
+size_t Archive::scenario_budget() const {
+  return scenario_budget_;
+}
+
+void Archive::EvictScenarios(const std::set<int>& pinned) {
+  std::lock_guard<std::mutex> lock(accessed_mutex_);
+  if (scenario_budget_ == 0)
+    return;
+
+  // Expressions are parsed into a scenario's arena as it runs, so refresh
+  // every size before deciding what has to go.
+  size_t resident = 0;
+  std::vector<ScenarioSlot*> candidates;
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    ScenarioSlot& slot = slots_[i];
+    if (!slot.scenario)
+      continue;
+    slot.memory_usage = slot.scenario->memory_usage();
+    resident += slot.memory_usage;
+    if (pinned.count(i) == 0)
+      candidates.push_back(&slot);
+  }
+  if (resident <= scenario_budget_)
+    return;
+
+  std::sort(candidates.begin(), candidates.end(),
+            [](ScenarioSlot* a, ScenarioSlot* b) {
+              return a->last_used.load(std::memory_order_relaxed) <
+                     b->last_used.load(std::memory_order_relaxed);
+            });
+  for (ScenarioSlot* slot : candidates) {
+    if (resident <= scenario_budget_)
+      break;
+    resident -= slot->memory_usage;
+    slot->loaded.store(NULL, std::memory_order_release);
+    slot->scenario.reset();
+  }
+}
+
+std::map<int, size_t> Archive::GetScenarioMemoryUsage() const {
+  std::lock_guard<std::mutex> lock(accessed_mutex_);
+  std::map<int, size_t> usage;
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    if (slots_[i].scenario)
+      usage[i] = slots_[i].scenario->memory_usage();
+  }
+  return usage;
+}
+
+size_t Archive::GetResidentScenarioBytes() const {
+  size_t total = 0;
+  for (auto const& scenario : GetScenarioMemoryUsage())
+    total += scenario.second;
+  return total;
 }
 
 int Archive::GetProbableEncodingType() const {
@@ -129,6 +326,50 @@ void Archive::ReadTOC() {
   }
 }
 
+void Archive::BuildSlots() {
+  if (scenarios_.empty())
+    return;
+
+  // ScenarioSlot can't be moved, so the vector is built at its final size.
+  slots_ = std::vector<ScenarioSlot>(scenarios_.rbegin()->first + 1);
+  for (auto const& scenario : scenarios_)
+    slots_[scenario.first].file = scenario.second;
+}
+
+void Archive::PreloadWorker() {
+  while (!stop_preloading_) {
+    size_t next = next_preload_++;
+    if (next >= preload_queue_.size())
+      return;
+
+    {
+      // Sizes recorded at construction are good enough here; the VM thread
+      // may be parsing into the arenas of scenarios it's running.
+      std::lock_guard<std::mutex> lock(accessed_mutex_);
+      if (scenario_budget_ != 0) {
+        size_t resident = 0;
+        for (auto const& slot : slots_)
+          resident += slot.scenario ? slot.memory_usage : 0;
+        if (resident >= scenario_budget_)
+          return;
+      }
+    }
+
+    try {
+      LoadScenario(preload_queue_[next], false);
+    }
+    catch (...) {
+      // Swallowed on purpose. The scenario stays unparsed, so the error will
+      // be raised again (and reported properly) if the VM ever jumps there.
+    }
+  }
+}
+
+void Archive::StopPreloading() {
+  stop_preloading_ = true;
+  WaitForPreload();
+}
+
 void Archive::ReadOverrides() {
   // Iterate over all files in the directory and override the table of contents
   // if there is a free SEENXXXX.TXT file.
@@ -34,9 +34,15 @@
 #ifndef SRC_LIBREALLIVE_ARCHIVE_H_
 #define SRC_LIBREALLIVE_ARCHIVE_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "libreallive/defs.h"
@@ -49,6 +55,8 @@ namespace compression {
 struct XorKey;
 }  // namespace compression
 
+class ScenarioCache;
+
 // Interface to a loaded SEEN.TXT file.
 class Archive {
  public:
@@ -64,26 +72,145 @@ class Archive {
   const_iterator begin() { return scenarios_.cbegin(); }
   const_iterator end() { return scenarios_.cend(); }
 
-  // Returns a specific scenario by |index| number or NULL if none exist.
+  // Returns a specific scenario by |index| number or NULL if none exist. Safe
+  // to call while a preload is running; if a worker is currently building
+  // |index|, this blocks until that worker is done instead of parsing the
+  // scenario a second time.
   Scenario* GetScenario(int index);
 
+  // Starts decompressing and parsing every scenario in the archive on
+  // |num_threads| background threads (or one less than the number of cores if
+  // |num_threads| is 0). Returns immediately; GetScenario() keeps working and
+  // will pick up the results as they finish. Scenarios that fail to parse are
+  // skipped here and will report their errors when the VM reaches them.
+  void StartPreloading(int num_threads);
+
+  // Blocks until every background preload thread has finished.
+  void WaitForPreload();
+
+  // Equivalent to StartPreloading() followed by WaitForPreload().
+  void PreloadAllScenarios(int num_threads);
+
+  // Uses the scenario cache file at |path| (see ScenarioCache) to skip
+  // decompression. If the file is missing or was built from different
+  // scenario data, every scenario is decompressed now and the cache is
+  // rewritten. Failing to write the cache is not an error; scenarios are then
+  // decompressed on demand as usual. Must be called before StartPreloading().
+  void UseScenarioCache(const std::string& path);
+
+  // Whether UseScenarioCache() succeeded.
+  bool has_scenario_cache() const { return cache_ != NULL; }
+
+  // Returns whether |index| has already been parsed.
+  bool IsScenarioLoaded(int index) const;
+
+  // Sets how many bytes (as counted by Scenario::memory_usage()) parsed
+  // scenarios may use before EvictScenarios() starts discarding the least
+  // recently used ones. 0, the default, means no limit. Preloading stops
+  // early once the budget is used up.
+  void set_scenario_budget(size_t bytes);
+  size_t scenario_budget() const;
+
+  // Discards least recently used scenarios until the rest fit in the
+  // budget. Scenarios in |pinned| are kept regardless, as are any that are
+  // being parsed. The Archive never evicts on its own: only the caller knows
+  // which Scenario pointers are still in use, so this must only be called
+  // when every scenario outside |pinned| is safe to delete.
+  void EvictScenarios(const std::set<int>& pinned);
+
+  // Returns the memory used by each parsed scenario, keyed by scene number.
+  std::map<int, size_t> GetScenarioMemoryUsage() const;
+
+  // Returns the sum of GetScenarioMemoryUsage().
+  size_t GetResidentScenarioBytes() const;
+
   // Does a quick pass through all scenarios in the archive, looking for any
   // with non-default encoding. This short circuits when it finds one.
   int GetProbableEncodingType() const;
 
  private:
   typedef std::map<int, FilePos> scenarios_t;
-  typedef std::map<int, std::unique_ptr<Scenario>> accessed_t;
+
+  // Everything we know about one scene number. Indexed directly by scene
+  // number in |slots_|, so looking up a scenario is an array access.
+  struct ScenarioSlot {
+    ScenarioSlot() : loaded(NULL), last_used(0), memory_usage(0) {}
+
+    // The scenario's data; empty if the archive has no such scenario.
+    FilePos file;
+
+    // The parsed scenario, or NULL if it hasn't been parsed or was evicted.
+    std::unique_ptr<Scenario> scenario;
+
+    // Copy of |scenario| that GetScenario() reads without taking
+    // |accessed_mutex_|, so that jumping to a parsed scenario stays cheap.
+    std::atomic<Scenario*> loaded;
+
+    // Value of |use_clock_| when this was last returned by GetScenario(), or
+    // 0 if it was preloaded and hasn't been asked for yet.
+    std::atomic<uint64_t> last_used;
+
+    // Scenario::memory_usage() as of construction or the last eviction pass.
+    size_t memory_usage;
+  };
 
   void ReadTOC();
 
   void ReadOverrides();
 
+  // Fills |slots_| from |scenarios_|.
+  void BuildSlots();
+
+  // Returns the next value of |use_clock_|.
+  uint64_t NextUseTick();
+
+  // Implementation of GetScenario(). Only marks the scenario as used if
+  // |touch| is set, so that preloading doesn't make scenarios look recent.
+  Scenario* LoadScenario(int index, bool touch);
+
+  // Body of each preload thread: claims the next unparsed scenario in
+  // |preload_queue_| until the queue is exhausted or we're shutting down.
+  void PreloadWorker();
+
+  // Stops and joins all preload threads.
+  void StopPreloading();
+
+  // The table of contents, in scene order. Used for iteration; lookups go
+  // through |slots_|.
   scenarios_t scenarios_;
-  accessed_t accessed_;
+
+  // One entry per scene number up to the highest one in |scenarios_|. Sized
+  // once in the constructor, so that pointers into it stay valid.
+  std::vector<ScenarioSlot> slots_;
+
+  // Guards the parsed scenarios in |slots_| and |in_progress_|.
+  mutable std::mutex accessed_mutex_;
+
+  // Advanced every time GetScenario() hands out a scenario.
+  std::atomic<uint64_t> use_clock_;
+
+  // See set_scenario_budget().
+  std::atomic<size_t> scenario_budget_;
+
+  // Signaled every time a scenario finishes (or fails) construction.
+  std::condition_variable scenario_built_;
+
+  // Scenarios which some thread is currently constructing.
+  std::set<int> in_progress_;
+
+  // Scene numbers handed out to the preload threads, and the index of the
+  // next one to claim.
+  std::vector<int> preload_queue_;
+  std::atomic<size_t> next_preload_;
+  std::atomic<bool> stop_preloading_;
+  std::vector<std::thread> preload_threads_;
   string name_;
   Mapping info_;
 
+  // Decompressed bytecode from a previous run, if UseScenarioCache() was
+  // called and found or built a cache for this archive.
+  std::unique_ptr<ScenarioCache> cache_;
+
   // Mappings to unarchived SEEN\d{4}.TXT files on disk.
   std::vector<std::unique_ptr<Mapping>> maps_to_delete_;
 
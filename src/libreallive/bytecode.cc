@@ -33,6 +33,7 @@
 
 #include "libreallive/bytecode.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <exception>
@@ -63,7 +64,7 @@ inline BytecodeElement* ReadFunction(const char* stream,
     case 0x00050005:
     case 0x00060001:
     case 0x00060005:
-      return new GotoElement(stream, cdata);
+      return new (cdata.arena) GotoElement(stream, cdata);
     case 0x00010001:
     case 0x00010002:
     case 0x00010006:
@@ -75,24 +76,24 @@ inline BytecodeElement* ReadFunction(const char* stream,
     case 0x00060002:
     case 0x00060006:
     case 0x00060007:
-      return new GotoIfElement(stream, cdata);
+      return new (cdata.arena) GotoIfElement(stream, cdata);
     case 0x00010003:
     case 0x00010008:
     case 0x00050003:
     case 0x00050008:
     case 0x00060003:
     case 0x00060008:
-      return new GotoOnElement(stream, cdata);
+      return new (cdata.arena) GotoOnElement(stream, cdata);
     case 0x00010004:
     case 0x00010009:
     case 0x00050004:
     case 0x00050009:
     case 0x00060004:
     case 0x00060009:
-      return new GotoCaseElement(stream, cdata);
+      return new (cdata.arena) GotoCaseElement(stream, cdata);
     case 0x00010010:
     case 0x00060010:
-      return new GosubWithElement(stream, cdata);
+      return new (cdata.arena) GosubWithElement(stream, cdata);
 
     // Select elements.
     case 0x00020000:
@@ -100,17 +101,17 @@ inline BytecodeElement* ReadFunction(const char* stream,
     case 0x00020002:
     case 0x00020003:
     case 0x00020010:
-      return new SelectElement(stream);
+      return new (cdata.arena) SelectElement(stream);
   }
 
-  return BuildFunctionElement(stream);
+  return BuildFunctionElement(stream, cdata.arena);
 }
 
 }  // namespace
 
 char BytecodeElement::entrypoint_marker = '@';
 
-CommandElement* BuildFunctionElement(const char* stream) {
+CommandElement* BuildFunctionElement(const char* stream, BytecodeList* arena) {
   const char* ptr = stream;
   ptr += 8;
   std::vector<std::string> params;
@@ -124,11 +125,11 @@ CommandElement* BuildFunctionElement(const char* stream) {
   }
 
   if (params.size() == 0)
-    return new VoidFunctionElement(stream);
+    return new (arena) VoidFunctionElement(stream);
   else if (params.size() == 1)
-    return new SingleArgFunctionElement(stream, params.front());
+    return new (arena) SingleArgFunctionElement(stream, params.front());
   else
-    return new FunctionElement(stream, params);
+    return new (arena) FunctionElement(stream, params);
 }
 
 void PrintParameterString(std::ostream& oss,
@@ -159,13 +160,76 @@ void PrintParameterString(std::ostream& oss,
 // ConstructionData
 // -----------------------------------------------------------------------
 
-ConstructionData::ConstructionData(size_t kt, pointer_t pt)
-    : kidoku_table(kt), null(pt) {}
+ConstructionData::ConstructionData(size_t kt, BytecodeList* arena)
+    : kidoku_table(kt), arena(arena) {}
 
 // -----------------------------------------------------------------------
 
 ConstructionData::~ConstructionData() {}
 
+pointer_t ConstructionData::ResolveOffset(unsigned long offset) const {
+  std::vector<unsigned long>::const_iterator it =
+      std::lower_bound(offsets.begin(), offsets.end(), offset);
+  if (it == offsets.end() || *it != offset)
+    throw Error("Pointer to an offset that isn't the start of an instruction");
+  return it - offsets.begin();
+}
+
+// -----------------------------------------------------------------------
+// BytecodeList
+// -----------------------------------------------------------------------
+
+namespace {
+
+// Elements hold nothing with stricter alignment than a pointer or a double.
+const size_t kElementAlignment =
+    alignof(double) > alignof(void*) ? alignof(double) : alignof(void*);
+
+// Blocks start small so that tiny scenarios stay tiny, and double up to a cap
+// so that large ones only need a handful of allocations.
+const size_t kFirstBlockBytes = 512;
+const size_t kMaxBlockBytes = 64 * 1024;
+
+}  // namespace
+
+BytecodeList::BytecodeList()
+    : block_bytes_(0), reserved_bytes_(0), free_(NULL), free_bytes_(0) {}
+
+BytecodeList::~BytecodeList() {
+  for (BytecodeElement* element : elements_)
+    element->~BytecodeElement();
+}
+
+void* BytecodeList::Allocate(size_t size) {
+  size = (size + kElementAlignment - 1) & ~(kElementAlignment - 1);
+  if (size > free_bytes_) {
+    block_bytes_ = block_bytes_ == 0
+                       ? kFirstBlockBytes
+                       : std::min(block_bytes_ * 2, kMaxBlockBytes);
+    size_t bytes = std::max(block_bytes_, size);
+    blocks_.emplace_back(new char[bytes]);
+    reserved_bytes_ += bytes;
+    free_ = blocks_.back().get();
+    free_bytes_ = bytes;
+  }
+
+  void* storage = free_;
+  free_ += size;
+  free_bytes_ -= size;
+  return storage;
+}
+
+pointer_t BytecodeList::Append(BytecodeElement* element) {
+  elements_.push_back(element);
+  return elements_.size() - 1;
+}
+
+void BytecodeList::ShrinkToFit() { elements_.shrink_to_fit(); }
+
+size_t BytecodeList::memory_usage() const {
+  return reserved_bytes_ + elements_.capacity() * sizeof(BytecodeElement*);
+}
+
 // -----------------------------------------------------------------------
 // Pointers
 // -----------------------------------------------------------------------
@@ -177,12 +241,8 @@ Pointers::~Pointers() {}
 void Pointers::SetPointers(ConstructionData& cdata) {
   assert(target_ids.size() != 0);
   targets.reserve(target_ids.size());
-  for (unsigned int i = 0; i < target_ids.size(); ++i) {
-    ConstructionData::offsets_t::const_iterator it =
-        cdata.offsets.find(target_ids[i]);
-    assert(it != cdata.offsets.end());
-    targets.push_back(it->second);
-  }
+  for (unsigned int i = 0; i < target_ids.size(); ++i)
+    targets.push_back(cdata.ResolveOffset(target_ids[i]));
   target_ids.clear();
 }
 
@@ -194,6 +254,23 @@ BytecodeElement::BytecodeElement() {}
 
 BytecodeElement::~BytecodeElement() {}
 
+void* BytecodeElement::operator new(size_t size, BytecodeList* arena) {
+  return arena ? arena->Allocate(size) : ::operator new(size);
+}
+
+void BytecodeElement::operator delete(void* ptr, BytecodeList* arena) {
+  // Only reached when a constructor throws. Arena storage is reclaimed along
+  // with the rest of the list.
+  if (!arena)
+    ::operator delete(ptr);
+}
+
+void* BytecodeElement::operator new(size_t size) {
+  return ::operator new(size);
+}
+
+void BytecodeElement::operator delete(void* ptr) { ::operator delete(ptr); }
+
 void BytecodeElement::PrintSourceRepresentation(RLMachine* machine,
                                                 std::ostream& oss) const {
   oss << "<unspecified bytecode>" << std::endl;
@@ -223,18 +300,18 @@ BytecodeElement* BytecodeElement::Read(const char* stream,
   switch (c) {
     case 0:
     case ',':
-      return new CommaElement;
+      return new (cdata.arena) CommaElement;
     case '\n':
-      return new MetaElement(0, stream);
+      return new (cdata.arena) MetaElement(0, stream);
     case '@':  // fall through
     case '!':
-      return new MetaElement(&cdata, stream);
+      return new (cdata.arena) MetaElement(&cdata, stream);
     case '$':
-      return new ExpressionElement(stream);
+      return new (cdata.arena) ExpressionElement(stream);
     case '#':
       return ReadFunction(stream, cdata);
     default:
-      return new TextoutElement(stream, end);
+      return new (cdata.arena) TextoutElement(stream, end);
   }
 }
 
@@ -373,16 +450,19 @@ ExpressionElement::ExpressionElement(const char* src)
   const char* end = src;
   parsed_expression_ = GetAssignment(end);
   length_ = std::distance(src, end);
+  program_ = CompiledExpression(parsed_expression_);
 }
 
 ExpressionElement::ExpressionElement(const long val)
     : length_(0),
-      parsed_expression_(ExpressionPiece::IntConstant(val)) {
+      parsed_expression_(ExpressionPiece::IntConstant(val)),
+      program_(parsed_expression_) {
 }
 
 ExpressionElement::ExpressionElement(const ExpressionElement& rhs)
     : length_(0),
-      parsed_expression_(rhs.parsed_expression_) {
+      parsed_expression_(rhs.parsed_expression_),
+      program_(rhs.program_) {
 }
 
 ExpressionElement::~ExpressionElement() {}
@@ -391,6 +471,12 @@ const ExpressionPiece& ExpressionElement::ParsedExpression() const {
   return parsed_expression_;
 }
 
+int ExpressionElement::Evaluate(RLMachine& machine) const {
+  if (program_.is_valid())
+    return program_.Run(machine);
+  return parsed_expression_.GetIntegerValue(machine);
+}
+
 void ExpressionElement::PrintSourceRepresentation(RLMachine* machine,
                                                   std::ostream& oss) const {
   oss << ParsedExpression().GetDebugString() << std::endl;
@@ -412,6 +498,12 @@ CommandElement::CommandElement(const char* src) { memcpy(command, src, 8); }
 
 CommandElement::~CommandElement() {}
 
+void CommandElement::SetCachedOperation(uint64_t epoch,
+                                        RLOperation* op) const {
+  cached_operation_ = op;
+  cached_epoch_ = epoch;
+}
+
 std::vector<std::string> CommandElement::GetUnparsedParameters() const {
   std::vector<std::string> parameters;
   size_t param_count = GetParamCount();
@@ -460,7 +552,7 @@ void CommandElement::PrintSourceRepresentation(RLMachine* machine,
 }
 
 void CommandElement::RunOnMachine(RLMachine& machine) const {
-  machine.ExecuteCommand(*this);
+  machine.RunCommand(*this);
 }
 
 // -----------------------------------------------------------------------
@@ -730,9 +822,7 @@ pointer_t GotoElement::GetPointer(int i) const {
 const size_t GotoElement::GetBytecodeLength() const { return 12; }
 
 void GotoElement::SetPointers(ConstructionData& cdata) {
-  ConstructionData::offsets_t::const_iterator it = cdata.offsets.find(id_);
-  assert(it != cdata.offsets.end());
-  pointer_ = it->second;
+  pointer_ = cdata.ResolveOffset(id_);
 }
 
 // -----------------------------------------------------------------------
@@ -782,9 +872,7 @@ const size_t GotoIfElement::GetBytecodeLength() const {
 }
 
 void GotoIfElement::SetPointers(ConstructionData& cdata) {
-  ConstructionData::offsets_t::const_iterator it = cdata.offsets.find(id_);
-  assert(it != cdata.offsets.end());
-  pointer_ = it->second;
+  pointer_ = cdata.ResolveOffset(id_);
 }
 
 // -----------------------------------------------------------------------
@@ -930,9 +1018,7 @@ const size_t GosubWithElement::GetBytecodeLength() const {
 }
 
 void GosubWithElement::SetPointers(ConstructionData& cdata) {
-  ConstructionData::offsets_t::const_iterator it = cdata.offsets.find(id_);
-  assert(it != cdata.offsets.end());
-  pointer_ = it->second;
+  pointer_ = cdata.ResolveOffset(id_);
 }
 
 }  // namespace libreallive
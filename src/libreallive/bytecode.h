@@ -35,34 +35,87 @@
 #define SRC_LIBREALLIVE_BYTECODE_H_
 
 #include <cstdint>
-#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "libreallive/bytecode_fwd.h"
+#include "libreallive/compiled_expression.h"
 #include "libreallive/defs.h"
 #include "libreallive/expression.h"
 
 class RLMachine;
+class RLOperation;
 
 namespace libreallive {
 
 class CommandElement;
 
-// Returns a representation of the non-special cased function.
-CommandElement* BuildFunctionElement(const char* stream);
+// Returns a representation of the non-special cased function. The element is
+// allocated in |arena| when one is given, and on the heap otherwise.
+CommandElement* BuildFunctionElement(const char* stream,
+                                     BytecodeList* arena = NULL);
 
 void PrintParameterString(std::ostream& oss,
                           const std::vector<std::string>& paramseters);
 
 struct ConstructionData {
-  ConstructionData(size_t kt, pointer_t pt);
+  ConstructionData(size_t kt, BytecodeList* arena);
   ~ConstructionData();
 
+  // Returns the index of the element that starts at byte |offset| of the
+  // bytecode. Throws if no element starts there.
+  pointer_t ResolveOffset(unsigned long offset) const;
+
   std::vector<unsigned long> kidoku_table;
-  pointer_t null;
-  typedef std::map<unsigned long, pointer_t> offsets_t;
-  offsets_t offsets;
+  // Where newly read elements are allocated. NULL puts them on the heap.
+  BytecodeList* arena;
+  // The byte offset of every element read so far, indexed by the element's
+  // position in the BytecodeList. Elements are read in order, so this is
+  // sorted and ResolveOffset() can binary search it.
+  std::vector<unsigned long> offsets;
+};
+
+// The instructions of a Script. Elements are constructed back to back in a
+// few large blocks instead of being allocated one by one, and are addressed
+// by their index so that moving or saving an instruction pointer is O(1).
+class BytecodeList {
+ public:
+  typedef std::vector<BytecodeElement*>::const_iterator const_iterator;
+
+  BytecodeList();
+  ~BytecodeList();
+
+  // Returns uninitialized storage for an element of |size| bytes. Used by
+  // BytecodeElement's placement new.
+  void* Allocate(size_t size);
+
+  // Takes ownership of |element|, which must have been allocated from this
+  // list, and returns its index.
+  pointer_t Append(BytecodeElement* element);
+
+  // Releases slack in the index once parsing is finished.
+  void ShrinkToFit();
+
+  BytecodeElement* operator[](pointer_t index) const {
+    return elements_[index];
+  }
+  size_t size() const { return elements_.size(); }
+
+  const_iterator begin() const { return elements_.cbegin(); }
+  const_iterator end() const { return elements_.cend(); }
+
+  // Bytes held by the blocks and the index, not counting heap memory owned by
+  // the elements themselves.
+  size_t memory_usage() const;
+
+ private:
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  size_t block_bytes_;
+  size_t reserved_bytes_;
+  char* free_;
+  size_t free_bytes_;
+  std::vector<BytecodeElement*> elements_;
 };
 
 class Pointers {
@@ -97,6 +150,14 @@ class BytecodeElement {
   BytecodeElement();
   virtual ~BytecodeElement();
 
+  // Elements belonging to a Scenario live in its BytecodeList and are
+  // destroyed by it. Passing a NULL |arena| allocates on the heap instead, and
+  // the caller owns the element.
+  static void* operator new(size_t size, BytecodeList* arena);
+  static void operator delete(void* ptr, BytecodeList* arena);
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr);
+
   // Prints a human readable version of this bytecode element to |oss|. This
   // tries to match Haeleth's kepago language as much as is feasible.
   virtual void PrintSourceRepresentation(RLMachine* machine,
@@ -199,6 +260,9 @@ class ExpressionElement : public BytecodeElement {
   // Returns an ExpressionPiece representing this expression.
   const ExpressionPiece& ParsedExpression() const;
 
+  // Evaluates the expression, through its compiled form when it has one.
+  int Evaluate(RLMachine& machine) const;
+
   // Overridden from BytecodeElement:
   virtual void PrintSourceRepresentation(RLMachine* machine,
                                          std::ostream& oss) const final;
@@ -211,6 +275,9 @@ class ExpressionElement : public BytecodeElement {
   // Storage for the parsed expression so we only have to calculate
   // it once (and so we can return it by const reference)
   ExpressionPiece parsed_expression_;
+
+  // |parsed_expression_| compiled to stack code, when it can be.
+  CompiledExpression program_;
 };
 
 // Command elements.
@@ -237,6 +304,14 @@ class CommandElement : public BytecodeElement {
   void SetParsedParameters(ExpressionPiecesVector p) const;
   const ExpressionPiecesVector& GetParsedParameters() const;
 
+  // Inline cache for RLMachine::ExecuteCommand(). Returns the RLOperation
+  // stored by SetCachedOperation() if it was stored under |epoch|, and NULL
+  // otherwise.
+  RLOperation* GetCachedOperation(uint64_t epoch) const {
+    return cached_epoch_ == epoch ? cached_operation_ : NULL;
+  }
+  void SetCachedOperation(uint64_t epoch, RLOperation* op) const;
+
   // Returns the number of parameters.
   virtual const size_t GetParamCount() const = 0;
   virtual string GetParam(int index) const = 0;
@@ -259,6 +334,11 @@ class CommandElement : public BytecodeElement {
   unsigned char command[COMMAND_SIZE];
 
   mutable std::vector<ExpressionPiece> parsed_parameters_;
+
+  // The RLOperation this command resolved to, and the dispatch epoch of the
+  // RLMachine that resolved it. Epoch 0 is never handed out.
+  mutable RLOperation* cached_operation_ = NULL;
+  mutable uint64_t cached_epoch_ = 0;
 };
 
 class SelectElement : public CommandElement {
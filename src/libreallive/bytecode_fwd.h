@@ -29,16 +29,17 @@
 #ifndef SRC_LIBREALLIVE_BYTECODE_FWD_H_
 #define SRC_LIBREALLIVE_BYTECODE_FWD_H_
 
-#include <forward_list>
-#include <memory>
+#include <cstddef>
 
 namespace libreallive {
 
 // List definitions.
 class ExpressionPiece;
 class BytecodeElement;
-typedef std::forward_list<std::unique_ptr<BytecodeElement>> BytecodeList;
-typedef BytecodeList::iterator pointer_t;
+class BytecodeList;
+
+// Instructions are addressed by their index in the owning BytecodeList.
+typedef std::size_t pointer_t;
 
 struct ConstructionData;
 class Pointers;
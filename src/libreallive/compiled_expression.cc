@@ -0,0 +1,428 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of libreallive, a dependency of RLVM.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (c) 2016 Elliot Glaysher
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// -----------------------------------------------------------------------
+
+
+#include "libreallive/compiled_expression.h"
+
+#include "libreallive/expression.h"
+#include "libreallive/intmemref.h"
+#include "machine/memory.h"
+#include "machine/rlmachine.h"
+
+namespace libreallive {
+
+namespace {
+
+// Expressions that need a deeper stack than this are left to the tree walker.
+// In practice RealLive code rarely goes beyond a handful of entries.
+const int kMaxStackDepth = 32;
+
+// Whether |ref| is a bit-packed view of one of banks A through Z, which can be
+// bound to its PACKED_INT_ACCESSORS entry ahead of time. intL is left to
+// RLMachine.
+bool IsPackedBankRef(const IntMemRef& ref) {
+  return ref.bank() < INTL_LOCATION && ref.type() > 0 &&
+         ref.type() < NUMBER_OF_PACKED_INT_TYPES;
+}
+
+}  // namespace
+
+CompiledExpression::CompiledExpression() : depth_(0), max_depth_(0) {}
+
+CompiledExpression::CompiledExpression(const ExpressionPiece& piece)
+    : depth_(0), max_depth_(0) {
+  if (!Compile(piece) || max_depth_ > kMaxStackDepth)
+    program_.clear();
+  program_.shrink_to_fit();
+}
+
+CompiledExpression::~CompiledExpression() {}
+
+int CompiledExpression::Run(RLMachine& machine) const {
+  Memory& memory = machine.memory();
+  int stack[kMaxStackDepth];
+  int* top = stack - 1;
+
+  for (const Instruction& instruction : program_) {
+    switch (instruction.op) {
+      case OP_PUSH:
+        *++top = instruction.arg;
+        break;
+      case OP_LOAD_STORE_REGISTER:
+        *++top = machine.store_register();
+        break;
+      case OP_LOAD_BANK:
+        *++top = memory.int_bank(instruction.bank)[instruction.arg];
+        break;
+      case OP_LOAD_BANK_INDIRECT:
+        if (static_cast<unsigned int>(*top) < SIZE_OF_MEM_BANK) {
+          *top = memory.int_bank(instruction.bank)[*top];
+        } else {
+          // Let Memory report the bad access.
+          *top = machine.GetIntValue(IntMemRef(instruction.bank, 0, *top));
+        }
+        break;
+      case OP_LOAD_REF:
+        *++top = machine.GetIntValue(IntMemRef(instruction.bank,
+                                               instruction.arg));
+        break;
+      case OP_LOAD_REF_INDIRECT:
+        *top = machine.GetIntValue(IntMemRef(instruction.bank, *top));
+        break;
+      case OP_LOAD_PACKED:
+        *++top = memory.GetPackedIntValue(
+            PACKED_INT_ACCESSORS[instruction.access], instruction.bank,
+            instruction.arg);
+        break;
+      case OP_LOAD_PACKED_INDIRECT: {
+        const PackedIntAccessor& accessor =
+            PACKED_INT_ACCESSORS[instruction.access];
+        if (static_cast<unsigned int>(*top) <
+            static_cast<unsigned int>(accessor.size)) {
+          *top = memory.GetPackedIntValue(accessor, instruction.bank, *top);
+        } else {
+          *top = machine.GetIntValue(
+              IntMemRef(instruction.bank, instruction.access, *top));
+        }
+        break;
+      }
+      case OP_NEGATE:
+        *top = -*top;
+        break;
+      case OP_ADD:
+        top--;
+        top[0] = top[0] + top[1];
+        break;
+      case OP_SUBTRACT:
+        top--;
+        top[0] = top[0] - top[1];
+        break;
+      case OP_MULTIPLY:
+        top--;
+        top[0] = top[0] * top[1];
+        break;
+      case OP_DIVIDE:
+        top--;
+        if (top[1] != 0)
+          top[0] = top[0] / top[1];
+        break;
+      case OP_MODULO:
+        top--;
+        if (top[1] != 0)
+          top[0] = top[0] % top[1];
+        break;
+      case OP_BITWISE_AND:
+        top--;
+        top[0] = top[0] & top[1];
+        break;
+      case OP_BITWISE_OR:
+        top--;
+        top[0] = top[0] | top[1];
+        break;
+      case OP_BITWISE_XOR:
+        top--;
+        top[0] = top[0] ^ top[1];
+        break;
+      case OP_SHIFT_LEFT:
+        top--;
+        top[0] = top[0] << top[1];
+        break;
+      case OP_SHIFT_RIGHT:
+        top--;
+        top[0] = top[0] >> top[1];
+        break;
+      case OP_EQUAL:
+        top--;
+        top[0] = top[0] == top[1];
+        break;
+      case OP_NOT_EQUAL:
+        top--;
+        top[0] = top[0] != top[1];
+        break;
+      case OP_LESS_OR_EQUAL:
+        top--;
+        top[0] = top[0] <= top[1];
+        break;
+      case OP_LESS:
+        top--;
+        top[0] = top[0] < top[1];
+        break;
+      case OP_GREATER_OR_EQUAL:
+        top--;
+        top[0] = top[0] >= top[1];
+        break;
+      case OP_GREATER:
+        top--;
+        top[0] = top[0] > top[1];
+        break;
+      case OP_LOGICAL_AND:
+        top--;
+        top[0] = top[0] && top[1];
+        break;
+      case OP_LOGICAL_OR:
+        top--;
+        top[0] = top[0] || top[1];
+        break;
+      case OP_STORE_STORE_REGISTER:
+        machine.set_store_register(*top);
+        break;
+      case OP_STORE_REF:
+        machine.SetIntValue(IntMemRef(instruction.bank, instruction.arg),
+                            *top);
+        break;
+      case OP_STORE_REF_INDIRECT:
+        top--;
+        machine.SetIntValue(IntMemRef(instruction.bank, top[1]), top[0]);
+        break;
+      case OP_STORE_PACKED:
+        memory.SetPackedIntValue(PACKED_INT_ACCESSORS[instruction.access],
+                                 instruction.bank, instruction.arg, *top);
+        break;
+      case OP_STORE_PACKED_INDIRECT: {
+        top--;
+        const PackedIntAccessor& accessor =
+            PACKED_INT_ACCESSORS[instruction.access];
+        if (static_cast<unsigned int>(top[1]) <
+            static_cast<unsigned int>(accessor.size)) {
+          memory.SetPackedIntValue(accessor, instruction.bank, top[1],
+                                   top[0]);
+        } else {
+          machine.SetIntValue(
+              IntMemRef(instruction.bank, instruction.access, top[1]), top[0]);
+        }
+        break;
+      }
+    }
+  }
+
+  return *top;
+}
+
+bool CompiledExpression::Compile(const ExpressionPiece& piece) {
+  switch (piece.piece_type) {
+    case TYPE_STORE_REGISTER:
+      Emit(OP_LOAD_STORE_REGISTER, 0, 0);
+      return true;
+    case TYPE_INT_CONSTANT:
+      Emit(OP_PUSH, 0, piece.int_constant);
+      return true;
+    case TYPE_SIMPLE_MEMORY_REFERENCE: {
+      int type = piece.simple_mem_reference.type;
+      int location = piece.simple_mem_reference.location;
+      if (is_string_location(type))
+        return false;
+
+      // Banks A through Z can be read directly once the location is known to
+      // be in range, and their bit-packed views through the accessor for
+      // their width. intL lives in the stack frame and goes through
+      // RLMachine, as do locations that are out of range.
+      IntMemRef ref(type, location);
+      if (ref.type() == 0 && ref.bank() < INTL_LOCATION &&
+          static_cast<unsigned int>(location) < SIZE_OF_MEM_BANK) {
+        Emit(OP_LOAD_BANK, ref.bank(), location);
+      } else if (IsPackedBankRef(ref) &&
+                 static_cast<unsigned int>(location) <
+                     static_cast<unsigned int>(
+                         PACKED_INT_ACCESSORS[ref.type()].size)) {
+        Emit(OP_LOAD_PACKED, ref.bank(), location, ref.type());
+      } else {
+        Emit(OP_LOAD_REF, type, location);
+      }
+      return true;
+    }
+    case TYPE_MEMORY_REFERENCE: {
+      int type = piece.mem_reference.type;
+      if (is_string_location(type) || !Compile(*piece.mem_reference.location))
+        return false;
+
+      IntMemRef ref(type, 0);
+      if (ref.type() == 0 && ref.bank() < INTL_LOCATION)
+        Emit(OP_LOAD_BANK_INDIRECT, ref.bank(), 0);
+      else if (IsPackedBankRef(ref))
+        Emit(OP_LOAD_PACKED_INDIRECT, ref.bank(), 0, ref.type());
+      else
+        Emit(OP_LOAD_REF_INDIRECT, type, 0);
+      return true;
+    }
+    case TYPE_UNIARY_EXPRESSION: {
+      size_t start = program_.size();
+      if (!Compile(*piece.uniary_expression.operand))
+        return false;
+
+      // Every operator other than negation leaves its operand unchanged.
+      if (piece.uniary_expression.operation != 0x01)
+        return true;
+
+      int value;
+      if (IsConstant(start, program_.size(), &value))
+        program_[start].arg = -value;
+      else
+        Emit(OP_NEGATE, 0, 0);
+      return true;
+    }
+    case TYPE_BINARY_EXPRESSION: {
+      const int operation = piece.binary_expression.operation;
+      const ExpressionPiece& lhs = *piece.binary_expression.left_operand;
+      const ExpressionPiece& rhs = *piece.binary_expression.right_operand;
+
+      if (operation == 30)
+        return Compile(rhs) && CompileStore(lhs);
+
+      Opcode op;
+      int base = operation >= 20 && operation < 30 ? operation - 20 : operation;
+      if (base >= 0 && base <= 9)
+        op = static_cast<Opcode>(OP_ADD + base);
+      else if (base >= 40 && base <= 45)
+        op = static_cast<Opcode>(OP_EQUAL + (base - 40));
+      else if (base == 60 || base == 61)
+        op = static_cast<Opcode>(OP_LOGICAL_AND + (base - 60));
+      else
+        return false;  // Let the tree walker throw about the operator.
+
+      size_t start = program_.size();
+      if (!Compile(lhs))
+        return false;
+      size_t rhs_start = program_.size();
+      if (!Compile(rhs))
+        return false;
+
+      // Assignment operators: lhs is read, combined with rhs and written
+      // back, evaluating any location expression twice just like
+      // ExpressionPiece::GetIntegerValue() does.
+      if (operation >= 20 && operation < 30) {
+        Emit(op, 0, 0);
+        return CompileStore(lhs);
+      }
+
+      int left, right;
+      if (IsConstant(start, rhs_start, &left) &&
+          IsConstant(rhs_start, program_.size(), &right)) {
+        program_.resize(start);
+        depth_ -= 2;
+        Emit(OP_PUSH, 0,
+             ExpressionPiece::PerformBinaryOperationOn(operation, left, right));
+      } else {
+        Emit(op, 0, 0);
+      }
+      return true;
+    }
+    case TYPE_SIMPLE_ASSIGNMENT:
+      Emit(OP_PUSH, 0, piece.simple_assignment.value);
+      EmitStore(piece.simple_assignment.type,
+                piece.simple_assignment.location);
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool CompiledExpression::CompileStore(const ExpressionPiece& piece) {
+  switch (piece.piece_type) {
+    case TYPE_STORE_REGISTER:
+      Emit(OP_STORE_STORE_REGISTER, 0, 0);
+      return true;
+    case TYPE_SIMPLE_MEMORY_REFERENCE:
+      if (is_string_location(piece.simple_mem_reference.type))
+        return false;
+      EmitStore(piece.simple_mem_reference.type,
+                piece.simple_mem_reference.location);
+      return true;
+    case TYPE_MEMORY_REFERENCE: {
+      int type = piece.mem_reference.type;
+      if (is_string_location(type) || !Compile(*piece.mem_reference.location))
+        return false;
+
+      IntMemRef ref(type, 0);
+      if (IsPackedBankRef(ref))
+        Emit(OP_STORE_PACKED_INDIRECT, ref.bank(), 0, ref.type());
+      else
+        Emit(OP_STORE_REF_INDIRECT, type, 0);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+void CompiledExpression::EmitStore(int type, int location) {
+  IntMemRef ref(type, location);
+  if (IsPackedBankRef(ref) &&
+      static_cast<unsigned int>(location) <
+          static_cast<unsigned int>(PACKED_INT_ACCESSORS[ref.type()].size)) {
+    Emit(OP_STORE_PACKED, ref.bank(), location, ref.type());
+  } else {
+    Emit(OP_STORE_REF, type, location);
+  }
+}
+
+void CompiledExpression::Emit(Opcode op, int bank, int arg, int access) {
+  program_.push_back(Instruction{op, static_cast<uint8_t>(bank),
+                                 static_cast<uint8_t>(access), arg});
+
+  switch (op) {
+    case OP_PUSH:
+    case OP_LOAD_STORE_REGISTER:
+    case OP_LOAD_BANK:
+    case OP_LOAD_REF:
+    case OP_LOAD_PACKED:
+      depth_++;
+      break;
+    case OP_LOAD_BANK_INDIRECT:
+    case OP_LOAD_REF_INDIRECT:
+    case OP_LOAD_PACKED_INDIRECT:
+    case OP_NEGATE:
+    case OP_STORE_STORE_REGISTER:
+    case OP_STORE_REF:
+    case OP_STORE_PACKED:
+      break;
+    default:
+      // Binary operators and the indirect stores consume two entries and
+      // leave one.
+      depth_--;
+      break;
+  }
+
+  if (depth_ > max_depth_)
+    max_depth_ = depth_;
+}
+
+bool CompiledExpression::IsConstant(size_t start,
+                                    size_t end,
+                                    int* value) const {
+  if (end != start + 1 || program_[start].op != OP_PUSH)
+    return false;
+  *value = program_[start].arg;
+  return true;
+}
+
+}  // namespace libreallive
@@ -0,0 +1,151 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of libreallive, a dependency of RLVM.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (c) 2016 Elliot Glaysher
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// -----------------------------------------------------------------------
+
+
+#ifndef SRC_LIBREALLIVE_COMPILED_EXPRESSION_H_
+#define SRC_LIBREALLIVE_COMPILED_EXPRESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class RLMachine;
+
+namespace libreallive {
+
+class ExpressionPiece;
+
+// An integer ExpressionPiece compiled to a flat postfix program for a small
+// stack machine, so that evaluating it is one loop over an array instead of a
+// recursive walk of the tree with an IntMemRef built at every leaf.
+//
+// While compiling, constant subexpressions are folded, memory references with
+// a constant location in banks A through Z become direct reads of the bank,
+// bit-packed references to those banks are bound to the accessor for their
+// width, and the assignment operators are turned into a load, an operation and
+// a store.
+class CompiledExpression {
+ public:
+  CompiledExpression();
+
+  // Compiles |piece|. Expressions that involve strings or complex or special
+  // parameters, or that nest too deeply, are left uncompiled (see
+  // is_valid()); evaluate the ExpressionPiece for those.
+  explicit CompiledExpression(const ExpressionPiece& piece);
+  ~CompiledExpression();
+
+  bool is_valid() const { return !program_.empty(); }
+
+  // Number of instructions in the program.
+  size_t size() const { return program_.size(); }
+
+  // Evaluates the program. Returns the same value and has the same side
+  // effects (including errors thrown) as ExpressionPiece::GetIntegerValue().
+  int Run(RLMachine& machine) const;
+
+ private:
+  enum Opcode : uint8_t {
+    OP_PUSH,                   // push |arg|
+    OP_LOAD_STORE_REGISTER,    // push the store register
+    OP_LOAD_BANK,              // push bank |bank|[|arg|]
+    OP_LOAD_BANK_INDIRECT,     // pop location, push bank |bank|[location]
+    OP_LOAD_REF,               // push memory ref (|bank|, |arg|)
+    OP_LOAD_REF_INDIRECT,      // pop location, push memory ref (|bank|, loc)
+    OP_LOAD_PACKED,            // push bank |bank| viewed as |access|[|arg|]
+    OP_LOAD_PACKED_INDIRECT,   // pop location, push |bank| as |access|[loc]
+    OP_NEGATE,
+    OP_ADD,
+    OP_SUBTRACT,
+    OP_MULTIPLY,
+    OP_DIVIDE,
+    OP_MODULO,
+    OP_BITWISE_AND,
+    OP_BITWISE_OR,
+    OP_BITWISE_XOR,
+    OP_SHIFT_LEFT,
+    OP_SHIFT_RIGHT,
+    OP_EQUAL,
+    OP_NOT_EQUAL,
+    OP_LESS_OR_EQUAL,
+    OP_LESS,
+    OP_GREATER_OR_EQUAL,
+    OP_GREATER,
+    OP_LOGICAL_AND,
+    OP_LOGICAL_OR,
+    // The stores leave the stored value on the stack, since an assignment is
+    // itself an expression.
+    OP_STORE_STORE_REGISTER,   // store register = top
+    OP_STORE_REF,              // memory ref (|bank|, |arg|) = top
+    OP_STORE_REF_INDIRECT,     // pop location, memory ref (|bank|, loc) = top
+    OP_STORE_PACKED,           // bank |bank| viewed as |access|[|arg|] = top
+    OP_STORE_PACKED_INDIRECT,  // pop location, |bank| as |access|[loc] = top
+  };
+
+  // For the bank and packed ops, |bank| is an index into Memory's integer
+  // banks. For the ref ops it is the bytecode representation of the memory
+  // reference (bank and access type), as in IntMemRef(int, int). |access| is
+  // the bit-packed access type of the packed ops, an index into
+  // PACKED_INT_ACCESSORS.
+  struct Instruction {
+    Opcode op;
+    uint8_t bank;
+    uint8_t access;
+    int32_t arg;
+  };
+
+  // Appends code for |piece| and returns whether it could be compiled.
+  bool Compile(const ExpressionPiece& piece);
+
+  // Appends code that stores the top of the stack into |piece|.
+  bool CompileStore(const ExpressionPiece& piece);
+
+  // Appends a store of the top of the stack to the memory reference |type|
+  // at the constant |location|.
+  void EmitStore(int type, int location);
+
+  void Emit(Opcode op, int bank, int arg, int access = 0);
+
+  // If the code in [|start|, |end|) is a single constant, stores it in
+  // |value|.
+  bool IsConstant(size_t start, size_t end, int* value) const;
+
+  std::vector<Instruction> program_;
+
+  // Deepest the stack gets while running |program_|, tracked while compiling.
+  int depth_;
+  int max_depth_;
+};
+
+}  // namespace libreallive
+
+#endif  // SRC_LIBREALLIVE_COMPILED_EXPRESSION_H_
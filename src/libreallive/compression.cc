@@ -33,6 +33,9 @@
 
 #include "libreallive/compression.h"
 
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <string>
 
 namespace libreallive {
@@ -114,36 +117,112 @@ const XorKey kud_wafter_all_ages_xor_mask[] = {
 
 // -----------------------------------------------------------------------
 
+namespace {
+
+// Undoes the first level xor on |length| bytes of compressed data starting at
+// |src|, writing the result to |dst|. The key byte for each input byte depends
+// only on its offset from the start of the compressed block, so this can be
+// done a word at a time ahead of decompression.
+void UnmaskCompressedData(const char* src, char* dst, size_t length) {
+  static_assert(sizeof(xor_mask) % sizeof(uint64_t) == 0,
+                "xor_mask must be a whole number of words");
+  uint64_t mask_words[sizeof(xor_mask) / sizeof(uint64_t)];
+  memcpy(mask_words, xor_mask, sizeof(xor_mask));
+
+  size_t pos = 0;
+  for (; pos + sizeof(xor_mask) <= length; pos += sizeof(xor_mask)) {
+    for (size_t i = 0; i < sizeof(xor_mask) / sizeof(uint64_t); ++i) {
+      uint64_t word;
+      memcpy(&word, src + pos + i * sizeof(uint64_t), sizeof(uint64_t));
+      word ^= mask_words[i];
+      memcpy(dst + pos + i * sizeof(uint64_t), &word, sizeof(uint64_t));
+    }
+  }
+  for (; pos < length; ++pos)
+    dst[pos] = src[pos] ^ xor_mask[pos % sizeof(xor_mask)];
+}
+
+// Copies 8 bytes from |src| to |dst|. Used for back references, where the
+// ranges may overlap by up to the copy width.
+inline void Copy8(char* dst, const char* src) {
+  uint64_t word;
+  memcpy(&word, src, sizeof(word));
+  memcpy(dst, &word, sizeof(word));
+}
+
+// The longest back reference RealLive can encode.
+const int kMaxMatchLength = 0x0f + 2;
+
+}  // namespace
+
 // Decompress an archived file.
 void Decompress(const char* src,
                 size_t src_len,
                 char* dst,
                 size_t dst_len,
                 const XorKey* per_game_xor_key) {
-  int bit = 1;
-  const char* srcend = src + src_len;
+  // The first eight bytes are the (unmasked) compressed and uncompressed
+  // sizes, which our caller already knows.
+  if (src_len <= 8)
+    return;
+  std::unique_ptr<char[]> unmasked(new char[src_len]);
+  UnmaskCompressedData(src, unmasked.get(), src_len);
+
+  const unsigned char* in =
+      reinterpret_cast<const unsigned char*>(unmasked.get()) + 8;
+  const unsigned char* inend =
+      reinterpret_cast<const unsigned char*>(unmasked.get()) + src_len;
   char* dststart = dst;
   char* dstend = dst + dst_len;
-  src += 8;
-  unsigned char mask = 8;
-  char flag = *src++ ^ xor_mask[mask++];
-  while (src < srcend && dst < dstend) {
+
+  int bit = 1;
+  unsigned char flag = *in++;
+  while (in < inend && dst < dstend) {
     if (bit == 256) {
       bit = 1;
-      flag = *src++ ^ xor_mask[mask++];
+      flag = *in++;
+
+      // A whole group of literals, which is most of the data in text heavy
+      // scenes.
+      if (flag == 0xff && inend - in >= 8 && dstend - dst >= 8) {
+        memcpy(dst, in, 8);
+        dst += 8;
+        in += 8;
+        bit = 256;
+        continue;
+      }
+      if (in >= inend)
+        break;
     }
+
     if (flag & bit) {
-      *dst++ = *src++ ^ xor_mask[mask++];
+      *dst++ = *in++;
     } else {
-      char* repeat;
-      int count = *src++ ^ xor_mask[mask++];
-      count += (*src++ ^ xor_mask[mask++]) << 8;
-      repeat = dst - ((count >> 4) - 1) - 1;
+      if (inend - in < 2)
+        break;
+      int count = in[0] | (in[1] << 8);
+      in += 2;
+      const ptrdiff_t distance = count >> 4;
+      const char* repeat = dst - distance;
       count = (count & 0x0f) + 2;
       if (repeat < dststart || repeat >= dst)
         throw Error("corrupt data");
-      for (int i = 0; i < count; i++)
-        *dst++ = *repeat++;
+
+      if (distance >= 8 && dstend - dst >= kMaxMatchLength + 7) {
+        // Each 8 byte block reads only bytes that are already final, so
+        // overlapping references still repeat correctly. The few bytes past
+        // |count| are overwritten by whatever comes next.
+        Copy8(dst, repeat);
+        Copy8(dst + 8, repeat + 8);
+        if (count > 16)
+          Copy8(dst + 16, repeat + 16);
+        dst += count;
+      } else {
+        if (count > dstend - dst)
+          count = dstend - dst;
+        for (int i = 0; i < count; i++)
+          *dst++ = *repeat++;
+      }
     }
     bit <<= 1;
   }
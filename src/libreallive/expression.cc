@@ -38,6 +38,7 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/tokenizer.hpp>
 
+#include <algorithm>
 #include <iomanip>
 #include <sstream>
 #include <string>
@@ -547,6 +548,62 @@ std::string PrintableToParsableString(const std::string& src) {
 
 // ----------------------------------------------------------------------
 
+namespace {
+
+// Most scenarios only hold a handful of compound expressions, so start small
+// and double up to a limit, like BytecodeList does.
+const size_t kFirstArenaBlockSize = 8;
+const size_t kMaxArenaBlockSize = 512;
+
+}  // namespace
+
+thread_local ExpressionArena* ExpressionArena::current_ = NULL;
+
+ExpressionArena::ExpressionArena() : size_(0) {}
+
+ExpressionArena::~ExpressionArena() {
+  for (Block& block : blocks_) {
+    for (size_t i = 0; i < block.used; ++i)
+      reinterpret_cast<ExpressionPiece*>(&block.slots[i])->~ExpressionPiece();
+  }
+}
+
+ExpressionPiece* ExpressionArena::Allocate(ExpressionPiece&& piece) {
+  if (blocks_.empty() || blocks_.back().used == blocks_.back().capacity) {
+    size_t capacity = blocks_.empty()
+                          ? kFirstArenaBlockSize
+                          : std::min(blocks_.back().capacity * 2,
+                                     kMaxArenaBlockSize);
+    blocks_.push_back(Block{std::unique_ptr<Slot[]>(new Slot[capacity]),
+                            capacity, 0});
+  }
+
+  Block& block = blocks_.back();
+  ExpressionPiece* node =
+      new (&block.slots[block.used]) ExpressionPiece(std::move(piece));
+  block.used++;
+  size_++;
+  return node;
+}
+
+size_t ExpressionArena::memory_usage() const {
+  size_t bytes = blocks_.capacity() * sizeof(Block);
+  for (const Block& block : blocks_)
+    bytes += block.capacity * sizeof(Slot);
+  return bytes;
+}
+
+ScopedExpressionArena::ScopedExpressionArena(ExpressionArena* arena)
+    : previous_(ExpressionArena::current_) {
+  ExpressionArena::current_ = arena;
+}
+
+ScopedExpressionArena::~ScopedExpressionArena() {
+  ExpressionArena::current_ = previous_;
+}
+
+// ----------------------------------------------------------------------
+
 // OK: Here's the current things I need to do more:
 //
 // - I've written a move operator= (I've written the move ctor).
@@ -588,7 +645,7 @@ ExpressionPiece ExpressionPiece::MemoryReference(const int type,
   } else {
     piece.piece_type = TYPE_MEMORY_REFERENCE;
     piece.mem_reference.type = type;
-    piece.mem_reference.location = new ExpressionPiece(std::move(location));
+    piece.mem_reference.location = piece.NewOperand(std::move(location));
   }
   return piece;
 }
@@ -599,7 +656,7 @@ ExpressionPiece ExpressionPiece::UniaryExpression(const char operation,
   ExpressionPiece piece;
   piece.piece_type = TYPE_UNIARY_EXPRESSION;
   piece.uniary_expression.operation = operation;
-  piece.uniary_expression.operand = new ExpressionPiece(std::move(operand));
+  piece.uniary_expression.operand = piece.NewOperand(std::move(operand));
   return piece;
 }
 
@@ -628,8 +685,8 @@ ExpressionPiece ExpressionPiece::BinaryExpression(const char operation,
   } else {
     piece.piece_type = TYPE_BINARY_EXPRESSION;
     piece.binary_expression.operation = operation;
-    piece.binary_expression.left_operand = new ExpressionPiece(std::move(lhs));
-    piece.binary_expression.right_operand = new ExpressionPiece(std::move(rhs));
+    piece.binary_expression.left_operand = piece.NewOperand(std::move(lhs));
+    piece.binary_expression.right_operand = piece.NewOperand(std::move(rhs));
   }
   return piece;
 }
@@ -652,11 +709,12 @@ ExpressionPiece ExpressionPiece::SpecialExpression(const int tag) {
 }
 
 ExpressionPiece::ExpressionPiece(invalid_expression_piece_t)
-    : piece_type(TYPE_INVALID) {
+    : piece_type(TYPE_INVALID), owns_operands(true) {
 }
 
 ExpressionPiece::ExpressionPiece(const ExpressionPiece& rhs)
-    : piece_type(rhs.piece_type) {
+    : piece_type(rhs.piece_type),
+      owns_operands(rhs.owns_operands || ExpressionArena::current() == NULL) {
   switch (piece_type) {
     case TYPE_STORE_REGISTER:
       break;
@@ -668,8 +726,7 @@ ExpressionPiece::ExpressionPiece(const ExpressionPiece& rhs)
       break;
     case TYPE_MEMORY_REFERENCE:
       mem_reference.type = rhs.mem_reference.type;
-      mem_reference.location =
-          new ExpressionPiece(*rhs.mem_reference.location);
+      mem_reference.location = CopyOperand(rhs.mem_reference.location);
       break;
     case TYPE_SIMPLE_MEMORY_REFERENCE:
       simple_mem_reference.type = rhs.simple_mem_reference.type;
@@ -677,15 +734,14 @@ ExpressionPiece::ExpressionPiece(const ExpressionPiece& rhs)
       break;
     case TYPE_UNIARY_EXPRESSION:
       uniary_expression.operation = rhs.uniary_expression.operation;
-      uniary_expression.operand =
-          new ExpressionPiece(*rhs.uniary_expression.operand);
+      uniary_expression.operand = CopyOperand(rhs.uniary_expression.operand);
       break;
     case TYPE_BINARY_EXPRESSION:
       binary_expression.operation = rhs.binary_expression.operation;
       binary_expression.left_operand =
-          new ExpressionPiece(*rhs.binary_expression.left_operand);
+          CopyOperand(rhs.binary_expression.left_operand);
       binary_expression.right_operand =
-          new ExpressionPiece(*rhs.binary_expression.right_operand);
+          CopyOperand(rhs.binary_expression.right_operand);
       break;
     case TYPE_SIMPLE_ASSIGNMENT:
       simple_assignment.type = rhs.simple_assignment.type;
@@ -707,7 +763,7 @@ ExpressionPiece::ExpressionPiece(const ExpressionPiece& rhs)
 }
 
 ExpressionPiece::ExpressionPiece(ExpressionPiece&& rhs)
-    : piece_type(rhs.piece_type) {
+    : piece_type(rhs.piece_type), owns_operands(rhs.owns_operands) {
   switch (piece_type) {
     case TYPE_STORE_REGISTER:
       break;
@@ -767,6 +823,8 @@ ExpressionPiece& ExpressionPiece::operator=(const ExpressionPiece& rhs) {
   Invalidate();
 
   piece_type = rhs.piece_type;
+  owns_operands =
+      rhs.owns_operands || ExpressionArena::current() == NULL;
   switch (piece_type) {
     case TYPE_STORE_REGISTER:
       break;
@@ -778,8 +836,7 @@ ExpressionPiece& ExpressionPiece::operator=(const ExpressionPiece& rhs) {
       break;
     case TYPE_MEMORY_REFERENCE:
       mem_reference.type = rhs.mem_reference.type;
-      mem_reference.location =
-          new ExpressionPiece(*rhs.mem_reference.location);
+      mem_reference.location = CopyOperand(rhs.mem_reference.location);
       break;
     case TYPE_SIMPLE_MEMORY_REFERENCE:
       simple_mem_reference.type = rhs.simple_mem_reference.type;
@@ -787,15 +844,14 @@ ExpressionPiece& ExpressionPiece::operator=(const ExpressionPiece& rhs) {
       break;
     case TYPE_UNIARY_EXPRESSION:
       uniary_expression.operation = rhs.uniary_expression.operation;
-      uniary_expression.operand =
-          new ExpressionPiece(*rhs.uniary_expression.operand);
+      uniary_expression.operand = CopyOperand(rhs.uniary_expression.operand);
       break;
     case TYPE_BINARY_EXPRESSION:
       binary_expression.operation = rhs.binary_expression.operation;
       binary_expression.left_operand =
-          new ExpressionPiece(*rhs.binary_expression.left_operand);
+          CopyOperand(rhs.binary_expression.left_operand);
       binary_expression.right_operand =
-          new ExpressionPiece(*rhs.binary_expression.right_operand);
+          CopyOperand(rhs.binary_expression.right_operand);
       break;
     case TYPE_SIMPLE_ASSIGNMENT:
       simple_assignment.type = rhs.simple_assignment.type;
@@ -822,6 +878,7 @@ ExpressionPiece& ExpressionPiece::operator=(ExpressionPiece&& rhs) {
   Invalidate();
 
   piece_type = rhs.piece_type;
+  owns_operands = rhs.owns_operands;
   switch (piece_type) {
     case TYPE_STORE_REGISTER:
       break;
@@ -1159,7 +1216,25 @@ std::string ExpressionPiece::GetDebugString() const {
 
 // -----------------------------------------------------------------------------
 
-ExpressionPiece::ExpressionPiece() : piece_type(TYPE_INVALID) {}
+ExpressionPiece::ExpressionPiece()
+    : piece_type(TYPE_INVALID),
+      owns_operands(ExpressionArena::current() == NULL) {}
+
+ExpressionPiece* ExpressionPiece::NewOperand(ExpressionPiece&& operand) const {
+  if (owns_operands)
+    return new ExpressionPiece(std::move(operand));
+  return ExpressionArena::current()->Allocate(std::move(operand));
+}
+
+ExpressionPiece* ExpressionPiece::CopyOperand(ExpressionPiece* operand) const {
+  if (!owns_operands)
+    return operand;
+
+  // A copy made outside of the arena's scope may outlive it, so copy the
+  // whole subtree onto the heap.
+  ScopedExpressionArena heap(NULL);
+  return new ExpressionPiece(*operand);
+}
 
 void ExpressionPiece::Invalidate() {
   // Needed to get around a quirk of the language
@@ -1174,16 +1249,20 @@ void ExpressionPiece::Invalidate() {
       str_constant.~string_type();
       break;
     case TYPE_MEMORY_REFERENCE:
-      delete mem_reference.location;
+      if (owns_operands)
+        delete mem_reference.location;
       break;
     case TYPE_SIMPLE_MEMORY_REFERENCE:
       break;
     case TYPE_UNIARY_EXPRESSION:
-      delete uniary_expression.operand;
+      if (owns_operands)
+        delete uniary_expression.operand;
       break;
     case TYPE_BINARY_EXPRESSION:
-      delete binary_expression.left_operand;
-      delete binary_expression.right_operand;
+      if (owns_operands) {
+        delete binary_expression.left_operand;
+        delete binary_expression.right_operand;
+      }
       break;
     case TYPE_SIMPLE_ASSIGNMENT:
       break;
@@ -37,6 +37,7 @@
 
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "machine/reference.h"
@@ -94,6 +95,12 @@ enum ExpressionPieceType {
 
 struct invalid_expression_piece_t {};
 
+// A parsed RealLive expression. Operands of compound expressions are separate
+// nodes. When an ExpressionArena is current (see ScopedExpressionArena), the
+// nodes are placed in the arena, the piece doesn't own them, and copying the
+// piece while the arena is current only copies the pointers. Copies made
+// outside the arena's scope, and pieces parsed without an arena, own their
+// operands and are deep.
 class ExpressionPiece {
  public:
   static ExpressionPiece StoreRegister();
@@ -173,11 +180,20 @@ class ExpressionPiece {
   int GetOverloadTag() const;
 
  private:
+  friend class CompiledExpression;
+
   ExpressionPiece();
 
   // Frees all possible memory and sets |piece_type| to TYPE_INVALID.
   void Invalidate();
 
+  // Returns storage for an operand of this piece: in the current arena, or on
+  // the heap if this piece owns its operands.
+  ExpressionPiece* NewOperand(ExpressionPiece&& operand) const;
+
+  // Returns the operand to use for a copy of this piece.
+  ExpressionPiece* CopyOperand(ExpressionPiece* operand) const;
+
   // Implementations of some of the public interface where they aren't one
   // liners.
   std::string GetComplexSerializedExpression(RLMachine& machine) const;
@@ -197,6 +213,10 @@ class ExpressionPiece {
 
   ExpressionPieceType piece_type;
 
+  // Whether the operand pointers below are heap allocations owned by this
+  // piece, as opposed to nodes in an ExpressionArena.
+  bool owns_operands;
+
   union {
     // TYPE_INT_CONSTANT
     int int_constant;
@@ -249,6 +269,60 @@ class ExpressionPiece {
 
 typedef std::vector<libreallive::ExpressionPiece> ExpressionPiecesVector;
 
+// Bulk storage for the operand nodes of every expression parsed from one
+// Scenario. Nodes are constructed in blocks of growing size and are destroyed
+// together with the arena, so parsing doesn't make an allocation per node and
+// the nodes of one expression end up next to each other in memory.
+class ExpressionArena {
+ public:
+  ExpressionArena();
+  ~ExpressionArena();
+
+  // Moves |piece| into the arena and returns its address, which stays valid
+  // for the lifetime of the arena.
+  ExpressionPiece* Allocate(ExpressionPiece&& piece);
+
+  // Number of nodes in the arena.
+  size_t size() const { return size_; }
+
+  // Bytes reserved by the arena, including slots not handed out yet.
+  size_t memory_usage() const;
+
+  // The arena expressions parsed on this thread are placed in, or NULL.
+  static ExpressionArena* current() { return current_; }
+
+ private:
+  friend class ScopedExpressionArena;
+
+  typedef std::aligned_storage<sizeof(ExpressionPiece),
+                               alignof(ExpressionPiece)>::type Slot;
+
+  static thread_local ExpressionArena* current_;
+
+  struct Block {
+    std::unique_ptr<Slot[]> slots;
+    size_t capacity;
+    size_t used;
+  };
+
+  std::vector<Block> blocks_;
+  size_t size_;
+
+  ExpressionArena(const ExpressionArena&) = delete;
+  ExpressionArena& operator=(const ExpressionArena&) = delete;
+};
+
+// Makes |arena| the current ExpressionArena on this thread until destroyed.
+// Passing NULL makes parsed expressions own their operands again.
+class ScopedExpressionArena {
+ public:
+  explicit ScopedExpressionArena(ExpressionArena* arena);
+  ~ScopedExpressionArena();
+
+ private:
+  ExpressionArena* previous_;
+};
+
 }  // namespace libreallive
 
 #endif  // SRC_LIBREALLIVE_EXPRESSION_H_
@@ -37,6 +37,7 @@
 #include <cassert>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "libreallive/compression.h"
 #include "utilities/exception.h"
@@ -108,20 +109,15 @@ Header::Header(const char* data, const size_t length) {
 
 Header::~Header() {}
 
-Script::Script(const Header& hdr,
-               const char* data,
-               const size_t length,
-               const std::string& regname,
-               bool use_xor_2,
-               const compression::XorKey* second_level_xor_key) {
-  // Kidoku/entrypoint table
-  const int kidoku_offs = read_i32(data + 0x08);
-  const size_t kidoku_length = read_i32(data + 0x0c);
-  ConstructionData cdat(kidoku_length, elts_.end());
-  for (size_t i = 0; i < kidoku_length; ++i)
-    cdat.kidoku_table[i] = read_i32(data + kidoku_offs + i * 4);
+namespace {
 
-  // Decompress data
+// Undoes the compression and xor obfuscation on the bytecode of the scenario
+// file |data|, writing the plain bytecode to |out|.
+void DecompressBytecode(const char* data,
+                        bool use_xor_2,
+                        const std::string& regname,
+                        const compression::XorKey* second_level_xor_key,
+                        std::vector<char>* out) {
   const size_t dlen = read_i32(data + 0x24);
 
   const compression::XorKey* key = NULL;
@@ -140,29 +136,75 @@ Script::Script(const Header& hdr,
     }
   }
 
-  char* uncompressed = new char[dlen];
+  out->resize(dlen);
   compression::Decompress(data + read_i32(data + 0x20),
                           read_i32(data + 0x28),
-                          uncompressed,
+                          out->data(),
                           dlen,
                           key);
+}
+
+}  // namespace
+
+void DecompressScenario(const FilePos& fp,
+                        const std::string& regname,
+                        const compression::XorKey* second_level_xor_key,
+                        std::vector<char>* out) {
+  Header header(fp.data, fp.length);
+  DecompressBytecode(
+      fp.data, header.use_xor_2_, regname, second_level_xor_key, out);
+}
+
+const pointer_t Script::kNoEntrypoint;
+
+Script::Script(const Header& hdr,
+               const char* data,
+               const size_t length,
+               const std::string& regname,
+               bool use_xor_2,
+               const compression::XorKey* second_level_xor_key,
+               const FilePos& bytecode) {
+  // Kidoku/entrypoint table
+  const int kidoku_offs = read_i32(data + 0x08);
+  const size_t kidoku_length = read_i32(data + 0x0c);
+  ConstructionData cdat(kidoku_length, &elts_);
+  for (size_t i = 0; i < kidoku_length; ++i)
+    cdat.kidoku_table[i] = read_i32(data + kidoku_offs + i * 4);
+
+  // Decompress data, unless the caller already has it.
+  std::vector<char> decompressed;
+  const char* uncompressed = bytecode.data;
+  size_t dlen = bytecode.length;
+  if (!uncompressed) {
+    DecompressBytecode(
+        data, use_xor_2, regname, second_level_xor_key, &decompressed);
+    uncompressed = decompressed.data();
+    dlen = decompressed.size();
+  }
+
   // Read bytecode
+  ScopedExpressionArena scope(&expressions_);
   const char* stream = uncompressed;
   const char* end = uncompressed + dlen;
   size_t pos = 0;
-  pointer_t it = elts_.before_begin();
   while (pos < dlen) {
     // Read element
-    it = elts_.emplace_after(it, BytecodeElement::Read(stream, end, cdat));
-    cdat.offsets[pos] = it;
+    BytecodeElement* element = BytecodeElement::Read(stream, end, cdat);
+    pointer_t it = elts_.Append(element);
+    cdat.offsets.push_back(pos);
 
     // Keep track of the entrypoints
-    int entrypoint = (*it)->GetEntrypoint();
-    if (entrypoint != BytecodeElement::kInvalidEntrypoint)
-      entrypoint_associations_.emplace(entrypoint, it);
+    int entrypoint = element->GetEntrypoint();
+    if (entrypoint >= 0 && entrypoint < kMaxEntrypoints) {
+      if (static_cast<size_t>(entrypoint) >= entrypoint_associations_.size())
+        entrypoint_associations_.resize(entrypoint + 1, kNoEntrypoint);
+      // The first declaration of an entrypoint wins.
+      if (entrypoint_associations_[entrypoint] == kNoEntrypoint)
+        entrypoint_associations_[entrypoint] = it;
+    }
 
     // Advance
-    size_t l = (*it)->GetBytecodeLength();
+    size_t l = element->GetBytecodeLength();
     if (l <= 0)
       l = 1;  // Failsafe: always advance at least one byte.
     stream += l;
@@ -170,21 +212,22 @@ Script::Script(const Header& hdr,
   }
 
   // Resolve pointers
-  for (auto& element : elts_) {
+  for (BytecodeElement* element : elts_) {
     element->SetPointers(cdat);
   }
-
-  delete[] uncompressed;
+  elts_.ShrinkToFit();
 }
 
 Script::~Script() {}
 
 const pointer_t Script::GetEntrypoint(int entrypoint) const {
-  pointernumber::const_iterator it = entrypoint_associations_.find(entrypoint);
-  if (it == entrypoint_associations_.end())
+  if (entrypoint < 0 ||
+      static_cast<size_t>(entrypoint) >= entrypoint_associations_.size() ||
+      entrypoint_associations_[entrypoint] == kNoEntrypoint) {
     throw Error("Unknown entrypoint");
+  }
 
-  return it->second;
+  return entrypoint_associations_[entrypoint];
 }
 
 Scenario::Scenario(const char* data, const size_t length, int sn,
@@ -192,22 +235,23 @@ Scenario::Scenario(const char* data, const size_t length, int sn,
                    const compression::XorKey* second_level_xor_key)
   : header(data, length),
     script(header, data, length, regname,
-           header.use_xor_2_, second_level_xor_key),
+           header.use_xor_2_, second_level_xor_key, FilePos()),
     scenario_number_(sn) {
 }
 
 Scenario::Scenario(const FilePos& fp, int sn,
                    const std::string& regname,
-                   const compression::XorKey* second_level_xor_key)
+                   const compression::XorKey* second_level_xor_key,
+                   const FilePos& bytecode)
   : header(fp.data, fp.length),
     script(header, fp.data, fp.length, regname,
-           header.use_xor_2_, second_level_xor_key),
+           header.use_xor_2_, second_level_xor_key, bytecode),
     scenario_number_(sn) {
 }
 
 Scenario::~Scenario() {}
 
-Scenario::const_iterator Scenario::FindEntrypoint(int entrypoint) const {
+pointer_t Scenario::FindEntrypoint(int entrypoint) const {
   return script.GetEntrypoint(entrypoint);
 }
 
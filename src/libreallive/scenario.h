@@ -35,6 +35,7 @@
 #define SRC_LIBREALLIVE_SCENARIO_H_
 
 #include <string>
+#include <vector>
 
 #include "libreallive/defs.h"
 #include "libreallive/bytecode.h"
@@ -52,9 +53,12 @@ class Scenario {
   Scenario(const char* data, const size_t length, int scenarioNum,
            const std::string& regname,
            const compression::XorKey* second_level_xor_key);
+  // |bytecode| optionally points at the decompressed bytecode for |fp|
+  // (usually from a ScenarioCache), which skips decompression.
   Scenario(const FilePos& fp, int scenarioNum,
            const std::string& regname,
-           const compression::XorKey* second_level_xor_key);
+           const compression::XorKey* second_level_xor_key,
+           const FilePos& bytecode = FilePos());
   ~Scenario();
 
   // Get the scenario number
@@ -71,13 +75,30 @@ class Scenario {
 
   // Access to script
   typedef BytecodeList::const_iterator const_iterator;
-  typedef BytecodeList::iterator iterator;
 
-  const_iterator begin() const  { return script.elts_.cbegin(); }
-  const_iterator end() const    { return script.elts_.cend();   }
+  const_iterator begin() const  { return script.elts_.begin(); }
+  const_iterator end() const    { return script.elts_.end();   }
+
+  // Number of instructions; valid instruction pointers are below this.
+  size_t size() const { return script.elts_.size(); }
+
+  // Returns the instruction at |location|.
+  const BytecodeElement* GetElement(pointer_t location) const {
+    return script.elts_[location];
+  }
+
+  // Bytes used to store the parsed instructions and the expressions parsed
+  // from them so far.
+  size_t memory_usage() const {
+    return script.elts_.memory_usage() + script.expressions_.memory_usage();
+  }
+
+  // Where the expressions of this scenario's instructions are stored. Make it
+  // current (see ScopedExpressionArena) while parsing their parameters.
+  ExpressionArena* expression_arena() const { return &script.expressions_; }
 
   // Locate the entrypoint
-  const_iterator FindEntrypoint(int entrypoint) const;
+  pointer_t FindEntrypoint(int entrypoint) const;
 
  private:
   Header header;
@@ -85,6 +106,13 @@ class Scenario {
   int scenario_number_;
 };
 
+// Decompresses the bytecode of the scenario file at |fp| into |out| without
+// parsing it. Throws the same errors as constructing a Scenario would.
+void DecompressScenario(const FilePos& fp,
+                        const std::string& regname,
+                        const compression::XorKey* second_level_xor_key,
+                        std::vector<char>* out);
+
 }  // namespace libreallive
 
 #endif  // SRC_LIBREALLIVE_SCENARIO_H_
@@ -0,0 +1,187 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of libreallive, a dependency of RLVM.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (c) 2016 Elliot Glaysher
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// -----------------------------------------------------------------------
+
+#include "libreallive/scenario_cache.h"
+
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace fs = boost::filesystem;
+
+namespace libreallive {
+
+namespace {
+
+// File layout, all integers little endian:
+//
+//   0x00  magic "RLVMSCN\0"
+//   0x08  format version
+//   0x0c  key, low 32 bits
+//   0x10  key, high 32 bits
+//   0x14  number of scenarios
+//   0x18  per scenario: scene number, offset of bytecode, length of bytecode
+//
+// Bump kFormatVersion whenever the layout or the meaning of the bytecode
+// changes; old caches are then silently rebuilt.
+const char kMagic[8] = {'R', 'L', 'V', 'M', 'S', 'C', 'N', '\0'};
+const int kFormatVersion = 1;
+const size_t kHeaderSize = 0x18;
+const size_t kEntrySize = 12;
+
+const uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+const uint64_t kFnvPrime = 0x100000001b3ULL;
+
+uint64_t Fnv1a(uint64_t hash, const char* data, size_t length) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= bytes[i];
+    hash *= kFnvPrime;
+  }
+  return hash;
+}
+
+uint64_t Fnv1a(uint64_t hash, uint32_t value) {
+  char bytes[4];
+  insert_i32(bytes, value);
+  return Fnv1a(hash, bytes, sizeof(bytes));
+}
+
+uint32_t ReadU32(const char* src) {
+  return static_cast<uint32_t>(read_i32(src));
+}
+
+}  // namespace
+
+ScenarioCache::ScenarioCache(const std::string& path, uint64_t key) {
+  std::unique_ptr<Mapping> mapping;
+  try {
+    mapping.reset(new Mapping(path, Read));
+  }
+  catch (Error&) {
+    return;
+  }
+
+  const char* data = mapping->get();
+  const size_t size = mapping->size();
+  if (size < kHeaderSize || memcmp(data, kMagic, sizeof(kMagic)) != 0 ||
+      read_i32(data + 0x08) != kFormatVersion ||
+      ReadU32(data + 0x0c) != static_cast<uint32_t>(key) ||
+      ReadU32(data + 0x10) != static_cast<uint32_t>(key >> 32)) {
+    return;
+  }
+
+  const size_t count = ReadU32(data + 0x14);
+  if (count > (size - kHeaderSize) / kEntrySize)
+    return;
+
+  const char* entry = data + kHeaderSize;
+  for (size_t i = 0; i < count; ++i, entry += kEntrySize) {
+    const size_t offset = ReadU32(entry + 4);
+    const size_t length = ReadU32(entry + 8);
+    if (offset > size || length > size - offset) {
+      entries_.clear();
+      return;
+    }
+    entries_[read_i32(entry)] = FilePos(data + offset, length);
+  }
+
+  mapping_ = std::move(mapping);
+}
+
+ScenarioCache::~ScenarioCache() {}
+
+FilePos ScenarioCache::Find(int scenario) const {
+  auto it = entries_.find(scenario);
+  if (it == entries_.end())
+    return FilePos();
+  return it->second;
+}
+
+// static
+uint64_t ScenarioCache::KeyFor(const std::map<int, FilePos>& scenarios,
+                               const std::string& regname) {
+  uint64_t hash = Fnv1a(kFnvOffsetBasis, regname.data(), regname.size() + 1);
+  for (auto const& scenario : scenarios) {
+    hash = Fnv1a(hash, scenario.first);
+    hash = Fnv1a(hash, scenario.second.length);
+    hash = Fnv1a(hash, scenario.second.data, scenario.second.length);
+  }
+  return hash;
+}
+
+// static
+bool ScenarioCache::Write(const std::string& path,
+                          uint64_t key,
+                          const std::map<int, std::vector<char>>& bytecode) {
+  string header(kHeaderSize + bytecode.size() * kEntrySize, '\0');
+  memcpy(&header[0], kMagic, sizeof(kMagic));
+  insert_i32(header, 0x08, kFormatVersion);
+  insert_i32(header, 0x0c, static_cast<uint32_t>(key));
+  insert_i32(header, 0x10, static_cast<uint32_t>(key >> 32));
+  insert_i32(header, 0x14, bytecode.size());
+
+  size_t offset = header.size();
+  int entry = kHeaderSize;
+  for (auto const& scenario : bytecode) {
+    insert_i32(header, entry, scenario.first);
+    insert_i32(header, entry + 4, offset);
+    insert_i32(header, entry + 8, scenario.second.size());
+    entry += kEntrySize;
+    offset += scenario.second.size();
+  }
+
+  const std::string temp_path = path + ".tmp";
+  std::ofstream out(temp_path.c_str(), std::ios::binary | std::ios::trunc);
+  out.write(header.data(), header.size());
+  for (auto const& scenario : bytecode)
+    out.write(scenario.second.data(), scenario.second.size());
+  out.close();
+
+  boost::system::error_code ec;
+  if (out.fail()) {
+    fs::remove(temp_path, ec);
+    return false;
+  }
+
+  fs::rename(temp_path, path, ec);
+  if (ec) {
+    fs::remove(temp_path, ec);
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace libreallive
@@ -0,0 +1,90 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of libreallive, a dependency of RLVM.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (c) 2016 Elliot Glaysher
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+// -----------------------------------------------------------------------
+
+#ifndef SRC_LIBREALLIVE_SCENARIO_CACHE_H_
+#define SRC_LIBREALLIVE_SCENARIO_CACHE_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "libreallive/defs.h"
+#include "libreallive/filemap.h"
+#include "libreallive/scenario.h"
+
+namespace libreallive {
+
+// An on disk copy of the decompressed bytecode of every scenario in an
+// Archive, so that later runs can skip decompression. The file is a small
+// table of contents followed by the bytecode of each scenario, and is mapped
+// into memory rather than read.
+//
+// Each cache is tagged with a key computed from the scenario data it was built
+// from (see KeyFor()). A cache whose key, format version or layout doesn't
+// match is treated as missing, and the Archive rebuilds and overwrites it.
+class ScenarioCache {
+ public:
+  // Maps the cache file at |path|. The cache is only usable (valid()) if the
+  // file exists, is intact and was written for |key|.
+  ScenarioCache(const std::string& path, uint64_t key);
+  ~ScenarioCache();
+
+  bool valid() const { return mapping_ != NULL; }
+
+  // Returns the decompressed bytecode for |scenario|, or an empty FilePos if
+  // the cache doesn't have it.
+  FilePos Find(int scenario) const;
+
+  // Computes the cache key for the scenarios in an archive. Covers the raw
+  // scenario data (including loose SEENxxxx.TXT overrides) and the #REGNAME,
+  // which picks the second level xor key.
+  static uint64_t KeyFor(const std::map<int, FilePos>& scenarios,
+                         const std::string& regname);
+
+  // Writes a cache for |key| holding |bytecode| to |path|. The file is
+  // written next to |path| and renamed into place, so a crash never leaves a
+  // half written cache behind. Returns false on any I/O error.
+  static bool Write(const std::string& path,
+                    uint64_t key,
+                    const std::map<int, std::vector<char>>& bytecode);
+
+ private:
+  std::unique_ptr<Mapping> mapping_;
+  std::map<int, FilePos> entries_;
+};
+
+}  // namespace libreallive
+
+#endif  // SRC_LIBREALLIVE_SCENARIO_CACHE_H_
@@ -29,7 +29,6 @@
 #ifndef SRC_LIBREALLIVE_SCENARIO_INTERNALS_H_
 #define SRC_LIBREALLIVE_SCENARIO_INTERNALS_H_
 
-#include <map>
 #include <string>
 #include <vector>
 
@@ -81,16 +80,26 @@ class Script {
  private:
   friend class Scenario;
 
+  // |bytecode| is the already decompressed bytecode of |data|, or an empty
+  // FilePos if it still needs to be decompressed.
   Script(const Header& hdr, const char* data, const size_t length,
          const std::string& regname,
-         bool use_xor_2, const compression::XorKey* second_level_xor_key);
+         bool use_xor_2, const compression::XorKey* second_level_xor_key,
+         const FilePos& bytecode);
   ~Script();
 
+  // Operands of the expressions in |elts_|, including parameters parsed
+  // lazily when a command first runs. Mutable for that reason.
+  mutable ExpressionArena expressions_;
+
   BytecodeList elts_;
 
-  // Entrypoint handeling
-  typedef std::map<int, pointer_t> pointernumber;
-  pointernumber entrypoint_associations_;
+  // Entrypoint handeling. RealLive entrypoints are small integers (#Z00 to
+  // #Z99), so they index straight into a table of instruction pointers, with
+  // kNoEntrypoint marking the unused ones.
+  static const int kMaxEntrypoints = 1000;
+  static const pointer_t kNoEntrypoint = static_cast<pointer_t>(-1);
+  std::vector<pointer_t> entrypoint_associations_;
 };
 
 #endif  // SRC_LIBREALLIVE_SCENARIO_INTERNALS_H_
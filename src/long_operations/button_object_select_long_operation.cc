@@ -48,14 +48,17 @@ ButtonObjectSelectLongOperation::ButtonObjectSelectLongOperation(
     if (obj.IsButton() && obj.GetButtonGroup() == group_) {
       buttons_.emplace_back(&obj, static_cast<GraphicsObject*>(NULL));
     } else if (obj.has_object_data()) {
-      ParentGraphicsObjectData* parent =
-          dynamic_cast<ParentGraphicsObjectData*>(&obj.GetObjectData());
-
-      if (parent) {
-        for (GraphicsObject& child : parent->objects()) {
-          if (child.IsButton() && child.GetButtonGroup() == group_) {
-            buttons_.emplace_back(&child, &obj);
-          }
+      // Only ask for mutable data once we know there are children to hand
+      // out; that marks the data changed for the next savepoint.
+      const GraphicsObject& const_obj = obj;
+      if (!const_obj.GetObjectData().IsParentLayer())
+        continue;
+
+      ParentGraphicsObjectData& parent =
+          static_cast<ParentGraphicsObjectData&>(obj.GetObjectData());
+      for (GraphicsObject& child : parent.objects()) {
+        if (child.IsButton() && child.GetButtonGroup() == group_) {
+          buttons_.emplace_back(&child, &obj);
         }
       }
     }
@@ -79,8 +82,7 @@ void ButtonObjectSelectLongOperation::MouseMotion(const Point& point) {
 
   for (ButtonPair& button_pair : buttons_) {
     if (button_pair.first->has_object_data()) {
-      GraphicsObjectData* data = &button_pair.first->GetObjectData();
-      Rect screen_rect = data->DstRect(*button_pair.first, button_pair.second);
+      Rect screen_rect = button_pair.first->DstRect(button_pair.second);
 
       if (screen_rect.Contains(point))
         hovering_button = button_pair.first;
@@ -148,6 +148,8 @@ UndefinedFunction::UndefinedFunction(int modtype,
       opcode_(opcode),
       overload_(overload) {}
 
+bool UndefinedFunction::IsImplemented() const { return false; }
+
 void UndefinedFunction::Dispatch(
     RLMachine& machine,
     const libreallive::ExpressionPiecesVector& parameters) {
@@ -188,6 +188,9 @@ class UndefinedFunction : public RLOp_SpecialCase {
   // all these methods so we error as early as possible when trying to use this
   // invalid opcode.
 
+  // RLOperation:
+  virtual bool IsImplemented() const override;
+
   // RLOp_SpecialCase:
   virtual void Dispatch(
       RLMachine& machine,
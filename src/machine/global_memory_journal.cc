@@ -0,0 +1,295 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+#include "machine/global_memory_journal.h"
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/crc.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/utility.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include <istream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "machine/memory.h"
+
+namespace {
+
+// Bumped whenever GlobalMemoryDelta changes. Replay() stops at a record of
+// another version.
+const int kJournalVersion = 1;
+
+// Each record starts with its payload's length, the CRC of its sequence
+// number and payload, and its sequence number.
+const size_t kFrameHeaderSize = 12;
+
+// Anything longer is a corrupt length, not a record.
+const uint32_t kMaxRecordSize = 64 * 1024 * 1024;
+
+void AppendUint32(std::string& dest, uint32_t value) {
+  for (int i = 0; i < 4; ++i)
+    dest += static_cast<char>((value >> (i * 8)) & 0xff);
+}
+
+uint32_t ReadUint32(const char* src) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(src);
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+         (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+uint32_t Checksum(const char* sequence, const std::string& payload) {
+  boost::crc_32_type crc;
+  crc.process_bytes(sequence, 4);
+  crc.process_bytes(payload.data(), payload.size());
+  return crc.checksum();
+}
+
+// What changed in a GlobalMemory between two records.
+struct GlobalMemoryDelta {
+  template <typename T>
+  using Cells = std::vector<std::pair<int, T>>;
+
+  // The kidoku bitset of one scenario. Normally only the bits read since the
+  // last record; RecordKidoku() never clears a bit, but if one was cleared,
+  // or the bitset shrank, |replace| is set and |bits| holds every set bit.
+  struct Kidoku {
+    int scenario;
+    size_t size;
+    bool replace;
+    std::vector<int> bits;
+
+    template <class Archive>
+    void serialize(Archive& ar, unsigned int version) {
+      ar& scenario& size& replace& bits;
+    }
+  };
+
+  Cells<int> intG;
+  Cells<int> intZ;
+  Cells<std::string> strM;
+  Cells<std::string> global_names;
+
+  std::vector<Kidoku> kidoku;
+  std::vector<int> kidoku_erased;
+
+  // Empty if the system globals didn't change.
+  std::string system_globals;
+
+  bool empty() const {
+    return intG.empty() && intZ.empty() && strM.empty() &&
+           global_names.empty() && kidoku.empty() && kidoku_erased.empty() &&
+           system_globals.empty();
+  }
+
+  template <class Archive>
+  void serialize(Archive& ar, unsigned int version) {
+    ar& intG& intZ& strM& global_names& kidoku& kidoku_erased& system_globals;
+  }
+};
+
+template <typename T, size_t N>
+void DiffBank(const T (&from)[N],
+              const T (&to)[N],
+              GlobalMemoryDelta::Cells<T>* changes) {
+  for (size_t i = 0; i < N; ++i) {
+    if (from[i] != to[i])
+      changes->emplace_back(i, to[i]);
+  }
+}
+
+template <typename T, size_t N>
+void ApplyBank(const GlobalMemoryDelta::Cells<T>& changes, T (&bank)[N]) {
+  for (const std::pair<int, T>& change : changes) {
+    if (change.first >= 0 && static_cast<size_t>(change.first) < N)
+      bank[change.first] = change.second;
+  }
+}
+
+void DiffKidoku(const std::map<int, boost::dynamic_bitset<>>& from,
+                const std::map<int, boost::dynamic_bitset<>>& to,
+                GlobalMemoryDelta* delta) {
+  for (const auto& scenario_and_bits : to) {
+    const boost::dynamic_bitset<>& bits = scenario_and_bits.second;
+    auto it = from.find(scenario_and_bits.first);
+    if (it != from.end() && it->second == bits)
+      continue;
+
+    GlobalMemoryDelta::Kidoku kidoku;
+    kidoku.scenario = scenario_and_bits.first;
+    kidoku.size = bits.size();
+    kidoku.replace = it == from.end() || it->second.size() > bits.size();
+    if (!kidoku.replace) {
+      boost::dynamic_bitset<> old_bits = it->second;
+      old_bits.resize(bits.size());
+      kidoku.replace = !old_bits.is_subset_of(bits);
+      if (!kidoku.replace) {
+        boost::dynamic_bitset<> read = bits - old_bits;
+        for (size_t i = read.find_first(); i != read.npos;
+             i = read.find_next(i)) {
+          kidoku.bits.push_back(i);
+        }
+      }
+    }
+
+    if (kidoku.replace) {
+      for (size_t i = bits.find_first(); i != bits.npos; i = bits.find_next(i))
+        kidoku.bits.push_back(i);
+    }
+
+    delta->kidoku.push_back(std::move(kidoku));
+  }
+
+  for (const auto& scenario_and_bits : from) {
+    if (!to.count(scenario_and_bits.first))
+      delta->kidoku_erased.push_back(scenario_and_bits.first);
+  }
+}
+
+void ApplyDelta(const GlobalMemoryDelta& delta,
+                GlobalMemory* global,
+                std::string* system_globals) {
+  ApplyBank(delta.intG, global->intG);
+  ApplyBank(delta.intZ, global->intZ);
+  ApplyBank(delta.strM, global->strM);
+  ApplyBank(delta.global_names, global->global_names);
+
+  for (const GlobalMemoryDelta::Kidoku& kidoku : delta.kidoku) {
+    boost::dynamic_bitset<>& bits = global->kidoku_data[kidoku.scenario];
+    if (kidoku.replace)
+      bits.clear();
+    bits.resize(kidoku.size, false);
+    for (int bit : kidoku.bits) {
+      if (bit >= 0 && static_cast<size_t>(bit) < bits.size())
+        bits[bit] = true;
+    }
+  }
+
+  for (int scenario : delta.kidoku_erased)
+    global->kidoku_data.erase(scenario);
+
+  if (!delta.system_globals.empty())
+    *system_globals = delta.system_globals;
+}
+
+}  // namespace
+
+GlobalMemoryJournal::GlobalMemoryJournal() : append_failed_(false) {}
+
+GlobalMemoryJournal::~GlobalMemoryJournal() {}
+
+uint64_t GlobalMemoryJournal::Replay(std::istream& journal,
+                                     GlobalMemory* global,
+                                     std::string* system_globals) {
+  uint64_t intact = 0;
+  bool first = true;
+  char header[kFrameHeaderSize];
+  while (journal.read(header, kFrameHeaderSize)) {
+    uint32_t length = ReadUint32(header);
+    uint32_t checksum = ReadUint32(header + 4);
+    uint32_t sequence = ReadUint32(header + 8);
+    if (length > kMaxRecordSize || (!first && sequence != next_sequence_))
+      break;
+
+    std::string payload(length, '\0');
+    if (!journal.read(&payload[0], length) ||
+        Checksum(header + 8, payload) != checksum) {
+      break;
+    }
+
+    GlobalMemoryDelta delta;
+    try {
+      std::istringstream iss(payload);
+      boost::archive::binary_iarchive ia(iss, boost::archive::no_header);
+      int version;
+      ia >> version;
+      if (version != kJournalVersion)
+        break;
+      ia >> delta;
+    }
+    catch (std::exception&) {
+      break;
+    }
+
+    ApplyDelta(delta, global, system_globals);
+    intact += kFrameHeaderSize + length;
+    next_sequence_ = sequence + 1;
+    first = false;
+  }
+
+  return intact;
+}
+
+void GlobalMemoryJournal::SetBaseline(const GlobalMemory& global,
+                                      const std::string& system_globals,
+                                      uint64_t size) {
+  baseline_.reset(new GlobalMemory(global));
+  baseline_system_globals_ = system_globals;
+  size_ = size;
+  append_failed_ = false;
+}
+
+std::string GlobalMemoryJournal::Record(const GlobalMemory& global,
+                                        const std::string& system_globals) {
+  GlobalMemoryDelta delta;
+  DiffBank(baseline_->intG, global.intG, &delta.intG);
+  DiffBank(baseline_->intZ, global.intZ, &delta.intZ);
+  DiffBank(baseline_->strM, global.strM, &delta.strM);
+  DiffBank(baseline_->global_names, global.global_names, &delta.global_names);
+  DiffKidoku(baseline_->kidoku_data, global.kidoku_data, &delta);
+  if (system_globals != baseline_system_globals_)
+    delta.system_globals = system_globals;
+
+  if (delta.empty())
+    return std::string();
+
+  // Applying the delta rather than copying |global| keeps the baseline
+  // exactly what Replay() will rebuild.
+  ApplyDelta(delta, baseline_.get(), &baseline_system_globals_);
+
+  std::ostringstream oss;
+  {
+    boost::archive::binary_oarchive oa(oss, boost::archive::no_header);
+    oa << kJournalVersion << const_cast<const GlobalMemoryDelta&>(delta);
+  }
+  const std::string payload = oss.str();
+
+  std::string record;
+  record.reserve(kFrameHeaderSize + payload.size());
+  AppendUint32(record, payload.size());
+  std::string sequence;
+  AppendUint32(sequence, next_sequence_++);
+  AppendUint32(record, Checksum(sequence.data(), payload));
+  record += sequence;
+  record += payload;
+
+  size_ += record.size();
+  return record;
+}
@@ -0,0 +1,103 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+#ifndef SRC_MACHINE_GLOBAL_MEMORY_JOURNAL_H_
+#define SRC_MACHINE_GLOBAL_MEMORY_JOURNAL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+
+struct GlobalMemory;
+
+// Incremental persistence for global memory. Rewriting global.sav.gz means
+// serializing and compressing every global bank and all kidoku data, so it's
+// done rarely; in between, Serialization::journalGlobalMemory() appends a
+// record of just what changed to a journal beside it.
+//
+// Each record holds the intG, intZ, strM and global name cells that differ
+// from the state the previous record left, the kidoku bits read since, and the
+// system globals if they changed. Records are framed with their length, a CRC
+// and a sequence number, so replay stops cleanly at a record torn by a crash.
+//
+// Since a record stores values rather than increments, replaying records that
+// a newer global.sav.gz already includes leaves the same state. That is what
+// makes it safe to remove the journal only after the new global.sav.gz has
+// been written.
+class GlobalMemoryJournal {
+ public:
+  GlobalMemoryJournal();
+  ~GlobalMemoryJournal();
+
+  // Applies the records read from |journal| in order to |global| and
+  // |system_globals|, which hold what global.sav.gz had. Returns the length of
+  // the intact records; anything after that is a torn or corrupt tail, which
+  // the caller should cut off before more records are appended.
+  uint64_t Replay(std::istream& journal,
+                  GlobalMemory* global,
+                  std::string* system_globals);
+
+  // Makes |global| and |system_globals| the state that global.sav.gz plus
+  // the first |size| bytes of the journal hold. Record() diffs against it.
+  void SetBaseline(const GlobalMemory& global,
+                   const std::string& system_globals,
+                   uint64_t size);
+
+  bool has_baseline() const { return baseline_ != nullptr; }
+
+  // Returns a record of everything in |global| and |system_globals| that
+  // differs from the baseline, ready to be appended to the journal, and makes
+  // them the new baseline. Returns an empty string if nothing changed.
+  // Requires has_baseline().
+  std::string Record(const GlobalMemory& global,
+                     const std::string& system_globals);
+
+  // The length of the journal, counting the records Record() has made since
+  // SetBaseline().
+  uint64_t size() const { return size_; }
+
+  // Called when appending a record failed. Every record after a missing one
+  // is ignored by Replay(), so global.sav.gz has to be rewritten. Safe to call
+  // from the SaveWriter thread.
+  void set_append_failed() { append_failed_ = true; }
+  bool append_failed() const { return append_failed_; }
+
+ private:
+  std::unique_ptr<GlobalMemory> baseline_;
+  std::string baseline_system_globals_;
+
+  uint64_t size_ = 0;
+
+  // The sequence number of the next record. Replay() only accepts
+  // consecutive numbers, so a lost record ends the journal.
+  uint32_t next_sequence_ = 0;
+
+  std::atomic<bool> append_failed_;
+};
+
+#endif  // SRC_MACHINE_GLOBAL_MEMORY_JOURNAL_H_
@@ -51,6 +51,16 @@ const IntegerBank_t GLOBAL_INTEGER_BANKS = {
   make_pair(libreallive::INTG_LOCATION, 'G'),
   make_pair(libreallive::INTZ_LOCATION, 'Z')};
 
+const PackedIntAccessor PACKED_INT_ACCESSORS[NUMBER_OF_PACKED_INT_TYPES] = {
+    {NULL, NULL, 0},
+    {&PackedIntView<1>::Get, &PackedIntView<1>::Set, PackedIntView<1>::kSize},
+    {&PackedIntView<2>::Get, &PackedIntView<2>::Set, PackedIntView<2>::kSize},
+    {&PackedIntView<4>::Get, &PackedIntView<4>::Set, PackedIntView<4>::kSize},
+    {&PackedIntView<8>::Get, &PackedIntView<8>::Set, PackedIntView<8>::kSize},
+    {&PackedIntView<16>::Get,
+     &PackedIntView<16>::Set,
+     PackedIntView<16>::kSize}};
+
 // -----------------------------------------------------------------------
 // GlobalMemory
 // -----------------------------------------------------------------------
@@ -119,6 +129,31 @@ void Memory::ConnectIntVarPointers() {
   original_int_var[7] = NULL;
 }
 
+const int* Memory::GetIntSpan(const libreallive::IntMemRef& first,
+                              int count) const {
+  const int index = first.bank();
+  const int location = first.location();
+  if (first.type() != 0 || index < 0 || index >= NUMBER_OF_INT_LOCATIONS ||
+      count <= 0 || count > SIZE_OF_MEM_BANK || location < 0 ||
+      location > SIZE_OF_MEM_BANK - count) {
+    return NULL;
+  }
+
+  return int_var[index] + location;
+}
+
+int* Memory::GetMutableIntSpan(const libreallive::IntMemRef& first,
+                               int count) {
+  if (!GetIntSpan(first, count))
+    return NULL;
+
+  const int index = first.bank();
+  if (original_int_var[index])
+    original_int_var[index]->RecordRange(int_var[index], first.location(),
+                                         count);
+  return int_var[index] + first.location();
+}
+
 const std::string& Memory::GetStringValue(int type, int location) {
   if (location > (SIZE_OF_MEM_BANK - 1))
     throw rlvm::Exception(
@@ -154,12 +189,7 @@ void Memory::SetStringValue(int type, int number, const std::string& value) {
       break;
     case libreallive::STRS_LOCATION: {
       // Possibly record the original value for a piece of local memory.
-      std::map<int, std::string>::iterator it =
-          local_.original_strS.find(number);
-      if (it == local_.original_strS.end()) {
-        local_.original_strS.insert(
-            std::make_pair(number, local_.strS[number]));
-      }
+      local_.original_strS.Record(number, local_.strS[number]);
       local_.strS[number] = value;
       break;
     }
@@ -216,13 +246,13 @@ void Memory::RecordKidoku(int scenario, int kidoku) {
 }
 
 void Memory::TakeSavepointSnapshot() {
-  local_.original_intA.clear();
-  local_.original_intB.clear();
-  local_.original_intC.clear();
-  local_.original_intD.clear();
-  local_.original_intE.clear();
-  local_.original_intF.clear();
-  local_.original_strS.clear();
+  local_.original_intA.Clear();
+  local_.original_intB.Clear();
+  local_.original_intC.Clear();
+  local_.original_intD.Clear();
+  local_.original_intE.Clear();
+  local_.original_intF.Clear();
+  local_.original_strS.Clear();
 }
 
 // static
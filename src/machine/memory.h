@@ -33,6 +33,7 @@
 #include <boost/serialization/version.hpp>
 
 #include <algorithm>
+#include <bitset>
 #include <map>
 #include <memory>
 #include <string>
@@ -87,6 +88,98 @@ BOOST_CLASS_VERSION(GlobalMemory, 1)
 
 struct dont_initialize {};
 
+// Remembers what each location of a SIZE_OF_MEM_BANK sized bank held at the
+// last savepoint, for the locations written since. Recording a write is a bit
+// test; forgetting everything at the next savepoint costs one step per
+// location that was written.
+template <typename T>
+class SavepointJournal {
+ public:
+  // Records |value| as the original value of |location|, unless |location|
+  // already has one.
+  void Record(int location, const T& value) {
+    if (!dirty_[location]) {
+      dirty_.set(location);
+      original_[location] = value;
+      dirty_locations_.push_back(location);
+    }
+  }
+
+  // Record() for |count| locations starting at |first|, whose current values
+  // are in |bank|.
+  void RecordRange(const T* bank, int first, int count) {
+    for (int location = first; location < first + count; ++location)
+      Record(location, bank[location]);
+  }
+
+  // Forgets all original values.
+  void Clear() {
+    for (int location : dirty_locations_) {
+      dirty_.reset(location);
+      original_[location] = T();
+    }
+    dirty_locations_.clear();
+  }
+
+  // Puts the original values back into |bank|.
+  void Revert(T (&bank)[SIZE_OF_MEM_BANK]) const {
+    for (int location : dirty_locations_)
+      bank[location] = original_[location];
+  }
+
+ private:
+  std::bitset<SIZE_OF_MEM_BANK> dirty_;
+  T original_[SIZE_OF_MEM_BANK] = {};
+
+  // The set bits of |dirty_|, in the order they were set.
+  std::vector<int> dirty_locations_;
+};
+
+// The bit-packed views of an integer bank. intAb[] sees each int as 32 one
+// bit elements, intA2b[] as 16 two bit elements and so on up to intA16b[],
+// lowest bits first. Each width is its own instantiation so that the
+// division, shift and mask are all constants.
+template <int kBits>
+struct PackedIntView {
+  static const int kPerInt = 32 / kBits;
+  static const unsigned int kMask = (1u << kBits) - 1;
+  static const int kSize = SIZE_OF_MEM_BANK * kPerInt;
+
+  static int Get(const int* bank, int location) {
+    return (static_cast<unsigned int>(bank[location / kPerInt]) >>
+            ((location % kPerInt) * kBits)) & kMask;
+  }
+
+  static void Set(int* bank,
+                  SavepointJournal<int>* original,
+                  int location,
+                  int value) {
+    int& word = bank[location / kPerInt];
+    if (original)
+      original->Record(location / kPerInt, word);
+
+    const int shift = (location % kPerInt) * kBits;
+    word = (word & ~(kMask << shift)) | ((value & kMask) << shift);
+  }
+};
+
+// One PackedIntView, for code that picks the access type of a reference when
+// it is parsed rather than every time it is used. Locations must already be
+// checked against |size|.
+struct PackedIntAccessor {
+  int (*get)(const int* bank, int location);
+  void (*set)(int* bank,
+              SavepointJournal<int>* original,
+              int location,
+              int value);
+  int size;
+};
+
+// Bit-packed access types as they appear in IntMemRef::type(): 1 is intAb[]
+// through 5 for intA16b[]. Type 0, the plain int view, has no accessor.
+const int NUMBER_OF_PACKED_INT_TYPES = 6;
+extern const PackedIntAccessor PACKED_INT_ACCESSORS[NUMBER_OF_PACKED_INT_TYPES];
+
 // Struct that represents Local Memory. In any one rlvm process, lots
 // of these things will be created, because there are commands
 struct LocalMemory {
@@ -114,13 +207,13 @@ struct LocalMemory {
   // Savepoint(). Instead of doing some sort of copying entire memory banks
   // whenever we hit a Savepoint() call, only reconstruct the original memory
   // when we save.
-  std::map<int, int> original_intA;
-  std::map<int, int> original_intB;
-  std::map<int, int> original_intC;
-  std::map<int, int> original_intD;
-  std::map<int, int> original_intE;
-  std::map<int, int> original_intF;
-  std::map<int, std::string> original_strS;
+  SavepointJournal<int> original_intA;
+  SavepointJournal<int> original_intB;
+  SavepointJournal<int> original_intC;
+  SavepointJournal<int> original_intD;
+  SavepointJournal<int> original_intE;
+  SavepointJournal<int> original_intF;
+  SavepointJournal<std::string> original_strS;
 
   std::string local_names[SIZE_OF_NAME_BANK];
 
@@ -129,12 +222,10 @@ struct LocalMemory {
   template <class Archive, typename T>
   void saveArrayRevertingChanges(Archive& ar,
                                  const T (&a)[SIZE_OF_MEM_BANK],
-                                 const std::map<int, T>& original) const {
+                                 const SavepointJournal<T>& original) const {
     T merged[SIZE_OF_MEM_BANK];
     std::copy(a, a + SIZE_OF_MEM_BANK, merged);
-    for (auto it = original.cbegin(); it != original.cend(); ++it) {
-      merged[it->first] = it->second;
-    }
+    original.Revert(merged);
     ar& merged;
   }
 
@@ -212,6 +303,36 @@ class Memory {
   // Sets the value of a certain memory location
   void SetIntValue(const libreallive::IntMemRef& ref, int value);
 
+  // Returns integer bank |index|, one of intA through intZ (not intL), for
+  // callers that check locations against SIZE_OF_MEM_BANK themselves. Writes
+  // must still go through SetIntValue() so that savepoints see them.
+  const int* int_bank(int index) const { return int_var[index]; }
+
+  // Get/SetIntValue() for bit-packed references into bank |index|, also not
+  // intL, through an accessor from PACKED_INT_ACCESSORS. |location| must be
+  // less than |accessor.size|.
+  int GetPackedIntValue(const PackedIntAccessor& accessor,
+                        int index,
+                        int location) const {
+    return accessor.get(int_var[index], location);
+  }
+  void SetPackedIntValue(const PackedIntAccessor& accessor,
+                         int index,
+                         int location,
+                         int value) {
+    accessor.set(int_var[index], original_int_var[index], location, value);
+  }
+
+  // Returns |count| consecutive locations starting at |first| as a plain
+  // array, for bulk operations. Only full width references to intA through
+  // intZ (not intL) qualify, and the whole range must fit in the bank; NULL is
+  // returned otherwise and the caller goes through Get/SetIntValue() instead.
+  const int* GetIntSpan(const libreallive::IntMemRef& first, int count) const;
+
+  // GetIntSpan() for writing. Every location in the range is recorded as
+  // changed for the next savepoint, as SetIntValue() would.
+  int* GetMutableIntSpan(const libreallive::IntMemRef& first, int count);
+
   // Returns the string value of a string memory bank
   const std::string& GetStringValue(int type, int location);
 
@@ -283,7 +404,7 @@ class Memory {
   int* int_var[NUMBER_OF_INT_LOCATIONS];
 
   // Change records for original.
-  std::map<int, int>* original_int_var[NUMBER_OF_INT_LOCATIONS];
+  SavepointJournal<int>* original_int_var[NUMBER_OF_INT_LOCATIONS];
 };  // end of class Memory
 
 // Implementation of getting an integer out of an array. Global because we need
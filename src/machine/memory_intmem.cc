@@ -61,14 +61,10 @@ void throwIllegalIndex(const IntMemRef& ref, const std::string& function) {
 }
 
 void saveOriginalValue(int* bank,
-                       std::map<int, int>* original_bank,
+                       SavepointJournal<int>* original_bank,
                        int location) {
-  if (bank && original_bank) {
-    std::map<int, int>::iterator it = original_bank->find(location);
-    if (it == original_bank->end()) {
-      original_bank->emplace(location, bank[location]);
-    }
-  }
+  if (bank && original_bank)
+    original_bank->Record(location, bank[location]);
 }
 
 }  // namespace
@@ -93,8 +89,14 @@ int Memory::GetIntValue(const IntMemRef& ref) {
       throwIllegalIndex(ref, "RLMachine::GetIntValue()");
 
     return bank[location];
-  } else {
+  } else if (type < NUMBER_OF_PACKED_INT_TYPES) {
     // Ab[]..G4b[], Z8b[] などを読む
+    const PackedIntAccessor& accessor = PACKED_INT_ACCESSORS[type];
+    if ((unsigned int)(location) >= (unsigned int)(accessor.size))
+      throwIllegalIndex(ref, "RLMachine::GetIntValue()");
+
+    return accessor.get(bank, location);
+  } else {
     int factor = 1 << (type - 1);
     int eltsize = 32 / factor;
     if ((unsigned int)(location) >= (64000u / factor))
@@ -111,7 +113,7 @@ void Memory::SetIntValue(const IntMemRef& ref, int value) {
   int location = ref.location();
 
   int* bank = NULL;
-  std::map<int, int>* original_bank = NULL;
+  SavepointJournal<int>* original_bank = NULL;
   if (index == 8) {
     bank = machine_.CurrentIntLBank();
   } else if (index < 0 || index > NUMBER_OF_INT_LOCATIONS) {
@@ -127,8 +129,14 @@ void Memory::SetIntValue(const IntMemRef& ref, int value) {
       throwIllegalIndex(ref, "RLMachine::SetIntValue()");
     saveOriginalValue(bank, original_bank, location);
     bank[location] = value;
-  } else {
+  } else if (type < NUMBER_OF_PACKED_INT_TYPES) {
     // Ab[]..G4b[], Z8b[] などを書く
+    const PackedIntAccessor& accessor = PACKED_INT_ACCESSORS[type];
+    if ((unsigned int)(location) >= (unsigned int)(accessor.size))
+      throwIllegalIndex(ref, "RLMachine::SetIntValue()");
+
+    accessor.set(bank, original_bank, location, value);
+  } else {
     int factor = 1 << (type - 1);
     int eltsize = 32 / factor;
     int eltmask = (1 << factor) - 1;
@@ -0,0 +1,255 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#include "machine/opcode_profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "libreallive/bytecode.h"
+
+namespace {
+
+typedef std::pair<std::pair<int, int>, OpcodeProfiler::Timing> LineRow;
+
+int64_t Nanoseconds(std::chrono::nanoseconds time) { return time.count(); }
+
+int64_t MeanNanoseconds(const OpcodeProfiler::Timing& timing) {
+  return timing.count ? timing.total.count() / timing.count : 0;
+}
+
+bool HasMoreTime(const OpcodeProfiler::Timing& lhs,
+                 const OpcodeProfiler::Timing& rhs) {
+  return lhs.total > rhs.total;
+}
+
+// Operation names are plain identifiers, but quote anything JSON would choke
+// on anyway.
+std::string JsonString(const std::string& in) {
+  std::string out = "\"";
+  for (char c : in) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      out += ' ';
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+  return out;
+}
+
+// CSV fields only need quoting when they contain a separator or a quote.
+std::string CsvString(const std::string& in) {
+  if (in.find_first_of(",\"\n") == std::string::npos)
+    return in;
+
+  std::string out = "\"";
+  for (char c : in) {
+    if (c == '"')
+      out += '"';
+    out += c;
+  }
+  out += '"';
+  return out;
+}
+
+std::vector<const OpcodeProfiler::OpcodeEntry*> SortedOpcodes(
+    const std::map<uint64_t, OpcodeProfiler::OpcodeEntry>& opcodes,
+    const OpcodeProfiler::OpcodeEntry& expression_entry) {
+  std::vector<const OpcodeProfiler::OpcodeEntry*> entries;
+  for (auto const& entry : opcodes)
+    entries.push_back(&entry.second);
+  if (expression_entry.timing.count)
+    entries.push_back(&expression_entry);
+
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const OpcodeProfiler::OpcodeEntry* lhs,
+                      const OpcodeProfiler::OpcodeEntry* rhs) {
+                     return HasMoreTime(lhs->timing, rhs->timing);
+                   });
+  return entries;
+}
+
+std::vector<LineRow> SortedLines(
+    const std::map<std::pair<int, int>, OpcodeProfiler::Timing>& lines) {
+  std::vector<LineRow> entries(lines.begin(), lines.end());
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const LineRow& lhs, const LineRow& rhs) {
+                     return HasMoreTime(lhs.second, rhs.second);
+                   });
+  return entries;
+}
+
+}  // namespace
+
+// -----------------------------------------------------------------------
+// OpcodeProfiler::Timing
+// -----------------------------------------------------------------------
+void OpcodeProfiler::Timing::Add(std::chrono::nanoseconds elapsed) {
+  count++;
+  total += elapsed;
+  max = std::max(max, elapsed);
+}
+
+// -----------------------------------------------------------------------
+// OpcodeProfiler::Sample
+// -----------------------------------------------------------------------
+OpcodeProfiler::Sample::Sample(OpcodeProfiler& profiler,
+                               OpcodeEntry& entry,
+                               int scene,
+                               int line)
+    : profiler_(profiler),
+      entry_(entry),
+      scene_(scene),
+      line_(line),
+      start_(std::chrono::steady_clock::now()) {}
+
+OpcodeProfiler::Sample::~Sample() {
+  profiler_.Record(entry_, scene_, line_,
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start_));
+}
+
+// -----------------------------------------------------------------------
+// OpcodeProfiler
+// -----------------------------------------------------------------------
+OpcodeProfiler::OpcodeProfiler() { expression_entry_.name = "(expression)"; }
+
+OpcodeProfiler::~OpcodeProfiler() {}
+
+OpcodeProfiler::OpcodeEntry& OpcodeProfiler::GetCommandEntry(
+    const libreallive::CommandElement& f) {
+  uint64_t key = (static_cast<uint64_t>(f.modtype()) << 40) |
+                 (static_cast<uint64_t>(f.module()) << 32) |
+                 (static_cast<uint64_t>(f.opcode()) << 8) | f.overload();
+  OpcodeStorage::iterator it = opcodes_.lower_bound(key);
+  if (it == opcodes_.end() || it->first != key) {
+    it = opcodes_.insert(it, std::make_pair(key, OpcodeEntry()));
+    it->second.modtype = f.modtype();
+    it->second.module = f.module();
+    it->second.opcode = f.opcode();
+    it->second.overload = f.overload();
+  }
+  return it->second;
+}
+
+void OpcodeProfiler::Record(OpcodeEntry& entry,
+                            int scene,
+                            int line,
+                            std::chrono::nanoseconds elapsed) {
+  entry.timing.Add(elapsed);
+  lines_[std::make_pair(scene, line)].Add(elapsed);
+}
+
+void OpcodeProfiler::WriteCsv(std::ostream& os) const {
+  os << "module_name,name,modtype,module,opcode,overload,count,total_ns,"
+        "mean_ns,max_ns\n";
+  for (const OpcodeEntry* entry : SortedOpcodes(opcodes_, expression_entry_)) {
+    const Timing& timing = entry->timing;
+    os << CsvString(entry->module_name) << "," << CsvString(entry->name) << ","
+       << entry->modtype << "," << entry->module << "," << entry->opcode << ","
+       << entry->overload << "," << timing.count << ","
+       << Nanoseconds(timing.total) << "," << MeanNanoseconds(timing) << ","
+       << Nanoseconds(timing.max) << "\n";
+  }
+
+  os << "\nseen,line,count,total_ns,mean_ns,max_ns\n";
+  for (auto const& line : SortedLines(lines_)) {
+    const Timing& timing = line.second;
+    os << line.first.first << "," << line.first.second << "," << timing.count
+       << "," << Nanoseconds(timing.total) << "," << MeanNanoseconds(timing)
+       << "," << Nanoseconds(timing.max) << "\n";
+  }
+}
+
+void OpcodeProfiler::WriteJson(std::ostream& os) const {
+  os << "{\n  \"opcodes\": [";
+  const char* separator = "\n";
+  for (const OpcodeEntry* entry : SortedOpcodes(opcodes_, expression_entry_)) {
+    const Timing& timing = entry->timing;
+    os << separator << "    {\"module_name\": "
+       << JsonString(entry->module_name)
+       << ", \"name\": " << JsonString(entry->name)
+       << ", \"modtype\": " << entry->modtype
+       << ", \"module\": " << entry->module
+       << ", \"opcode\": " << entry->opcode
+       << ", \"overload\": " << entry->overload
+       << ", \"count\": " << timing.count
+       << ", \"total_ns\": " << Nanoseconds(timing.total)
+       << ", \"mean_ns\": " << MeanNanoseconds(timing)
+       << ", \"max_ns\": " << Nanoseconds(timing.max) << "}";
+    separator = ",\n";
+  }
+
+  os << "\n  ],\n  \"lines\": [";
+  separator = "\n";
+  for (auto const& line : SortedLines(lines_)) {
+    const Timing& timing = line.second;
+    os << separator << "    {\"seen\": " << line.first.first
+       << ", \"line\": " << line.first.second
+       << ", \"count\": " << timing.count
+       << ", \"total_ns\": " << Nanoseconds(timing.total)
+       << ", \"mean_ns\": " << MeanNanoseconds(timing)
+       << ", \"max_ns\": " << Nanoseconds(timing.max) << "}";
+    separator = ",\n";
+  }
+  os << "\n  ]\n}\n";
+}
+
+bool OpcodeProfiler::WriteReport(const std::string& path) const {
+  std::ofstream file(path.c_str());
+  if (!file)
+    return false;
+
+  const std::string json = ".json";
+  if (path.size() >= json.size() &&
+      path.compare(path.size() - json.size(), json.size(), json) == 0) {
+    WriteJson(file);
+  } else {
+    WriteCsv(file);
+  }
+  return static_cast<bool>(file);
+}
+
+// -----------------------------------------------------------------------
+// ScopedOpcodeReport
+// -----------------------------------------------------------------------
+ScopedOpcodeReport::ScopedOpcodeReport(const OpcodeProfiler* profiler,
+                                       const std::string& path)
+    : profiler_(profiler), path_(path) {}
+
+ScopedOpcodeReport::~ScopedOpcodeReport() {
+  if (profiler_ && !profiler_->WriteReport(path_))
+    std::cerr << "Couldn't write opcode profile to " << path_ << std::endl;
+}
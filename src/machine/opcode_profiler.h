@@ -0,0 +1,137 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#ifndef SRC_MACHINE_OPCODE_PROFILER_H_
+#define SRC_MACHINE_OPCODE_PROFILER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace libreallive {
+class CommandElement;
+}  // namespace libreallive
+
+// An optional component to an RLMachine that times every command and
+// expression it executes. Wall time is totalled per (module, opcode, overload)
+// and per SEEN and line, so the report shows both which operations and which
+// parts of the script take up a frame.
+class OpcodeProfiler {
+ public:
+  // Accumulated wall time of one kind of instruction.
+  struct Timing {
+    int64_t count = 0;
+    std::chrono::nanoseconds total{0};
+    std::chrono::nanoseconds max{0};
+
+    void Add(std::chrono::nanoseconds elapsed);
+  };
+
+  struct OpcodeEntry {
+    // Filled in by the caller the first time the entry is used, since only
+    // the RLMachine knows which module and RLOperation handle the opcode.
+    std::string module_name;
+    std::string name;
+
+    // -1 for the expression entry.
+    int modtype = -1;
+    int module = -1;
+    int opcode = -1;
+    int overload = -1;
+
+    Timing timing;
+  };
+
+  // Times one instruction from construction to destruction, and records it
+  // against |entry| and against |scene|:|line|. Records even when the
+  // instruction throws.
+  class Sample {
+   public:
+    Sample(OpcodeProfiler& profiler, OpcodeEntry& entry, int scene, int line);
+    ~Sample();
+
+   private:
+    OpcodeProfiler& profiler_;
+    OpcodeEntry& entry_;
+    int scene_;
+    int line_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  OpcodeProfiler();
+  ~OpcodeProfiler();
+
+  // Returns the entry for |f|'s opcode, creating an unnamed one on first use.
+  OpcodeEntry& GetCommandEntry(const libreallive::CommandElement& f);
+
+  // The entry that all expression statements are recorded against.
+  OpcodeEntry& expression_entry() { return expression_entry_; }
+
+  // Adds |elapsed| to |entry| and to |scene|:|line|.
+  void Record(OpcodeEntry& entry,
+              int scene,
+              int line,
+              std::chrono::nanoseconds elapsed);
+
+  // Writes the opcode table and the line table, each sorted by total time,
+  // as two CSV sections with their own header rows.
+  void WriteCsv(std::ostream& os) const;
+
+  // Writes the same tables as a JSON object with "opcodes" and "lines"
+  // arrays.
+  void WriteJson(std::ostream& os) const;
+
+  // Writes JSON to |path| if it ends in ".json", and CSV otherwise. Returns
+  // false if the file couldn't be written.
+  bool WriteReport(const std::string& path) const;
+
+ private:
+  typedef std::map<uint64_t, OpcodeEntry> OpcodeStorage;
+  typedef std::map<std::pair<int, int>, Timing> LineStorage;
+
+  OpcodeStorage opcodes_;
+  OpcodeEntry expression_entry_;
+  LineStorage lines_;
+};
+
+// Writes |profiler|'s report to |path| when it goes out of scope, so a run
+// that ends in an exception still leaves its profile behind. Does nothing if
+// |profiler| is NULL.
+class ScopedOpcodeReport {
+ public:
+  ScopedOpcodeReport(const OpcodeProfiler* profiler, const std::string& path);
+  ~ScopedOpcodeReport();
+
+ private:
+  const OpcodeProfiler* profiler_;
+  std::string path_;
+};
+
+#endif  // SRC_MACHINE_OPCODE_PROFILER_H_
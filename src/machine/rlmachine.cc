@@ -25,6 +25,8 @@
 //
 // -----------------------------------------------------------------------
 
+#include <boost/archive/binary_iarchive.hpp>  // NOLINT
+#include <boost/archive/binary_oarchive.hpp>  // NOLINT
 #include <boost/archive/text_iarchive.hpp>  // NOLINT
 #include <boost/archive/text_oarchive.hpp>  // NOLINT
 #include <boost/serialization/vector.hpp>   // NOLINT
@@ -35,11 +37,17 @@
 #include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/path.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <mutex>
+#include <set>
 #include <string>
 #include <sstream>
 #include <iostream>
 #include <iterator>
+#include <thread>
 #include <vector>
 
 #include "libreallive/archive.h"
@@ -50,12 +58,16 @@
 #include "libreallive/scenario.h"
 #include "long_operations/pause_long_operation.h"
 #include "long_operations/textout_long_operation.h"
+#include "machine/global_memory_journal.h"
 #include "machine/long_operation.h"
 #include "machine/memory.h"
 #include "machine/opcode_log.h"
+#include "machine/opcode_profiler.h"
 #include "machine/reallive_dll.h"
 #include "machine/rlmodule.h"
 #include "machine/rloperation.h"
+#include "machine/save_game_index.h"
+#include "machine/save_writer.h"
 #include "machine/serialization.h"
 #include "machine/stack_frame.h"
 #include "systems/base/graphics_system.h"
@@ -94,6 +106,10 @@ bool IsNotLongOp(StackFrame& frame) {
   return frame.frame_type != StackFrame::TYPE_LONGOP;
 }
 
+// Source of RLMachine::dispatch_epoch_. Starts at 1 since a CommandElement
+// with epoch 0 has nothing cached.
+std::atomic<uint64_t> next_dispatch_epoch(1);
+
 }  // namespace
 
 // -----------------------------------------------------------------------
@@ -102,8 +118,11 @@ bool IsNotLongOp(StackFrame& frame) {
 
 RLMachine::RLMachine(System& in_system, libreallive::Archive& in_archive)
     : memory_(new Memory(*this, in_system.gameexe())),
+      dispatch_epoch_(next_dispatch_epoch++),
       archive_(in_archive),
-      system_(in_system) {
+      system_(in_system),
+      global_memory_journal_(new GlobalMemoryJournal),
+      save_writer_(new SaveWriter) {
   // Search in the Gameexe for #SEEN_START and place us there
   Gameexe& gameexe = in_system.gameexe();
   libreallive::Scenario* scenario = NULL;
@@ -122,8 +141,7 @@ RLMachine::RLMachine(System& in_system, libreallive::Archive& in_archive)
 
   if (scenario == 0)
     throw rlvm::Exception("Invalid scenario file");
-  PushStackFrame(
-      StackFrame(scenario, scenario->begin(), StackFrame::TYPE_ROOT));
+  PushStackFrame(StackFrame(scenario, 0, StackFrame::TYPE_ROOT));
 
   // Initial value of the savepoint
   MarkSavepoint();
@@ -155,9 +173,11 @@ void RLMachine::AttachModule(RLModule* module) {
   int module_number = module->module_number();
   unsigned int packed_module = PackModuleNumber(module_type, module_number);
 
-  ModuleMap::iterator it = modules_.find(packed_module);
-  if (it != modules_.end()) {
-    RLModule& cur_mod = *it->second;
+  if (packed_module >= modules_.size())
+    modules_.resize(packed_module + 1);
+
+  if (modules_[packed_module]) {
+    RLModule& cur_mod = *modules_[packed_module];
     std::ostringstream ss;
     ss << "Module identification clash: trying to overwrite " << cur_mod
        << " with " << *module << std::endl;
@@ -168,7 +188,13 @@ void RLMachine::AttachModule(RLModule* module) {
     throw rlvm::Exception(ss.str());
   }
 
-  modules_.emplace(packed_module, std::unique_ptr<RLModule>(module));
+  modules_[packed_module].reset(module);
+  module->machine_ = this;
+  InvalidateDispatchCache();
+}
+
+void RLMachine::InvalidateDispatchCache() {
+  dispatch_epoch_ = next_dispatch_epoch++;
 }
 
 int RLMachine::GetIntValue(const libreallive::IntMemRef& ref) {
@@ -261,19 +287,13 @@ void RLMachine::ExecuteNextInstruction() {
         }
         delayed_modifications_.clear();
       } else {
-        (*(call_stack_.back().ip))->RunOnMachine(*this);
+        const StackFrame& frame = call_stack_.back();
+        frame.scenario->GetElement(frame.ip)->RunOnMachine(*this);
       }
     }
     catch (rlvm::UnimplementedOpcode& e) {
       AdvanceInstructionPointer();
-
-      if (print_undefined_opcodes_) {
-        cout << "(SEEN" << call_stack_.back().scenario->scene_number()
-             << ")(Line " << line_ << "):  " << e.what() << endl;
-      }
-
-      if (undefined_log_)
-        undefined_log_->Increment(e.opcode_name());
+      ReportUnimplementedOpcode(e);
     }
     catch (rlvm::Exception& e) {
       if (halt_on_exception_) {
@@ -316,6 +336,34 @@ void RLMachine::ExecuteUntilHalted() {
   }
 }
 
+int RLMachine::ExecuteSlice(std::chrono::nanoseconds budget,
+                            int max_instructions) {
+  // Compare elapsed time rather than computing a deadline so that a budget of
+  // nanoseconds::max() can't overflow.
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  int executed = 0;
+  while (!halted_ && executed < max_instructions) {
+    int batch = max_instructions - executed;
+    if (batch > kSliceBatchSize)
+      batch = kSliceBatchSize;
+    for (int i = 0; i < batch; ++i) {
+      ExecuteNextInstruction();
+      executed++;
+
+      if (halted_ || system_.force_wait() || call_stack_.empty() ||
+          call_stack_.back().frame_type == StackFrame::TYPE_LONGOP) {
+        return executed;
+      }
+    }
+
+    if (std::chrono::steady_clock::now() - start >= budget)
+      break;
+  }
+  return executed;
+}
+
 void RLMachine::AdvanceInstructionPointer() {
   if (!replaying_graphics_stack()) {
     std::vector<StackFrame>::reverse_iterator it =
@@ -323,31 +371,179 @@ void RLMachine::AdvanceInstructionPointer() {
 
     if (it != call_stack_.rend()) {
       it->ip++;
-      if (it->ip == it->scenario->end())
+      if (it->ip == it->scenario->size())
         halted_ = true;
     }
   }
 }
 
 std::string RLMachine::GetCommandName(const libreallive::CommandElement& f) {
-  ModuleMap::iterator it =
-      modules_.find(PackModuleNumber(f.modtype(), f.module()));
+  RLModule* module = GetModule(f);
   std::string name;
-  if (it != modules_.end())
-    name = it->second->GetCommandName(*this, f);
+  if (module)
+    name = module->GetCommandName(*this, f);
   return name;
 }
 
+RLOperation* RLMachine::GetOperation(const libreallive::CommandElement& f) {
+  RLModule* module = GetModule(f);
+  if (module)
+    return module->GetOperation(f);
+  return NULL;
+}
+
+std::vector<RLMachine::ParameterParseFailure> RLMachine::PreparseParameters(
+    int num_threads) {
+  std::vector<int> scenes;
+  for (auto const& scenario : archive_)
+    scenes.push_back(scenario.first);
+
+  if (num_threads <= 0) {
+    num_threads = std::max(
+        1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+  }
+  num_threads = std::min(num_threads, static_cast<int>(scenes.size()));
+
+  std::atomic<size_t> next_scene(0);
+  std::mutex failures_mutex;
+  std::vector<ParameterParseFailure> failures;
+  auto add_failure = [&](int scene, int instruction, const char* message) {
+    std::lock_guard<std::mutex> lock(failures_mutex);
+    failures.push_back(ParameterParseFailure{scene, instruction, message});
+  };
+
+  // Each scenario is handled by exactly one thread, so nothing else touches
+  // its elements or its expression arena while we parse into them.
+  auto worker = [&]() {
+    for (size_t i = next_scene++; i < scenes.size(); i = next_scene++) {
+      const int scene = scenes[i];
+      libreallive::Scenario* scenario = NULL;
+      try {
+        scenario = archive_.GetScenario(scene);
+      }
+      catch (std::exception& e) {
+        add_failure(scene, -1, e.what());
+        continue;
+      }
+      if (!scenario)
+        continue;
+
+      for (size_t j = 0; j < scenario->size(); ++j) {
+        const libreallive::CommandElement* command =
+            dynamic_cast<const libreallive::CommandElement*>(
+                scenario->GetElement(j));
+        if (!command)
+          continue;
+
+        RLOperation* op = GetOperation(*command);
+        if (!op)
+          continue;
+
+        try {
+          op->CacheParsedParameters(*command, scenario->expression_arena());
+        }
+        catch (rlvm::UnimplementedOpcode&) {
+          // UndefinedFunction refuses to parse anything; it'll throw again
+          // when executed.
+        }
+        catch (std::exception& e) {
+          add_failure(scene, j, e.what());
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_threads; ++i)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& thread : threads)
+    thread.join();
+
+  std::sort(failures.begin(), failures.end(),
+            [](const ParameterParseFailure& a, const ParameterParseFailure& b) {
+              return a.scenario != b.scenario ? a.scenario < b.scenario
+                                              : a.instruction < b.instruction;
+            });
+  return failures;
+}
+
 void RLMachine::ExecuteCommand(const libreallive::CommandElement& f) {
-  ModuleMap::iterator it =
-      modules_.find(PackModuleNumber(f.modtype(), f.module()));
-  if (it != modules_.end()) {
-    it->second->DispatchFunction(*this, f);
-  } else {
+  RLOperation* op = ResolveOperation(f);
+  if (!op)
     throw rlvm::UnimplementedOpcode(*this, f);
+
+  DispatchCommand(op, f);
+}
+
+void RLMachine::RunCommand(const libreallive::CommandElement& f) {
+  RLOperation* op = ResolveOperation(f);
+  if (op && op->IsImplemented()) {
+    DispatchCommand(op, f);
+  } else if (tracing_) {
+    // Let the usual path print the trace line and throw.
+    ExecuteCommand(f);
+  } else {
+    SkipUnimplementedCommand(f, op);
   }
 }
 
+RLOperation* RLMachine::ResolveOperation(const libreallive::CommandElement& f) {
+  RLOperation* op = f.GetCachedOperation(dispatch_epoch_);
+  if (!op) {
+    op = GetOperation(f);
+    if (op)
+      f.SetCachedOperation(dispatch_epoch_, op);
+  }
+  return op;
+}
+
+void RLMachine::DispatchCommand(RLOperation* op,
+                                const libreallive::CommandElement& f) {
+  if (!opcode_profiler_) {
+    RLModule::DispatchOperation(*this, op, f);
+    return;
+  }
+
+  OpcodeProfiler::OpcodeEntry& entry = opcode_profiler_->GetCommandEntry(f);
+  if (entry.name.empty()) {
+    entry.module_name = GetModule(f)->module_name();
+    entry.name = op->name();
+  }
+
+  OpcodeProfiler::Sample sample(*opcode_profiler_, entry, SceneNumber(), line_);
+  RLModule::DispatchOperation(*this, op, f);
+}
+
+void RLMachine::SkipUnimplementedCommand(const libreallive::CommandElement& f,
+                                         RLOperation* op) {
+  // Describing the opcode means formatting its parameters, so only do that
+  // when someone is going to look at the description.
+  if (print_undefined_opcodes_ || undefined_log_) {
+    if (op) {
+      rlvm::UnimplementedOpcode e(*this, op->name(), f);
+      AdvanceInstructionPointer();
+      ReportUnimplementedOpcode(e);
+    } else {
+      rlvm::UnimplementedOpcode e(*this, f);
+      AdvanceInstructionPointer();
+      ReportUnimplementedOpcode(e);
+    }
+  } else {
+    AdvanceInstructionPointer();
+  }
+}
+
+void RLMachine::ReportUnimplementedOpcode(const rlvm::UnimplementedOpcode& e) {
+  if (print_undefined_opcodes_) {
+    cout << "(SEEN" << call_stack_.back().scenario->scene_number()
+         << ")(Line " << line_ << "):  " << e.what() << endl;
+  }
+
+  if (undefined_log_)
+    undefined_log_->Increment(e.opcode_name());
+}
+
 void RLMachine::Jump(int scenario_num, int entrypoint) {
   // Check to make sure it's a valid scenario
   libreallive::Scenario* scenario = archive_.GetScenario(scenario_num);
@@ -358,6 +554,8 @@ void RLMachine::Jump(int scenario_num, int entrypoint) {
     throw rlvm::Exception(oss.str());
   }
 
+  EvictUnreferencedScenarios(scenario_num);
+
   if (call_stack_.back().frame_type == StackFrame::TYPE_LONGOP) {
     // For some reason this is slow; REALLY slow, so for now I'm trying to
     // optimize the common case (no long operations on the back of the stack. I
@@ -386,8 +584,9 @@ void RLMachine::Farcall(int scenario_num, int entrypoint) {
     throw rlvm::Exception(oss.str());
   }
 
-  libreallive::Scenario::const_iterator it =
-      scenario->FindEntrypoint(entrypoint);
+  EvictUnreferencedScenarios(scenario_num);
+
+  libreallive::pointer_t it = scenario->FindEntrypoint(entrypoint);
 
   if (entrypoint == 0 && ShouldSetSeentopSavepoint())
     MarkSavepoint();
@@ -404,12 +603,12 @@ void RLMachine::ReturnFromFarcall() {
   PopStackFrame();
 }
 
-void RLMachine::GotoLocation(libreallive::BytecodeList::iterator new_location) {
+void RLMachine::GotoLocation(libreallive::pointer_t new_location) {
   // Modify the current frame of the call stack so that it's
   call_stack_.back().ip = new_location;
 }
 
-void RLMachine::Gosub(libreallive::BytecodeList::iterator new_location) {
+void RLMachine::Gosub(libreallive::pointer_t new_location) {
   PushStackFrame(StackFrame(
       call_stack_.back().scenario, new_location, StackFrame::TYPE_GOSUB));
 }
@@ -423,6 +622,22 @@ void RLMachine::ReturnFromGosub() {
   PopStackFrame();
 }
 
+void RLMachine::EvictUnreferencedScenarios(int scenario) {
+  // Frames pushed while a LongOperation runs wait in |delayed_modifications_|,
+  // where we can't see which scenarios they point to.
+  if (delay_stack_modifications_ || archive_.scenario_budget() == 0)
+    return;
+
+  std::set<int> pinned;
+  pinned.insert(scenario);
+  for (auto const& frame : call_stack_)
+    pinned.insert(frame.scenario->scene_number());
+  for (auto const& frame : savepoint_call_stack_)
+    pinned.insert(frame.scenario->scene_number());
+
+  archive_.EvictScenarios(pinned);
+}
+
 void RLMachine::PushStringValueUp(int index, const std::string& val) {
   if (index < 0 || index > 2) {
     throw rlvm::Exception("Invalid index in pushStringValue");
@@ -545,8 +760,30 @@ const libreallive::Scenario& RLMachine::Scenario() const {
   return *call_stack_.back().scenario;
 }
 
+libreallive::ExpressionArena* RLMachine::ExpressionArenaFor(
+    const libreallive::BytecodeElement& element) const {
+  if (call_stack_.empty())
+    return NULL;
+
+  const StackFrame& frame = call_stack_.back();
+  if (frame.frame_type == StackFrame::TYPE_LONGOP || !frame.scenario ||
+      frame.ip >= frame.scenario->size() ||
+      frame.scenario->GetElement(frame.ip) != &element) {
+    return NULL;
+  }
+
+  return frame.scenario->expression_arena();
+}
+
 void RLMachine::ExecuteExpression(const libreallive::ExpressionElement& e) {
-  e.ParsedExpression().GetIntegerValue(*this);
+  if (opcode_profiler_) {
+    OpcodeProfiler::Sample sample(
+        *opcode_profiler_, opcode_profiler_->expression_entry(), SceneNumber(),
+        line_);
+    e.Evaluate(*this);
+  } else {
+    e.Evaluate(*this);
+  }
   AdvanceInstructionPointer();
 }
 
@@ -654,10 +891,17 @@ int RLMachine::CallDLL(int slot,
   }
 }
 
-unsigned int RLMachine::PackModuleNumber(int modtype, int module) {
+unsigned int RLMachine::PackModuleNumber(int modtype, int module) const {
   return (modtype << 8) | module;
 }
 
+RLModule* RLMachine::GetModule(const libreallive::CommandElement& f) const {
+  unsigned int packed_module = PackModuleNumber(f.modtype(), f.module());
+  if (packed_module < modules_.size())
+    return modules_[packed_module].get();
+  return NULL;
+}
+
 void RLMachine::SetPrintUndefinedOpcodes(bool in) {
   print_undefined_opcodes_ = in;
 }
@@ -666,6 +910,16 @@ void RLMachine::RecordUndefinedOpcodeCounts() {
   undefined_log_.reset(new OpcodeLog);
 }
 
+void RLMachine::StartOpcodeProfiling() {
+  opcode_profiler_.reset(new OpcodeProfiler);
+}
+
+SaveGameIndex& RLMachine::save_game_index() {
+  if (!save_game_index_)
+    save_game_index_.reset(new SaveGameIndex(system_.GameSaveDirectory()));
+  return *save_game_index_;
+}
+
 void RLMachine::Halt() { halted_ = true; }
 
 void RLMachine::SetHaltOnException(bool halt_on_exception) {
@@ -721,6 +975,14 @@ template void RLMachine::save<boost::archive::text_oarchive>(
     boost::archive::text_oarchive& ar,
     unsigned int version) const;
 
+template void RLMachine::save<boost::archive::binary_oarchive>(
+    boost::archive::binary_oarchive& ar,
+    unsigned int version) const;
+
 template void RLMachine::load<boost::archive::text_iarchive>(
     boost::archive::text_iarchive& ar,
     unsigned int version);
+
+template void RLMachine::load<boost::archive::binary_iarchive>(
+    boost::archive::binary_iarchive& ar,
+    unsigned int version);
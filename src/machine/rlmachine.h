@@ -30,7 +30,9 @@
 
 #include <boost/serialization/split_member.hpp>
 
+#include <chrono>
 #include <functional>
+#include <limits>
 #include <map>
 #include <memory>
 #include <string>
@@ -46,11 +48,20 @@ class Archive;
 class IntMemRef;
 };
 
+namespace rlvm {
+class UnimplementedOpcode;
+};
+
+class GlobalMemoryJournal;
 class LongOperation;
 class Memory;
 class OpcodeLog;
+class OpcodeProfiler;
 class RLModule;
+class RLOperation;
 class RealLiveDLL;
+class SaveGameIndex;
+class SaveWriter;
 class System;
 struct StackFrame;
 
@@ -103,6 +114,12 @@ class RLMachine {
   // |module|.
   virtual void AttachModule(RLModule* module);
 
+  // Forgets which RLOperation each CommandElement was dispatched to, so the
+  // next execution looks it up again. Attaching a module or adding an opcode
+  // to an attached module does this automatically; anything else that changes
+  // which operation handles an opcode must call it.
+  void InvalidateDispatchCache();
+
   // ------------------------------------- [ Implicit savepoint management ]
   // RealLive will save the latest savepoint for the topmost stack
   // frame. Savepoints can be manually set (with the "Savepoint" command), but
@@ -174,13 +191,13 @@ class RLMachine {
   void ReturnFromFarcall();
 
   // Permanently moves the instruction pointer to the passed in
-  // iterator in the current stack frame.
-  void GotoLocation(libreallive::BytecodeList::iterator new_location);
+  // location in the current stack frame.
+  void GotoLocation(libreallive::pointer_t new_location);
 
   // Pushes a new stack frame onto the call stack, saving the current
   // location. The new frame contains the current SEEN with
   // new_location as the instruction pointer.
-  void Gosub(libreallive::BytecodeList::iterator new_location);
+  void Gosub(libreallive::pointer_t new_location);
 
   // Returns from the most recent gosub call. Throws if there's a mismatch
   // between farcall()/rtl() gosub()/ret() pairs.
@@ -210,6 +227,12 @@ class RLMachine {
   // Returns the actual Scenario on the top top of the call stack.
   const libreallive::Scenario& Scenario() const;
 
+  // Returns the arena that expressions parsed for |element| should live in:
+  // that of the current Scenario if |element| is the instruction being
+  // executed there, NULL for elements that don't belong to a Scenario.
+  libreallive::ExpressionArena* ExpressionArenaFor(
+      const libreallive::BytecodeElement& element) const;
+
   // ------------------------------------------------ [ Execution interface ]
   // Normally, execute_next_instruction will call RunOnMachine() on
   // whatever BytecodeElement is currently pointed to by the
@@ -235,7 +258,15 @@ class RLMachine {
   // that hasn't been patched at the time this method is called.)
   int GetProbableEncodingType() const;
 
+  // Executes |f|. Throws rlvm::UnimplementedOpcode if no attached module
+  // implements it.
   void ExecuteCommand(const libreallive::CommandElement& f);
+
+  // Executes |f| as the current instruction. Unlike ExecuteCommand(), an
+  // opcode that no module implements doesn't throw: it's reported the same way
+  // ExecuteNextInstruction() reports a thrown rlvm::UnimplementedOpcode and
+  // the instruction pointer moves on.
+  void RunCommand(const libreallive::CommandElement& f);
   void ExecuteExpression(const libreallive::ExpressionElement& e);
   void PerformTextout(const libreallive::TextoutElement& e);
   void PerformTextout(const std::string& cp932str);
@@ -278,6 +309,17 @@ class RLMachine {
   // fire between RLMachine instructions.
   void ExecuteUntilHalted();
 
+  // Executes instructions for about |budget| of wall time. Stops early when
+  // the machine halts, enters a long operation, or the system asks for a
+  // redraw with force_wait(). To keep the clock out of the inner loop, it is
+  // only read every kSliceBatchSize instructions, so a slice can overrun by a
+  // few instructions. Never runs more than |max_instructions|; pass
+  // std::chrono::nanoseconds::max() to be limited by that count alone.
+  // Returns the number of instructions executed.
+  int ExecuteSlice(
+      std::chrono::nanoseconds budget,
+      int max_instructions = std::numeric_limits<int>::max());
+
   // Increments the stack pointer in the current frame. If we have run
   // off the end of the current scenario, set the halted bit.
   void AdvanceInstructionPointer();
@@ -285,6 +327,28 @@ class RLMachine {
   // Returns the command name of |f|.
   std::string GetCommandName(const libreallive::CommandElement& f);
 
+  // Returns the RLOperation that implements |f|, or NULL if no attached module
+  // handles it.
+  RLOperation* GetOperation(const libreallive::CommandElement& f);
+
+  // A command whose parameters PreparseParameters() couldn't parse.
+  struct ParameterParseFailure {
+    int scenario;
+    // Index of the command in its Scenario.
+    int instruction;
+    std::string message;
+  };
+
+  // Parses the parameters of every command in every scenario in the archive
+  // up front, on |num_threads| threads (or one less than the number of cores
+  // if |num_threads| is 0), so that the first execution of a command doesn't
+  // pay for the parse and the bytecode is no longer written to while the game
+  // runs. Must be called after all modules are attached and before anything
+  // is executed. Commands without an implementation are left alone. Returns
+  // every command (or scenario) that failed to parse, ordered by scenario;
+  // those stay unparsed and report their error when reached, as before.
+  std::vector<ParameterParseFailure> PreparseParameters(int num_threads);
+
   // Pauses execution and notifies the System. Every call to
   // executeNextInstruction() will return immediately and the System's internal
   // timer will stop ticking.
@@ -303,6 +367,30 @@ class RLMachine {
   // results to stderr on machine destruction.
   void RecordUndefinedOpcodeCounts();
 
+  // The log started by RecordUndefinedOpcodeCounts(), or NULL.
+  const OpcodeLog* undefined_opcode_log() const { return undefined_log_.get(); }
+
+  // Starts timing every command and expression executed, by opcode and by
+  // SEEN and line. See OpcodeProfiler.
+  void StartOpcodeProfiling();
+
+  // The profiler started by StartOpcodeProfiling(), or NULL.
+  OpcodeProfiler* opcode_profiler() { return opcode_profiler_.get(); }
+
+  // Writes this machine's save files in the background. See
+  // Serialization::saveGameForSlot().
+  SaveWriter& save_writer() { return *save_writer_; }
+
+  // The headers of the saves in the game's save directory. Opened on first
+  // use.
+  SaveGameIndex& save_game_index();
+
+  // What of global memory has been persisted. See
+  // Serialization::journalGlobalMemory().
+  GlobalMemoryJournal& global_memory_journal() {
+    return *global_memory_journal_;
+  }
+
   // ---------------------------------------------------------------------
 
   // Force the machine to halt. This should terminate the execution of
@@ -314,7 +402,29 @@ class RLMachine {
   // it will.
   void SetHaltOnException(bool halt_on_exception);
 
-  unsigned int PackModuleNumber(int modtype, int module);
+  unsigned int PackModuleNumber(int modtype, int module) const;
+
+  // How many instructions ExecuteSlice() runs between reads of the clock.
+  static const int kSliceBatchSize = 32;
+
+  // Returns the RLOperation for |f|, going through the cache on |f| (see
+  // |dispatch_epoch_|), or NULL if no attached module handles it.
+  RLOperation* ResolveOperation(const libreallive::CommandElement& f);
+
+  // Skips the current instruction, |f|, which resolved to |op| (possibly
+  // NULL) and isn't implemented.
+  void SkipUnimplementedCommand(const libreallive::CommandElement& f,
+                                RLOperation* op);
+
+  // Dispatches |f| to |op|, timing it when profiling.
+  void DispatchCommand(RLOperation* op, const libreallive::CommandElement& f);
+
+  // Prints and counts |e| as requested by SetPrintUndefinedOpcodes() and
+  // RecordUndefinedOpcodeCounts().
+  void ReportUnimplementedOpcode(const rlvm::UnimplementedOpcode& e);
+
+  // Returns the attached module that handles |f|, or NULL.
+  RLModule* GetModule(const libreallive::CommandElement& f) const;
 
   // Pushes a stack frame onto the call stack, alerting possible
   // LongOperations of this change if needed.
@@ -351,16 +461,26 @@ class RLMachine {
   void AddLineAction(const int seen, const int line, std::function<void(void)>);
 
  private:
+  // Lets the archive evict parsed scenarios (see
+  // Archive::set_scenario_budget()) that aren't referenced by any frame on
+  // the call stack or the savepoint stack. |scenario| is about to be put on
+  // the call stack and is kept too.
+  void EvictUnreferencedScenarios(int scenario);
+
   // The Reallive VM's integer and string memory
   std::unique_ptr<Memory> memory_;
 
   // The RealLive machine's single result register
   int store_register_ = 0;
 
-  // Mapping between the module_type:module pair and the module implementation
-  typedef std::unordered_map<unsigned int, std::unique_ptr<RLModule>> ModuleMap;
-  // Mapping between the module_type:module pair and the module implementation
-  ModuleMap modules_;
+  // The attached modules, indexed directly by PackModuleNumber(). Grown as
+  // modules are attached; unused slots are NULL.
+  std::vector<std::unique_ptr<RLModule>> modules_;
+
+  // Tag for the RLOperations cached on CommandElements by ExecuteCommand().
+  // Drawn from a process wide counter, so a cache entry left behind by another
+  // machine (or by this one before InvalidateDispatchCache()) never matches.
+  uint64_t dispatch_epoch_;
 
   // States whether the RLMachine is in the halted state (and thus won't
   // execute more instructions)
@@ -393,6 +513,20 @@ class RLMachine {
   // undefined opcodes.
   std::unique_ptr<OpcodeLog> undefined_log_;
 
+  // (Optional) Timings of every instruction executed.
+  std::unique_ptr<OpcodeProfiler> opcode_profiler_;
+
+  // Created by save_game_index(). Declared before |save_writer_| since the
+  // writer updates it when a write finishes.
+  std::unique_ptr<SaveGameIndex> save_game_index_;
+
+  // Declared before |save_writer_| for the same reason.
+  std::unique_ptr<GlobalMemoryJournal> global_memory_journal_;
+
+  // Save files still being compressed and written. Destroying it waits for
+  // them to finish.
+  std::unique_ptr<SaveWriter> save_writer_;
+
   // Override defaults
   bool mark_savepoints_ = true;
 
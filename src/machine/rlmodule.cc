@@ -27,6 +27,7 @@
 
 #include "machine/rlmodule.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <utility>
@@ -36,6 +37,7 @@
 
 #include "libreallive/bytecode.h"
 #include "machine/general_operations.h"
+#include "machine/rlmachine.h"
 #include "machine/rloperation.h"
 #include "utilities/exception.h"
 
@@ -71,17 +73,22 @@ void RLModule::AddOpcode(int opcode,
   int packed_opcode = PackOpcodeNumber(opcode, overload);
   op->set_name(name);
   op->module_ = this;
-#ifndef NDEBUG
-  OpcodeMap::iterator it = stored_operations_.find(packed_opcode);
+  std::unique_ptr<RLOperation> owned_op(op);
 
-  if (it != stored_operations_.end()) {
+  OpcodeMap::const_iterator it = LowerBound(packed_opcode);
+  if (it != stored_operations_.end() && it->first == packed_opcode) {
+#ifndef NDEBUG
     std::ostringstream oss;
     oss << "Duplicate opcode in " << *this << ": opcode " << opcode << ", "
         << int(overload);
     throw rlvm::Exception(oss.str());
-  }
 #endif
-  stored_operations_.emplace(packed_opcode, std::unique_ptr<RLOperation>(op));
+    return;
+  }
+  stored_operations_.emplace(it, packed_opcode, std::move(owned_op));
+
+  if (machine_)
+    machine_->InvalidateDispatchCache();
 }
 
 void RLModule::AddUnsupportedOpcode(int opcode,
@@ -127,39 +134,65 @@ RLModule::PropertyList::iterator RLModule::FindProperty(int property) const {
                  [&](Property& p) { return p.first == property; });
 }
 
+RLModule::OpcodeMap::const_iterator RLModule::LowerBound(
+    int packed_opcode) const {
+  return std::lower_bound(
+      stored_operations_.begin(),
+      stored_operations_.end(),
+      packed_opcode,
+      [](const OpcodeMap::value_type& entry, int key) {
+        return entry.first < key;
+      });
+}
+
+RLOperation* RLModule::FindOperation(int packed_opcode) const {
+  OpcodeMap::const_iterator it = LowerBound(packed_opcode);
+  if (it != stored_operations_.end() && it->first == packed_opcode)
+    return it->second.get();
+  return NULL;
+}
+
 std::string RLModule::GetCommandName(RLMachine& machine,
                                      const libreallive::CommandElement& f) {
-  OpcodeMap::iterator it =
-      stored_operations_.find(PackOpcodeNumber(f.opcode(), f.overload()));
+  RLOperation* op = FindOperation(PackOpcodeNumber(f.opcode(), f.overload()));
   std::string name;
-  if (it != stored_operations_.end())
-    name = it->second->name();
+  if (op)
+    name = op->name();
   return name;
 }
 
+RLOperation* RLModule::GetOperation(
+    const libreallive::CommandElement& f) const {
+  return FindOperation(PackOpcodeNumber(f.opcode(), f.overload()));
+}
+
 void RLModule::DispatchFunction(RLMachine& machine,
                                 const libreallive::CommandElement& f) {
-  OpcodeMap::iterator it =
-      stored_operations_.find(PackOpcodeNumber(f.opcode(), f.overload()));
-  if (it != stored_operations_.end()) {
-    try {
-      if (machine.is_tracing_on()) {
-        std::cerr << "(SEEN" << std::setw(4) << std::setfill('0')
-                  << machine.SceneNumber()
-                  << ")(Line " << std::setw(4) << std::setfill('0')
-                  << machine.line_number() << "): " << it->second->name();
-        libreallive::PrintParameterString(std::cerr,
-                                          f.GetUnparsedParameters());
-        std::cerr << std::endl;
-      }
-      it->second->DispatchFunction(machine, f);
-    }
-    catch (rlvm::Exception& e) {
-      e.setOperation(it->second.get());
-      throw;
-    }
-  } else {
+  RLOperation* op = GetOperation(f);
+  if (op)
+    DispatchOperation(machine, op, f);
+  else
     throw rlvm::UnimplementedOpcode(machine, f);
+}
+
+// static
+void RLModule::DispatchOperation(RLMachine& machine,
+                                 RLOperation* op,
+                                 const libreallive::CommandElement& f) {
+  try {
+    if (machine.is_tracing_on()) {
+      std::cerr << "(SEEN" << std::setw(4) << std::setfill('0')
+                << machine.SceneNumber()
+                << ")(Line " << std::setw(4) << std::setfill('0')
+                << machine.line_number() << "): " << op->name();
+      libreallive::PrintParameterString(std::cerr, f.GetUnparsedParameters());
+      std::cerr << std::endl;
+    }
+    op->DispatchFunction(machine, f);
+  }
+  catch (rlvm::Exception& e) {
+    e.setOperation(op);
+    throw;
   }
 }
 
@@ -28,10 +28,8 @@
 #ifndef SRC_MACHINE_RLMODULE_H_
 #define SRC_MACHINE_RLMODULE_H_
 
-#include <map>
 #include <memory>
 #include <string>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -86,16 +84,10 @@ class RLOperation;
 // an RLMachine before the machine starts.
 class RLModule {
  public:
-  // Storage type of the opcodes. Exposed so TestMachine can iterate over this.
-#if defined(__APPLE__)
-  // There is something weird about unordered_map on OSX. When using an
-  // unordered_map here with whatever dev tools shipped on Maverick, one single
-  // unit test fails. For now, just falling back to a map, which shouldn't
-  // perform too much worse in practice.
-  typedef std::map<int, std::unique_ptr<RLOperation>> OpcodeMap;
-#else
-  typedef std::unordered_map<int, std::unique_ptr<RLOperation>> OpcodeMap;
-#endif
+  // Storage type of the opcodes, sorted by packed opcode number (see
+  // PackOpcodeNumber()) so lookups are a binary search over one contiguous
+  // array. Exposed so TestMachine can iterate over this.
+  typedef std::vector<std::pair<int, std::unique_ptr<RLOperation>>> OpcodeMap;
 
  public:
   virtual ~RLModule();
@@ -130,9 +122,19 @@ class RLModule {
   void DispatchFunction(RLMachine& machine,
                         const libreallive::CommandElement& f);
 
+  // Executes |op|, an operation of some module, for |f|. This is the part of
+  // DispatchFunction() after the lookup, for callers that already have the
+  // RLOperation.
+  static void DispatchOperation(RLMachine& machine,
+                                RLOperation* op,
+                                const libreallive::CommandElement& f);
+
   std::string GetCommandName(RLMachine& machine,
                              const libreallive::CommandElement& f);
 
+  // Returns the RLOperation that implements |f| in this module, or NULL.
+  RLOperation* GetOperation(const libreallive::CommandElement& f) const;
+
   OpcodeMap::iterator begin() { return stored_operations_.begin(); }
   OpcodeMap::iterator end() { return stored_operations_.end(); }
 
@@ -147,11 +149,20 @@ class RLModule {
            int in_module_number);
 
  private:
+  friend class RLMachine;
+
   typedef std::pair<int, int> Property;
   typedef std::vector<Property> PropertyList;
 
   PropertyList::iterator FindProperty(int property) const;
 
+  // Returns the first entry in |stored_operations_| whose packed opcode is not
+  // less than |packed_opcode|.
+  OpcodeMap::const_iterator LowerBound(int packed_opcode) const;
+
+  // Returns the operation stored under |packed_opcode|, or NULL.
+  RLOperation* FindOperation(int packed_opcode) const;
+
   std::unique_ptr<PropertyList> property_list_;
 
   int module_type_;
@@ -160,6 +171,10 @@ class RLModule {
 
   // Store functions.
   OpcodeMap stored_operations_;
+
+  // The machine this module is attached to, which is told to drop its cached
+  // dispatch targets whenever an opcode is added afterwards.
+  RLMachine* machine_ = nullptr;
 };
 
 std::ostream& operator<<(std::ostream&, const RLModule& module);
@@ -88,14 +88,11 @@ RLOperation::PropertyList::iterator RLOperation::FindProperty(int property)
 
 bool RLOperation::AdvanceInstructionPointer() { return true; }
 
+bool RLOperation::IsImplemented() const { return true; }
+
 void RLOperation::DispatchFunction(RLMachine& machine,
                                    const libreallive::CommandElement& ff) {
-  if (!ff.AreParametersParsed()) {
-    std::vector<std::string> unparsed = ff.GetUnparsedParameters();
-    libreallive::ExpressionPiecesVector output;
-    ParseParameters(unparsed, output);
-    ff.SetParsedParameters(std::move(output));
-  }
+  CacheParsedParameters(ff, machine.ExpressionArenaFor(ff));
 
   const libreallive::ExpressionPiecesVector& parameter_pieces =
       ff.GetParsedParameters();
@@ -110,6 +107,18 @@ void RLOperation::DispatchFunction(RLMachine& machine,
     machine.AdvanceInstructionPointer();
 }
 
+void RLOperation::CacheParsedParameters(const libreallive::CommandElement& f,
+                                        libreallive::ExpressionArena* arena) {
+  if (f.AreParametersParsed())
+    return;
+
+  libreallive::ScopedExpressionArena scope(arena);
+  std::vector<std::string> unparsed = f.GetUnparsedParameters();
+  libreallive::ExpressionPiecesVector output;
+  ParseParameters(unparsed, output);
+  f.SetParsedParameters(std::move(output));
+}
+
 // Implementation for IntConstant_T
 IntConstant_T::type IntConstant_T::getData(
     RLMachine& machine,
@@ -266,12 +275,7 @@ void RLOp_SpecialCase::ParseParameters(
 void RLOp_SpecialCase::DispatchFunction(RLMachine& machine,
                                         const libreallive::CommandElement& ff) {
   // First try to run the default parse_parameters if we can.
-  if (!ff.AreParametersParsed()) {
-    std::vector<std::string> unparsed = ff.GetUnparsedParameters();
-    libreallive::ExpressionPiecesVector output;
-    ParseParameters(unparsed, output);
-    ff.SetParsedParameters(std::move(output));
-  }
+  CacheParsedParameters(ff, machine.ExpressionArenaFor(ff));
 
   // Pass this on to the implementation of this functor.
   operator()(machine, ff);
@@ -112,6 +112,11 @@ class RLOperation {
   // the instruction pointer to be advanced automatically.
   virtual bool AdvanceInstructionPointer();
 
+  // Whether this operation does anything. Returns false for placeholders
+  // such as UndefinedFunction, which RLMachine::RunCommand() skips without
+  // dispatching to them.
+  virtual bool IsImplemented() const;
+
   // The Dispatch function is implemented on a per type basis and is called by
   // the Module, after checking to make sure that the
   virtual void Dispatch(
@@ -127,6 +132,13 @@ class RLOperation {
   virtual void DispatchFunction(RLMachine& machine,
                                 const libreallive::CommandElement& f);
 
+  // Parses |f|'s parameters with ParseParameters() and caches them on |f|,
+  // allocating the pieces from |arena|. Does nothing if |f| already has parsed
+  // parameters. This is the parse step of DispatchFunction(), exposed so that
+  // RLMachine::PreparseParameters() can run it ahead of time.
+  void CacheParsedParameters(const libreallive::CommandElement& f,
+                             libreallive::ExpressionArena* arena);
+
  private:
   friend class RLModule;
   friend class MappedRLModule;
@@ -26,6 +26,8 @@
 
 #include "machine/rlvm_instance.h"
 
+#include <chrono>
+#include <iomanip>
 #include <iostream>
 #include <string>
 
@@ -34,7 +36,9 @@
 #include "machine/dump_scenario.h"
 #include "machine/game_hacks.h"
 #include "machine/memory.h"
+#include "machine/opcode_profiler.h"
 #include "machine/rlmachine.h"
+#include "machine/save_writer.h"
 #include "machine/serialization.h"
 #include "modules/module_sys_save.h"
 #include "modules/modules.h"
@@ -60,6 +64,10 @@ const char* siglus_exes[] = {"siglus.exe",       "siglusengine-ch.exe",
                              "siglusengine.exe", "siglusenginechs.exe",
                              NULL};
 
+// How often, in milliseconds, changes to global memory are journaled while
+// the game runs, so that a crash loses little kidoku and settings.
+const unsigned int kJournalGlobalMemoryInterval = 30 * 1000;
+
 RLVMInstance::RLVMInstance()
     : seen_start_(-1),
       memory_(false),
@@ -67,7 +75,13 @@ RLVMInstance::RLVMInstance()
       count_undefined_copcodes_(false),
       tracing_(false),
       load_save_(-1),
-      dump_seen_(-1) {
+      dump_seen_(-1),
+      preload_scenarios_(false),
+      scenario_cache_(true),
+      preparse_parameters_(false),
+      scenario_budget_(0),
+      save_compression_(Serialization::SAVE_COMPRESSION_ZLIB),
+      save_format_(Serialization::SAVE_FORMAT_BINARY) {
   srand(time(NULL));
 }
 
@@ -105,10 +119,32 @@ void RLVMInstance::Run(const boost::filesystem::path& gamerootPath) {
 
     libreallive::Archive arc(seenPath.string(), gameexe("REGNAME"));
     SDLSystem sdlSystem(gameexe);
+
+    if (scenario_cache_) {
+      arc.UseScenarioCache(
+          (sdlSystem.GameSaveDirectory() / "scenarios.cache").string());
+    }
+    arc.set_scenario_budget(scenario_budget_);
+    if (preload_scenarios_)
+      arc.StartPreloading(0);
+
     RLMachine rlmachine(sdlSystem, arc);
+    rlmachine.save_writer().set_compression(save_compression_);
+    rlmachine.save_writer().set_archive_format(save_format_);
     AddAllModules(rlmachine);
     AddGameHacks(rlmachine);
 
+    if (preparse_parameters_) {
+      for (auto const& failure : rlmachine.PreparseParameters(0)) {
+        std::cerr << "(SEEN" << std::setw(4) << std::setfill('0')
+                  << failure.scenario << ")";
+        if (failure.instruction >= 0)
+          std::cerr << "(Instruction " << failure.instruction << ")";
+        std::cerr << ": Couldn't parse parameters: " << failure.message
+                  << std::endl;
+      }
+    }
+
     if (dump_seen_ != -1) {
       libreallive::Scenario* scenario = arc.GetScenario(dump_seen_);
       DumpScenario(&rlmachine, scenario);
@@ -140,6 +176,11 @@ void RLVMInstance::Run(const boost::filesystem::path& gamerootPath) {
     if (tracing_)
       rlmachine.set_tracing_on();
 
+    if (!opcode_profile_.empty())
+      rlmachine.StartOpcodeProfiling();
+    ScopedOpcodeReport opcode_report(rlmachine.opcode_profiler(),
+                                     opcode_profile_);
+
     Serialization::loadGlobalMemory(rlmachine);
 
     // Now to preform a quick integrity check. If the user opened the Japanese
@@ -152,6 +193,7 @@ void RLVMInstance::Run(const boost::filesystem::path& gamerootPath) {
     if (load_save_ != -1)
       Sys_load()(rlmachine, load_save_);
 
+    unsigned int last_journal_ticks = sdlSystem.event().GetTicks();
     while (!rlmachine.halted()) {
       // Give SDL a chance to respond to events, redraw the screen,
       // etc.
@@ -161,13 +203,18 @@ void RLVMInstance::Run(const boost::filesystem::path& gamerootPath) {
       // slice. Bail out if we switch to long operation mode, or if the screen
       // is marked as dirty.
       unsigned int start_ticks = sdlSystem.event().GetTicks();
-      unsigned int end_ticks = start_ticks;
-      do {
-        rlmachine.ExecuteNextInstruction();
-        end_ticks = sdlSystem.event().GetTicks();
-      } while (!rlmachine.CurrentLongOperation() &&
-               !sdlSystem.force_wait() &&
-               (end_ticks - start_ticks < 10));
+      rlmachine.ExecuteSlice(std::chrono::milliseconds(10));
+      unsigned int end_ticks = sdlSystem.event().GetTicks();
+
+      for (const std::string& failure :
+           rlmachine.save_writer().TakeFailures()) {
+        ReportError(_("Could not save"), failure);
+      }
+
+      if (end_ticks - last_journal_ticks >= kJournalGlobalMemoryInterval) {
+        Serialization::journalGlobalMemory(rlmachine);
+        last_journal_ticks = end_ticks;
+      }
 
       // Sleep to be nice to the processor and to give the GPU a chance to
       // catch up.
@@ -212,6 +259,11 @@ void RLVMInstance::ReportFatalError(const std::string& message_text,
   std::cerr << message_text << ": " << informative_text << std::endl;
 }
 
+void RLVMInstance::ReportError(const std::string& message_text,
+                               const std::string& informative_text) {
+  std::cerr << message_text << ": " << informative_text << std::endl;
+}
+
 void RLVMInstance::DoUserNameCheck(RLMachine& machine) {
   try {
     int encoding = machine.GetProbableEncodingType();
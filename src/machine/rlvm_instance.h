@@ -30,6 +30,8 @@
 #include <boost/filesystem/operations.hpp>
 #include <string>
 
+#include "machine/serialization.h"
+
 class Platform;
 class RLMachine;
 class System;
@@ -49,10 +51,21 @@ class RLVMInstance {
   void set_undefined_opcodes() { undefined_opcodes_ = true; }
   void set_count_undefined() { count_undefined_copcodes_ = true; }
   void set_tracing() { tracing_ = true; }
+  void set_opcode_profile(const std::string& path) { opcode_profile_ = path; }
   void set_load_save(int in) { load_save_ = in; }
   void set_custom_font(const std::string& font) { custom_font_ = font; }
 
   void set_dump_seen(int in) { dump_seen_ = in; }
+  void set_preload_scenarios() { preload_scenarios_ = true; }
+  void set_no_scenario_cache() { scenario_cache_ = false; }
+  void set_preparse_parameters() { preparse_parameters_ = true; }
+  void set_scenario_budget(size_t bytes) { scenario_budget_ = bytes; }
+  void set_save_compression(Serialization::SaveCompression compression) {
+    save_compression_ = compression;
+  }
+  void set_save_format(Serialization::SaveFormat format) {
+    save_format_ = format;
+  }
 
   // Optionally brings up a file selection dialog to get the game directory. In
   // case this isn't implemented or the user clicks cancel, returns an empty
@@ -64,6 +77,11 @@ class RLVMInstance {
   virtual void ReportFatalError(const std::string& message_text,
                                 const std::string& informative_text);
 
+  // Like ReportFatalError(), for problems the game carries on after, such as
+  // a save that couldn't be written.
+  virtual void ReportError(const std::string& message_text,
+                           const std::string& informative_text);
+
   // Ask the user if we should take an action.
   virtual bool AskUserPrompt(const std::string& message_text,
                              const std::string& informative_text,
@@ -105,11 +123,38 @@ class RLVMInstance {
   // Whether we should print out the opcodes as they are running.
   bool tracing_;
 
+  // Where to write the timings of every opcode on exit, if not empty. See
+  // OpcodeProfiler::WriteReport() for the format.
+  std::string opcode_profile_;
+
   // Loads the specified save file as soon as emulation starts if not -1.
   int load_save_;
 
   // Dumps pseudo-kepago of the current seen to stdout and exit if not -1.
   int dump_seen_;
+
+  // Whether we should parse every scenario in the background on startup
+  // instead of on first jump.
+  bool preload_scenarios_;
+
+  // Whether we should keep decompressed scenarios in the game's save
+  // directory between runs.
+  bool scenario_cache_;
+
+  // Whether we should parse the parameters of every command before starting
+  // instead of on first execution.
+  bool preparse_parameters_;
+
+  // How many bytes of parsed scenarios to keep in memory, or 0 to keep every
+  // scenario once it has been parsed.
+  size_t scenario_budget_;
+
+  // The codec save games and global memory are written with, other than
+  // quicksaves.
+  Serialization::SaveCompression save_compression_;
+
+  // The archive format save games and global memory are written with.
+  Serialization::SaveFormat save_format_;
 };
 
 #endif  // SRC_MACHINE_RLVM_INSTANCE_H_
@@ -0,0 +1,315 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+#include "machine/save_codec.h"
+
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/operations.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "utilities/exception.h"
+#include "utilities/gettext.h"
+#include "utilities/lz_compression.h"
+
+using Serialization::SaveCompression;
+
+namespace {
+
+// The most bytes any codec needs to recognize its stream.
+const size_t kMaxMagicSize = 4;
+
+// -----------------------------------------------------------------------
+// zlib
+// -----------------------------------------------------------------------
+
+// What every rlvm before the LZ codec wrote. Older builds only read it
+// around a text archive.
+class ZlibSaveCodec : public SaveCodec {
+ public:
+  virtual SaveCompression compression() const override {
+    return Serialization::SAVE_COMPRESSION_ZLIB;
+  }
+
+  // A zlib stream starts with a deflate method byte and a check byte that
+  // makes the pair a multiple of 31.
+  virtual bool Matches(const unsigned char* start,
+                       size_t size) const override {
+    return size >= 2 && (start[0] & 0x0f) == 8 &&
+           ((start[0] << 8) | start[1]) % 31 == 0;
+  }
+
+  virtual void PushCompressor(OutputStream& stream) const override {
+    stream.push(boost::iostreams::zlib_compressor());
+  }
+
+  virtual void PushDecompressor(InputStream& stream) const override {
+    stream.push(boost::iostreams::zlib_decompressor());
+  }
+};
+
+// -----------------------------------------------------------------------
+// LZ
+// -----------------------------------------------------------------------
+
+// The stream is the magic, then blocks of at most kMaxLzBlockSize bytes,
+// each preceded by its decompressed and stored sizes as little endian 32 bit
+// integers. A block whose sizes are equal is stored uncompressed. A block
+// with a decompressed size of zero ends the stream.
+const char kLzMagic[] = {'R', 'L', 'Z', 1};
+
+const size_t kLzBlockHeaderSize = 8;
+
+void AppendUint32(std::string& dest, uint32_t value) {
+  for (int i = 0; i < 4; ++i)
+    dest += static_cast<char>((value >> (i * 8)) & 0xff);
+}
+
+uint32_t ReadUint32(const char* src) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(src);
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+         (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+class LzCompressor {
+ public:
+  typedef char char_type;
+  struct category : boost::iostreams::multichar_output_filter_tag,
+                    boost::iostreams::closable_tag {};
+
+  template <typename Sink>
+  std::streamsize write(Sink& sink, const char* s, std::streamsize n) {
+    pending_.append(s, n);
+    while (pending_.size() >= kMaxLzBlockSize) {
+      WriteBlock(sink, pending_.data(), kMaxLzBlockSize);
+      pending_.erase(0, kMaxLzBlockSize);
+    }
+    return n;
+  }
+
+  template <typename Sink>
+  void close(Sink& sink) {
+    if (!pending_.empty())
+      WriteBlock(sink, pending_.data(), pending_.size());
+    pending_.clear();
+
+    std::string end;
+    if (!wrote_magic_)
+      end.append(kLzMagic, sizeof(kLzMagic));
+    AppendUint32(end, 0);
+    AppendUint32(end, 0);
+    boost::iostreams::write(sink, end.data(), end.size());
+    wrote_magic_ = false;
+  }
+
+ private:
+  template <typename Sink>
+  void WriteBlock(Sink& sink, const char* data, size_t size) {
+    block_.clear();
+    if (!wrote_magic_) {
+      block_.append(kLzMagic, sizeof(kLzMagic));
+      wrote_magic_ = true;
+    }
+
+    size_t header = block_.size();
+    AppendUint32(block_, size);
+    AppendUint32(block_, 0);
+    LzCompress(data, size, &block_);
+
+    size_t stored = block_.size() - header - kLzBlockHeaderSize;
+    if (stored >= size) {
+      block_.resize(header + kLzBlockHeaderSize);
+      block_.append(data, size);
+      stored = size;
+    }
+    for (int i = 0; i < 4; ++i)
+      block_[header + 4 + i] = static_cast<char>((stored >> (i * 8)) & 0xff);
+
+    boost::iostreams::write(sink, block_.data(), block_.size());
+  }
+
+  // Input not yet making up a whole block.
+  std::string pending_;
+
+  // Scratch space for the block being written.
+  std::string block_;
+
+  bool wrote_magic_ = false;
+};
+
+class LzDecompressor {
+ public:
+  typedef char char_type;
+  struct category : boost::iostreams::multichar_input_filter_tag,
+                    boost::iostreams::closable_tag {};
+
+  template <typename Source>
+  std::streamsize read(Source& source, char* s, std::streamsize n) {
+    if (position_ == block_.size()) {
+      if (finished_ || !ReadBlock(source))
+        return -1;
+    }
+
+    std::streamsize count =
+        std::min<std::streamsize>(n, block_.size() - position_);
+    memcpy(s, block_.data() + position_, count);
+    position_ += count;
+    return count;
+  }
+
+  template <typename Source>
+  void close(Source&) {
+    block_.clear();
+    position_ = 0;
+    read_magic_ = false;
+    finished_ = false;
+  }
+
+ private:
+  // Reads exactly |size| bytes into |dest|. Throws if the stream ends first,
+  // or stops giving bytes without saying it has ended; save files are only
+  // read from blocking sources, where that can't be waited out.
+  template <typename Source>
+  void ReadExactly(Source& source, char* dest, size_t size) {
+    size_t got = 0;
+    while (got < size) {
+      std::streamsize count =
+          boost::iostreams::read(source, dest + got, size - got);
+      if (count <= 0)
+        Corrupt();
+      got += count;
+    }
+  }
+
+  // Decompresses the next block into |block_|. Returns false at the end of
+  // the stream.
+  template <typename Source>
+  bool ReadBlock(Source& source) {
+    if (!read_magic_) {
+      char magic[sizeof(kLzMagic)];
+      ReadExactly(source, magic, sizeof(magic));
+      if (memcmp(magic, kLzMagic, sizeof(magic)) != 0)
+        Corrupt();
+      read_magic_ = true;
+    }
+
+    char header[kLzBlockHeaderSize];
+    ReadExactly(source, header, sizeof(header));
+    uint32_t size = ReadUint32(header);
+    uint32_t stored = ReadUint32(header + 4);
+    if (size == 0) {
+      finished_ = true;
+      return false;
+    }
+    if (size > kMaxLzBlockSize || stored > size)
+      Corrupt();
+
+    block_.resize(size);
+    position_ = 0;
+    if (stored == size) {
+      ReadExactly(source, &block_[0], size);
+    } else {
+      compressed_.resize(stored);
+      ReadExactly(source, &compressed_[0], stored);
+      if (!LzDecompress(compressed_.data(), stored, &block_[0], size))
+        Corrupt();
+    }
+    return true;
+  }
+
+  static void Corrupt() {
+    throw rlvm::Exception(_("Save file is truncated or corrupt"));
+  }
+
+  std::vector<char> compressed_;
+  std::string block_;
+  size_t position_ = 0;
+  bool read_magic_ = false;
+  bool finished_ = false;
+};
+
+// Several times faster than zlib in both directions, for somewhat larger
+// files.
+class LzSaveCodec : public SaveCodec {
+ public:
+  virtual SaveCompression compression() const override {
+    return Serialization::SAVE_COMPRESSION_LZ;
+  }
+
+  virtual bool Matches(const unsigned char* start,
+                       size_t size) const override {
+    return size >= sizeof(kLzMagic) &&
+           memcmp(start, kLzMagic, sizeof(kLzMagic)) == 0;
+  }
+
+  virtual void PushCompressor(OutputStream& stream) const override {
+    stream.push(LzCompressor());
+  }
+
+  virtual void PushDecompressor(InputStream& stream) const override {
+    stream.push(LzDecompressor());
+  }
+};
+
+const ZlibSaveCodec zlib_codec;
+const LzSaveCodec lz_codec;
+
+const SaveCodec* const all_codecs[] = {&lz_codec, &zlib_codec};
+
+}  // namespace
+
+SaveCodec::~SaveCodec() {}
+
+// static
+const SaveCodec& SaveCodec::For(SaveCompression compression) {
+  for (const SaveCodec* codec : all_codecs) {
+    if (codec->compression() == compression)
+      return *codec;
+  }
+  return zlib_codec;
+}
+
+// static
+const SaveCodec& SaveCodec::Detect(std::istream& iss) {
+  unsigned char start[kMaxMagicSize];
+  std::streampos position = iss.tellg();
+  iss.read(reinterpret_cast<char*>(start), sizeof(start));
+  size_t size = iss.gcount();
+  iss.clear();
+  iss.seekg(position);
+
+  for (const SaveCodec* codec : all_codecs) {
+    if (codec->Matches(start, size))
+      return *codec;
+  }
+
+  throw rlvm::Exception(_("Save file is not in a format rlvm can read"));
+}
@@ -0,0 +1,73 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+#ifndef SRC_MACHINE_SAVE_CODEC_H_
+#define SRC_MACHINE_SAVE_CODEC_H_
+
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <cstddef>
+#include <istream>
+
+#include "machine/serialization.h"
+
+// The compression around a save game or global memory archive. Save files
+// are written with whichever codec is asked for and read with whichever one
+// their first bytes name, so codecs can be switched without breaking old
+// saves.
+//
+// Save files keep their .sav.gz names whatever the codec, since slots are
+// found by name; the names were never accurate, as even the zlib codec
+// writes a raw zlib stream rather than a gzip file.
+class SaveCodec {
+ public:
+  typedef boost::iostreams::filtering_stream<boost::iostreams::output>
+      OutputStream;
+  typedef boost::iostreams::filtering_stream<boost::iostreams::input>
+      InputStream;
+
+  virtual ~SaveCodec();
+
+  static const SaveCodec& For(Serialization::SaveCompression compression);
+
+  // The codec that wrote the stream |iss| is positioned at, judged by its
+  // first bytes, which are left unread. Throws rlvm::Exception if no codec
+  // recognizes them.
+  static const SaveCodec& Detect(std::istream& iss);
+
+  virtual Serialization::SaveCompression compression() const = 0;
+
+  // Whether a stream starting with the |size| bytes at |start| was written
+  // by this codec.
+  virtual bool Matches(const unsigned char* start, size_t size) const = 0;
+
+  // Pushes the filter that compresses (or decompresses) onto |stream|, ahead
+  // of the device that the caller pushes next.
+  virtual void PushCompressor(OutputStream& stream) const = 0;
+  virtual void PushDecompressor(InputStream& stream) const = 0;
+};
+
+#endif  // SRC_MACHINE_SAVE_CODEC_H_
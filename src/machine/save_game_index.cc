@@ -0,0 +1,258 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#include "machine/save_game_index.h"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/date_time/posix_time/time_serialize.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/serialization/map.hpp>
+
+#include <cctype>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "machine/serialization.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+// Bumped whenever Entry changes; an index of another version is rebuilt.
+const int kIndexVersion = 1;
+
+const char kIndexFilename[] = "save_index.dat";
+
+// Returns the slot number of a file named like FilenameForSlot(), or -1.
+int SlotForFilename(const std::string& filename) {
+  if (filename.size() != 14 || !boost::starts_with(filename, "save") ||
+      !boost::ends_with(filename, ".sav.gz")) {
+    return -1;
+  }
+
+  for (int i = 4; i < 7; ++i) {
+    if (!std::isdigit(static_cast<unsigned char>(filename[i])))
+      return -1;
+  }
+
+  return std::stoi(filename.substr(4, 3));
+}
+
+}  // namespace
+
+SaveGameIndex::SaveGameIndex(const fs::path& save_directory)
+    : save_directory_(save_directory),
+      path_(save_directory / kIndexFilename) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!Load())
+    Rebuild();
+}
+
+SaveGameIndex::~SaveGameIndex() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (dirty_)
+    StoreLocked();
+}
+
+// static
+std::string SaveGameIndex::FilenameForSlot(int slot) {
+  std::ostringstream oss;
+  oss << "save" << std::setw(3) << std::setfill('0') << slot << ".sav.gz";
+  return oss.str();
+}
+
+uint64_t SaveGameIndex::Record(int slot, const SaveGameHeader& header) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry& entry = entries_[slot];
+  entry.header = header;
+  entry.pending_token = next_token_++;
+  return entry.pending_token;
+}
+
+void SaveGameIndex::Written(int slot, uint64_t token, bool succeeded) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(slot);
+  if (it == entries_.end() || it->second.pending_token != token)
+    return;
+
+  boost::system::error_code size_error, mtime_error;
+  fs::path file = save_directory_ / FilenameForSlot(slot);
+  uint64_t size = fs::file_size(file, size_error);
+  int64_t mtime = fs::last_write_time(file, mtime_error);
+  if (!succeeded || size_error || mtime_error) {
+    // Whatever is on disk now gets read back by the next Lookup().
+    entries_.erase(it);
+    return;
+  }
+
+  it->second.mtime = mtime;
+  it->second.size = size;
+  it->second.pending_token = 0;
+  StoreLocked();
+}
+
+bool SaveGameIndex::Lookup(int slot, SaveGameHeader* header) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(slot);
+  if (it != entries_.end() && it->second.pending_token) {
+    *header = it->second.header;
+    return true;
+  }
+
+  boost::system::error_code size_error, mtime_error;
+  fs::path file = save_directory_ / FilenameForSlot(slot);
+  uint64_t size = fs::file_size(file, size_error);
+  int64_t mtime = fs::last_write_time(file, mtime_error);
+  if (size_error || mtime_error) {
+    if (it != entries_.end()) {
+      entries_.erase(it);
+      dirty_ = true;
+    }
+    return false;
+  }
+
+  if (it != entries_.end() && it->second.mtime == mtime &&
+      it->second.size == size) {
+    *header = it->second.header;
+    return true;
+  }
+
+  Entry entry;
+  if (!ReadFromSaveFile(slot, &entry)) {
+    if (it != entries_.end()) {
+      entries_.erase(it);
+      dirty_ = true;
+    }
+    return false;
+  }
+
+  entries_[slot] = entry;
+  dirty_ = true;
+  *header = entry.header;
+  return true;
+}
+
+bool SaveGameIndex::Load() {
+  fs::ifstream file(path_, std::ios::binary);
+  if (!file)
+    return false;
+
+  try {
+    boost::archive::binary_iarchive ia(file);
+    int version;
+    ia >> version;
+    if (version != kIndexVersion)
+      return false;
+
+    ia >> entries_;
+  }
+  catch (std::exception& e) {
+    std::cerr << "WARNING: Rebuilding unreadable save index " << path_ << ": "
+              << e.what() << std::endl;
+    entries_.clear();
+    return false;
+  }
+
+  return true;
+}
+
+void SaveGameIndex::Rebuild() {
+  entries_.clear();
+
+  boost::system::error_code ec;
+  for (fs::directory_iterator it(save_directory_, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    int slot = SlotForFilename(it->path().filename().string());
+    if (slot == -1)
+      continue;
+
+    Entry entry;
+    if (ReadFromSaveFile(slot, &entry))
+      entries_[slot] = entry;
+  }
+
+  StoreLocked();
+}
+
+void SaveGameIndex::StoreLocked() {
+  std::map<int, Entry> finished;
+  for (const auto& slot_and_entry : entries_) {
+    if (!slot_and_entry.second.pending_token)
+      finished.insert(slot_and_entry);
+  }
+
+  fs::path temp_path = path_;
+  temp_path += ".tmp";
+
+  try {
+    {
+      fs::ofstream file(temp_path, std::ios::binary);
+      if (!file)
+        throw std::runtime_error("could not open " + temp_path.string());
+
+      boost::archive::binary_oarchive oa(file);
+      oa << kIndexVersion << const_cast<const std::map<int, Entry>&>(finished);
+    }
+    fs::rename(temp_path, path_);
+    dirty_ = false;
+  }
+  catch (std::exception& e) {
+    std::cerr << "WARNING: Could not write save index " << path_ << ": "
+              << e.what() << std::endl;
+  }
+}
+
+bool SaveGameIndex::ReadFromSaveFile(int slot, Entry* entry) {
+  fs::path file = save_directory_ / FilenameForSlot(slot);
+
+  boost::system::error_code size_error, mtime_error;
+  entry->size = fs::file_size(file, size_error);
+  entry->mtime = fs::last_write_time(file, mtime_error);
+  if (size_error || mtime_error)
+    return false;
+
+  fs::ifstream stream(file, std::ios::binary);
+  if (!stream)
+    return false;
+
+  try {
+    entry->header = Serialization::loadHeaderFrom(stream);
+  }
+  catch (std::exception& e) {
+    std::cerr << "WARNING: Could not read the header of " << file << ": "
+              << e.what() << std::endl;
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,124 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#ifndef SRC_MACHINE_SAVE_GAME_INDEX_H_
+#define SRC_MACHINE_SAVE_GAME_INDEX_H_
+
+#include <boost/filesystem/path.hpp>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "machine/save_game_header.h"
+
+// A sidecar file in the save directory holding the SaveGameHeader of every
+// slot, so that the save/load menu and SaveDate() and friends read one small
+// file instead of decompressing and parsing the start of every save game.
+//
+// Each entry remembers the modification time and size its save file had when
+// the entry was made. Lookup() checks them against the file and rereads the
+// header from a save that doesn't match, so saves copied in, deleted or
+// written by another rlvm are still reported correctly. A missing or
+// unreadable index is rebuilt from the save files.
+class SaveGameIndex {
+ public:
+  explicit SaveGameIndex(const boost::filesystem::path& save_directory);
+
+  // Writes out any entries Lookup() corrected.
+  ~SaveGameIndex();
+
+  // The name of the save game file for |slot|, relative to the save
+  // directory.
+  static std::string FilenameForSlot(int slot);
+
+  // Stores |header| for a save to |slot| that has been snapshotted but not
+  // written, and returns a token to pass to Written() when it has been.
+  // Lookup() returns |header| in the meantime.
+  uint64_t Record(int slot, const SaveGameHeader& header);
+
+  // Called when the write that Record() returned |token| for has finished.
+  // On success, stamps the entry with the new file's modification time and
+  // writes out the index; on failure, forgets the entry so the old file is
+  // read again. Does nothing if a later save to |slot| was recorded since.
+  // Safe to call from the SaveWriter thread.
+  void Written(int slot, uint64_t token, bool succeeded);
+
+  // Fills |header| and returns true if |slot| holds a save game.
+  bool Lookup(int slot, SaveGameHeader* header);
+
+  // The path of the index file.
+  const boost::filesystem::path& path() const { return path_; }
+
+ private:
+  struct Entry {
+    SaveGameHeader header;
+
+    // The save file's modification time and size when |header| was read or
+    // written.
+    int64_t mtime = 0;
+    uint64_t size = 0;
+
+    // Non-zero while the save is still being written.
+    uint64_t pending_token = 0;
+
+    template <class Archive>
+    void serialize(Archive& ar, unsigned int version) {
+      ar& header& mtime& size;
+    }
+  };
+
+  // Reads the index file. Returns false if it's missing or unreadable.
+  bool Load();
+
+  // Rebuilds every entry from the save files in the directory.
+  void Rebuild();
+
+  // Writes the finished entries to a temporary file and renames it over the
+  // index. Must hold |mutex_|. Errors are reported on stderr; the next
+  // Rebuild() or Lookup() recovers from a stale index.
+  void StoreLocked();
+
+  // Rereads |slot|'s header from its save file into |entry|. Returns false if
+  // the file is missing or unreadable.
+  bool ReadFromSaveFile(int slot, Entry* entry);
+
+  boost::filesystem::path save_directory_;
+  boost::filesystem::path path_;
+
+  std::mutex mutex_;
+
+  std::map<int, Entry> entries_;
+
+  // Whether |entries_| has changed since the index file was written.
+  bool dirty_ = false;
+
+  uint64_t next_token_ = 1;
+};
+
+#endif  // SRC_MACHINE_SAVE_GAME_INDEX_H_
@@ -0,0 +1,268 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#include "machine/save_writer.h"
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "machine/save_codec.h"
+#include "utilities/exception.h"
+#include "utilities/gettext.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+// Flushes the file or directory at |path| to disk. Renaming is only atomic
+// with respect to what's on disk once the new contents, and then the rename
+// itself, have reached it; otherwise a power failure can leave an empty or
+// truncated save under the real name.
+bool SyncToDisk(const fs::path& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  bool synced = fsync(fd) == 0;
+  close(fd);
+  return synced;
+}
+
+}  // namespace
+
+SaveWriter::SaveWriter() {}
+
+SaveWriter::~SaveWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  job_queued_.notify_all();
+
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void SaveWriter::Write(const fs::path& path,
+                       std::string archive,
+                       FinishedCallback on_finished) {
+  Write(path, std::move(archive), compression(), std::move(on_finished));
+}
+
+void SaveWriter::Write(const fs::path& path,
+                       std::string archive,
+                       Serialization::SaveCompression compression,
+                       FinishedCallback on_finished) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool replaced = false;
+    for (Job& job : queue_) {
+      if (job.path == path && !job.append) {
+        job.archive = std::move(archive);
+        job.on_finished = std::move(on_finished);
+        job.compression = compression;
+        replaced = true;
+        break;
+      }
+    }
+
+    if (!replaced) {
+      QueueLocked(Job{path, std::move(archive), std::move(on_finished), false,
+                      compression});
+    }
+  }
+  job_queued_.notify_one();
+}
+
+void SaveWriter::Append(const fs::path& path,
+                        std::string bytes,
+                        FinishedCallback on_finished) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    QueueLocked(Job{path, std::move(bytes), std::move(on_finished), true,
+                    compression_});
+  }
+  job_queued_.notify_one();
+}
+
+Serialization::SaveCompression SaveWriter::compression() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return compression_;
+}
+
+void SaveWriter::set_compression(Serialization::SaveCompression compression) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  compression_ = compression;
+}
+
+Serialization::SaveFormat SaveWriter::archive_format() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return archive_format_;
+}
+
+void SaveWriter::set_archive_format(Serialization::SaveFormat format) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  archive_format_ = format;
+}
+
+bool SaveWriter::IsPending(const fs::path& path) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_.count(path.string()) != 0;
+}
+
+void SaveWriter::WaitFor(const fs::path& path) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const std::string key = path.string();
+  job_finished_.wait(lock, [&]() { return pending_.count(key) == 0; });
+}
+
+void SaveWriter::WaitForAll() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_finished_.wait(lock, [&]() { return pending_.empty(); });
+}
+
+int SaveWriter::failed_writes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return failed_writes_;
+}
+
+std::vector<std::string> SaveWriter::TakeFailures() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::string> failures;
+  failures.swap(failures_);
+  return failures;
+}
+
+void SaveWriter::QueueLocked(Job job) {
+  pending_[job.path.string()]++;
+  queue_.push_back(std::move(job));
+
+  if (!thread_.joinable())
+    thread_ = std::thread(&SaveWriter::WriterLoop, this);
+}
+
+void SaveWriter::WriterLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    job_queued_.wait(lock, [&]() { return stopping_ || !queue_.empty(); });
+    if (queue_.empty())
+      return;
+
+    Job job = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+
+    bool failed = false;
+    std::string failure;
+    try {
+      if (job.append)
+        AppendFile(job.path, job.archive);
+      else
+        WriteFile(job.path, job.archive, job.compression);
+    }
+    catch (std::exception& e) {
+      std::cerr << "--- WARNING: ERROR DURING SAVING FILE: " << e.what()
+                << " ---" << std::endl;
+      failed = true;
+      failure = e.what();
+    }
+
+    // Called before the write stops being pending, so that anything the
+    // callback records is in place by the time WaitFor() returns.
+    if (job.on_finished)
+      job.on_finished(!failed);
+
+    lock.lock();
+    if (failed) {
+      failed_writes_++;
+      failures_.push_back(std::move(failure));
+    }
+    auto it = pending_.find(job.path.string());
+    if (--it->second == 0)
+      pending_.erase(it);
+    job_finished_.notify_all();
+  }
+}
+
+// static
+void SaveWriter::WriteFile(const fs::path& path,
+                           const std::string& archive,
+                           Serialization::SaveCompression compression) {
+  fs::path temp_path = path;
+  temp_path += ".tmp";
+
+  {
+    fs::ofstream file(temp_path, std::ios::binary);
+    if (!file) {
+      throw rlvm::Exception(
+          str(format(_("Could not open save game file %1%")) % temp_path));
+    }
+
+    SaveCodec::OutputStream filtered_output;
+    SaveCodec::For(compression).PushCompressor(filtered_output);
+    filtered_output.push(file);
+    filtered_output.write(archive.data(), archive.size());
+    filtered_output.reset();
+
+    file.close();
+    if (!file || !SyncToDisk(temp_path)) {
+      boost::system::error_code ec;
+      fs::remove(temp_path, ec);
+      throw rlvm::Exception(
+          str(format(_("Could not write save game file %1%")) % temp_path));
+    }
+  }
+
+  fs::rename(temp_path, path);
+
+  // Not every file system can sync a directory; the save is complete either
+  // way, so this is best effort.
+  SyncToDisk(path.has_parent_path() ? path.parent_path() : fs::path("."));
+}
+
+// static
+void SaveWriter::AppendFile(const fs::path& path, const std::string& bytes) {
+  fs::ofstream file(path, std::ios::binary | std::ios::app);
+  if (!file) {
+    throw rlvm::Exception(
+        str(format(_("Could not open save game file %1%")) % path));
+  }
+
+  file.write(bytes.data(), bytes.size());
+  file.close();
+  if (!file) {
+    throw rlvm::Exception(
+        str(format(_("Could not write save game file %1%")) % path));
+  }
+}
@@ -0,0 +1,175 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#ifndef SRC_MACHINE_SAVE_WRITER_H_
+#define SRC_MACHINE_SAVE_WRITER_H_
+
+#include <boost/filesystem/path.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "machine/serialization.h"
+
+// Compresses and writes save files on a background thread, so that saving
+// doesn't stall the frame it happens in.
+//
+// The caller serializes whatever it's saving to an uncompressed archive on the
+// VM thread; that string is the snapshot, and nothing here touches the live
+// machine. Each file is written to a temporary file next to it, synced to
+// disk and then renamed over it, so a reader (or a crash) sees either the old
+// save or the complete new one, never a partial file.
+class SaveWriter {
+ public:
+  SaveWriter();
+
+  // Finishes every queued write before returning.
+  ~SaveWriter();
+
+  // Called on the writer thread once a write has finished, with whether the
+  // file was replaced.
+  typedef std::function<void(bool succeeded)> FinishedCallback;
+
+  // Queues |archive| to be compressed and written to |path|, then calls
+  // |on_finished| if given. If a write to |path| is still queued and hasn't
+  // started, it's replaced by this one, callback included.
+  void Write(const boost::filesystem::path& path,
+             std::string archive,
+             FinishedCallback on_finished = FinishedCallback());
+
+  // As above, but compressed with |compression| instead of compression().
+  void Write(const boost::filesystem::path& path,
+             std::string archive,
+             Serialization::SaveCompression compression,
+             FinishedCallback on_finished = FinishedCallback());
+
+  // Queues |bytes| to be appended to |path| as they are, creating it if
+  // needed, then calls |on_finished| if given. Appends are never coalesced and
+  // run in order with the writes, so a write queued after an append sees the
+  // file it appended to.
+  void Append(const boost::filesystem::path& path,
+              std::string bytes,
+              FinishedCallback on_finished = FinishedCallback());
+
+  // The codec Write() compresses with unless told otherwise. Defaults to
+  // Serialization::SAVE_COMPRESSION_ZLIB, for the smaller files.
+  Serialization::SaveCompression compression() const;
+  void set_compression(Serialization::SaveCompression compression);
+
+  // The archive format saveGameForSlot() and saveGlobalMemory() snapshot
+  // with, kept beside compression() so both save settings are in one place.
+  // Write() itself takes archives that are already serialized. Defaults to
+  // Serialization::SAVE_FORMAT_BINARY.
+  Serialization::SaveFormat archive_format() const;
+  void set_archive_format(Serialization::SaveFormat format);
+
+  // Whether a write to |path| is queued or in progress. Code asking whether a
+  // save exists should treat a pending write as a save that exists.
+  bool IsPending(const boost::filesystem::path& path) const;
+
+  // Blocks until no write to |path| is queued or in progress. Must be called
+  // before reading |path|.
+  void WaitFor(const boost::filesystem::path& path);
+
+  // Blocks until every queued write has finished.
+  void WaitForAll();
+
+  // The number of writes that failed. The reason is reported on stderr, since
+  // there's nobody to throw to on the writer thread.
+  int failed_writes() const;
+
+  // Returns why each write that failed since the last call failed, so that
+  // the VM thread can tell the player their save wasn't written.
+  std::vector<std::string> TakeFailures();
+
+ private:
+  struct Job {
+    boost::filesystem::path path;
+    std::string archive;
+    FinishedCallback on_finished;
+
+    // Whether |archive| is appended to |path| uncompressed rather than
+    // replacing it.
+    bool append;
+
+    Serialization::SaveCompression compression;
+  };
+
+  // Queues |job| and starts |thread_| if needed. Must hold |mutex_|.
+  void QueueLocked(Job job);
+
+  // Body of |thread_|: takes jobs off |queue_| until it is empty and
+  // |stopping_| is set.
+  void WriterLoop();
+
+  // Compresses |archive| to a temporary file beside |path|, syncs it and
+  // renames it into place. Throws on failure.
+  static void WriteFile(const boost::filesystem::path& path,
+                        const std::string& archive,
+                        Serialization::SaveCompression compression);
+
+  // Appends |bytes| to |path|. Throws on failure.
+  static void AppendFile(const boost::filesystem::path& path,
+                         const std::string& bytes);
+
+  mutable std::mutex mutex_;
+
+  // Signalled when a job is queued or |stopping_| is set.
+  std::condition_variable job_queued_;
+
+  // Signalled whenever a job finishes.
+  std::condition_variable job_finished_;
+
+  // Jobs that haven't been started.
+  std::deque<Job> queue_;
+
+  // The number of queued or in progress writes to each path.
+  std::map<std::string, int> pending_;
+
+  int failed_writes_ = 0;
+
+  // Reasons for failed writes not yet returned by TakeFailures().
+  std::vector<std::string> failures_;
+
+  Serialization::SaveCompression compression_ =
+      Serialization::SAVE_COMPRESSION_ZLIB;
+  Serialization::SaveFormat archive_format_ =
+      Serialization::SAVE_FORMAT_BINARY;
+
+  bool stopping_ = false;
+
+  // Started by the first Write() or Append().
+  std::thread thread_;
+};
+
+#endif  // SRC_MACHINE_SAVE_WRITER_H_
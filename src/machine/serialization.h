@@ -30,6 +30,8 @@
 
 #include <boost/filesystem/path.hpp>
 
+#include <iosfwd>
+
 #include "machine/save_game_header.h"
 
 class RLMachine;
@@ -46,17 +48,96 @@ namespace Serialization {
 //          here; this is a likely location for errors
 extern RLMachine* g_current_machine;
 
+// The boost archive a save file is written with. Both formats load. Binary
+// archives are smaller and faster, but only builds of rlvm that know them can
+// read them, and they depend on the machine's word size and the version of
+// boost. Text is what every save written before binary archives were added
+// uses, and what older builds of rlvm read. saveGameForSlot() and
+// saveGlobalMemory() use SaveWriter::format().
+enum SaveFormat {
+  SAVE_FORMAT_TEXT,
+  SAVE_FORMAT_BINARY
+};
+
+// The compression around the archive. zlib makes smaller files, so it is the
+// default for saves kept a long time. LZ is several times faster to write and
+// to read, for files about twice the size; quickSaveGameForSlot() uses it.
+// Loading tells them apart by their first bytes. See SaveCodec. Older builds
+// of rlvm only load zlib around a text archive (SAVE_FORMAT_TEXT); the
+// default binary archive is only read by this version.
+enum SaveCompression {
+  SAVE_COMPRESSION_ZLIB,
+  SAVE_COMPRESSION_LZ
+};
+
+// Binary archives are preceded by a short magic and version in the
+// decompressed stream. Text archives always start with a digit, so old saves
+// are told apart by their first byte.
+void writeSaveFormat(std::ostream& oss, SaveFormat format);
+
+// Reads what writeSaveFormat() wrote, leaving |iss| at the start of the
+// archive. Throws if the stream holds a binary archive from a newer rlvm.
+SaveFormat readSaveFormat(std::istream& iss);
+
+// Snapshots global memory on the calling thread and hands it to the
+// machine's SaveWriter, which compresses and writes it in the background. The
+// global memory journal is removed once it has been written.
 void saveGlobalMemory(RLMachine& machine);
-void saveGlobalMemoryTo(std::ostream& oss, RLMachine& machine);
 
+// Appends what changed in global memory since it was last loaded, saved or
+// journaled to the global memory journal, also in the background. Cheap
+// enough to call often. Falls back to saveGlobalMemory() when the journal
+// has grown large, a record failed to append, or global memory wasn't loaded
+// with loadGlobalMemory().
+void journalGlobalMemory(RLMachine& machine);
+
+void saveGlobalMemoryTo(std::ostream& oss,
+                        RLMachine& machine,
+                        SaveFormat format = SAVE_FORMAT_BINARY,
+                        SaveCompression compression = SAVE_COMPRESSION_ZLIB);
+
+// Writes the uncompressed archive saveGlobalMemoryTo() compresses.
+void snapshotGlobalMemoryTo(std::ostream& oss,
+                            RLMachine& machine,
+                            SaveFormat format);
+
+// Loads global.sav.gz and then replays the journal over it.
 void loadGlobalMemory(RLMachine& machine);
 void loadGlobalMemoryFrom(std::istream& iss, RLMachine& machine);
 
+boost::filesystem::path buildGlobalMemoryFilename(RLMachine& machine);
+boost::filesystem::path buildGlobalMemoryJournalFilename(RLMachine& machine);
+
 boost::filesystem::path buildSaveGameFilename(RLMachine& machine, int slot);
 
+// Like saveGlobalMemory(), the slot is written in the background; the
+// loadXXXForSlot() functions below wait for a pending write to their slot.
 void saveGameForSlot(RLMachine& machine, int slot);
-void saveGameTo(std::ostream& oss, RLMachine& machine);
 
+// Saves to |slot| like saveGameForSlot(), but always with SAVE_COMPRESSION_LZ,
+// for saves made often enough that their cost shows. Older builds of rlvm
+// can't load these.
+void quickSaveGameForSlot(RLMachine& machine, int slot);
+
+void saveGameTo(std::ostream& oss,
+                RLMachine& machine,
+                SaveFormat format = SAVE_FORMAT_BINARY,
+                SaveCompression compression = SAVE_COMPRESSION_ZLIB);
+
+// Writes the uncompressed archive saveGameTo() compresses, and returns the
+// header written at its start.
+SaveGameHeader snapshotGameTo(std::ostream& oss,
+                              RLMachine& machine,
+                              SaveFormat format);
+
+// Whether |slot| holds a save, counting one that's still being written.
+bool saveExistsForSlot(RLMachine& machine, int slot);
+
+// Fills |header| from the machine's SaveGameIndex and returns true if |slot|
+// holds a save. Doesn't wait for a pending write to the slot.
+bool lookupHeaderForSlot(RLMachine& machine, int slot, SaveGameHeader* header);
+
+// The same, but throws if |slot| is empty.
 SaveGameHeader loadHeaderForSlot(RLMachine& machine, int slot);
 SaveGameHeader loadHeaderFrom(std::istream& iss);
 
@@ -27,7 +27,8 @@
 
 #include "machine/serialization.h"
 
-// include headers that implement a archive in simple text format
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/serialization/split_free.hpp>
@@ -38,14 +39,16 @@
 #include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/zlib.hpp>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
 #include "libreallive/intmemref.h"
+#include "machine/global_memory_journal.h"
 #include "machine/memory.h"
 #include "machine/rlmachine.h"
+#include "machine/save_codec.h"
+#include "machine/save_writer.h"
 #include "systems/base/event_system.h"
 #include "systems/base/graphics_system.h"
 #include "systems/base/sound_system.h"
@@ -66,39 +69,218 @@ namespace Serialization {
 //   games themselves don't use that feature.
 const int CURRENT_GLOBAL_VERSION = 3;
 
+namespace {
+
+// journalGlobalMemory() rewrites global.sav.gz instead once the journal is
+// longer than this.
+const uint64_t kCompactJournalAfterBytes = 128 * 1024;
+
+template <typename OArchive>
+void saveGlobalMemoryArchive(std::ostream& oss, RLMachine& machine) {
+  OArchive oa(oss);
+  System& sys = machine.system();
+
+  oa << CURRENT_GLOBAL_VERSION
+     << const_cast<const GlobalMemory&>(machine.memory().global())
+     << const_cast<const SystemGlobals&>(sys.globals())
+     << const_cast<const GraphicsSystemGlobals&>(sys.graphics().globals())
+     << const_cast<const EventSystemGlobals&>(sys.event().globals())
+     << const_cast<const TextSystemGlobals&>(sys.text().globals())
+     << const_cast<const SoundSystemGlobals&>(sys.sound().globals());
+}
+
+template <typename IArchive>
+void loadGlobalMemoryArchive(std::istream& iss, RLMachine& machine) {
+  IArchive ia(iss);
+  System& sys = machine.system();
+  int version;
+  ia >> version;
+
+  // Load global memory.
+  ia >> machine.memory().global();
+
+  // When Karmic Koala came out, support for all boost earlier than 1.36 was
+  // dropped. For years, I had used boost 1.35 on Ubuntu. It turns out that
+  // boost 1.35 had a serious bug in it, where it wouldn't save vectors of
+  // primitive data types correctly. These global data files no longer load
+  // correctly.
+  //
+  // After flirting with moving to Google protobuf (can't; doesn't handle
+  // complex object graphs like GraphicsObject and its copy-on-write stuff),
+  // and then trying to fix the problem in a forked copy of the serialization
+  // headers which was unsuccessful, I'm just saying to hell with the user's
+  // settings. Most people don't change these values and save games and global
+  // memory still work (per above.)
+  if (version == CURRENT_GLOBAL_VERSION) {
+    ia >> sys.globals() >> sys.graphics().globals() >> sys.event().globals() >>
+        sys.text().globals() >> sys.sound().globals();
+
+    // Restore options which may have System specific implementations. (This
+    // will probably expand as more of RealLive is implemented).
+    sys.sound().RestoreFromGlobals();
+  }
+}
+
+// The system globals saved after GlobalMemory, as the journal stores them.
+std::string snapshotSystemGlobals(RLMachine& machine) {
+  std::ostringstream oss;
+  {
+    boost::archive::binary_oarchive oa(oss, boost::archive::no_header);
+    System& sys = machine.system();
+    oa << const_cast<const SystemGlobals&>(sys.globals())
+       << const_cast<const GraphicsSystemGlobals&>(sys.graphics().globals())
+       << const_cast<const EventSystemGlobals&>(sys.event().globals())
+       << const_cast<const TextSystemGlobals&>(sys.text().globals())
+       << const_cast<const SoundSystemGlobals&>(sys.sound().globals());
+  }
+  return oss.str();
+}
+
+void restoreSystemGlobals(RLMachine& machine, const std::string& snapshot) {
+  std::istringstream iss(snapshot);
+  boost::archive::binary_iarchive ia(iss, boost::archive::no_header);
+  System& sys = machine.system();
+  ia >> sys.globals() >> sys.graphics().globals() >> sys.event().globals() >>
+      sys.text().globals() >> sys.sound().globals();
+  sys.sound().RestoreFromGlobals();
+}
+
+void appendToGlobalMemoryJournal(RLMachine& machine,
+                                 const std::string& record) {
+  if (record.empty())
+    return;
+
+  GlobalMemoryJournal& journal = machine.global_memory_journal();
+  machine.save_writer().Append(buildGlobalMemoryJournalFilename(machine),
+                               record,
+                               [&journal](bool succeeded) {
+                                 if (!succeeded)
+                                   journal.set_append_failed();
+                               });
+}
+
+// Replays the journal over the global memory loadGlobalMemory() just read,
+// cutting off a torn tail, and makes the result the journal's baseline.
+void replayGlobalMemoryJournal(RLMachine& machine) {
+  GlobalMemoryJournal& journal = machine.global_memory_journal();
+  GlobalMemory& global = machine.memory().global();
+  fs::path path = buildGlobalMemoryJournalFilename(machine);
+  std::string system_globals = snapshotSystemGlobals(machine);
+
+  uint64_t intact = 0;
+  bool truncate_failed = false;
+  fs::ifstream file(path, std::ios::binary);
+  if (file) {
+    std::string replayed = system_globals;
+    intact = journal.Replay(file, &global, &replayed);
+    file.close();
+
+    if (replayed != system_globals) {
+      try {
+        restoreSystemGlobals(machine, replayed);
+        system_globals = replayed;
+      }
+      catch (std::exception& e) {
+        std::cerr << "WARNING: Unable to restore journaled settings: "
+                  << e.what() << std::endl;
+      }
+    }
+
+    boost::system::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    if (!ec && size > intact) {
+      std::cerr << "WARNING: Discarding " << (size - intact)
+                << " bytes of damaged global memory journal " << path
+                << std::endl;
+      fs::resize_file(path, intact, ec);
+      truncate_failed = static_cast<bool>(ec);
+    }
+  }
+
+  journal.SetBaseline(global, system_globals, intact);
+
+  // Records appended after the damage would never be replayed.
+  if (truncate_failed)
+    journal.set_append_failed();
+}
+
+}  // namespace
+
 fs::path buildGlobalMemoryFilename(RLMachine& machine) {
   return machine.system().GameSaveDirectory() / "global.sav.gz";
 }
 
+fs::path buildGlobalMemoryJournalFilename(RLMachine& machine) {
+  return machine.system().GameSaveDirectory() / "global.journal";
+}
+
 void saveGlobalMemory(RLMachine& machine) {
-  fs::path home = buildGlobalMemoryFilename(machine);
-  fs::ofstream file(home, std::ios::binary);
-  if (!file) {
-    throw rlvm::Exception(_("Could not open global memory file."));
+  GlobalMemoryJournal& journal = machine.global_memory_journal();
+  const GlobalMemory& global = machine.memory().global();
+  std::string system_globals = snapshotSystemGlobals(machine);
+
+  // Until the new global.sav.gz is in place, the old one and the journal are
+  // what a crash leaves, so bring the journal up to date first. Replaying it
+  // over the new file gives the same state, so the journal can be removed
+  // whenever the write finishes.
+  if (journal.has_baseline()) {
+    appendToGlobalMemoryJournal(machine,
+                                journal.Record(global, system_globals));
   }
+  journal.SetBaseline(global, system_globals, 0);
 
-  saveGlobalMemoryTo(file, machine);
+  fs::path journal_path = buildGlobalMemoryJournalFilename(machine);
+  std::ostringstream snapshot;
+  snapshotGlobalMemoryTo(
+      snapshot, machine, machine.save_writer().archive_format());
+  machine.save_writer().Write(buildGlobalMemoryFilename(machine),
+                              snapshot.str(),
+                              [journal_path](bool succeeded) {
+                                if (succeeded) {
+                                  boost::system::error_code ec;
+                                  fs::remove(journal_path, ec);
+                                }
+                              });
 }
 
-void saveGlobalMemoryTo(std::ostream& oss, RLMachine& machine) {
-  boost::iostreams::filtering_stream<boost::iostreams::output> filtered_output;
-  filtered_output.push(boost::iostreams::zlib_compressor());
+void journalGlobalMemory(RLMachine& machine) {
+  GlobalMemoryJournal& journal = machine.global_memory_journal();
+  if (!journal.has_baseline() || journal.append_failed() ||
+      journal.size() > kCompactJournalAfterBytes) {
+    saveGlobalMemory(machine);
+    return;
+  }
+
+  const GlobalMemory& global = machine.memory().global();
+  appendToGlobalMemoryJournal(
+      machine, journal.Record(global, snapshotSystemGlobals(machine)));
+}
+
+void saveGlobalMemoryTo(std::ostream& oss,
+                        RLMachine& machine,
+                        SaveFormat format,
+                        SaveCompression compression) {
+  SaveCodec::OutputStream filtered_output;
+  SaveCodec::For(compression).PushCompressor(filtered_output);
   filtered_output.push(oss);
 
-  boost::archive::text_oarchive oa(filtered_output);
-  System& sys = machine.system();
+  snapshotGlobalMemoryTo(filtered_output, machine, format);
+}
 
-  oa << CURRENT_GLOBAL_VERSION
-     << const_cast<const GlobalMemory&>(machine.memory().global())
-     << const_cast<const SystemGlobals&>(sys.globals())
-     << const_cast<const GraphicsSystemGlobals&>(sys.graphics().globals())
-     << const_cast<const EventSystemGlobals&>(sys.event().globals())
-     << const_cast<const TextSystemGlobals&>(sys.text().globals())
-     << const_cast<const SoundSystemGlobals&>(sys.sound().globals());
+void snapshotGlobalMemoryTo(std::ostream& oss,
+                            RLMachine& machine,
+                            SaveFormat format) {
+  writeSaveFormat(oss, format);
+  if (format == SAVE_FORMAT_BINARY)
+    saveGlobalMemoryArchive<boost::archive::binary_oarchive>(oss, machine);
+  else
+    saveGlobalMemoryArchive<boost::archive::text_oarchive>(oss, machine);
 }
 
 void loadGlobalMemory(RLMachine& machine) {
   fs::path home = buildGlobalMemoryFilename(machine);
+  machine.save_writer().WaitFor(home);
+  machine.save_writer().WaitFor(buildGlobalMemoryJournalFilename(machine));
   fs::ifstream file(home, std::ios::binary);
 
   // If we were able to open the file for reading, load it. Don't
@@ -126,40 +308,21 @@ void loadGlobalMemory(RLMachine& machine) {
                 << save_dir << " to " << dest_save_dir << std::endl;
     }
   }
+
+  replayGlobalMemoryJournal(machine);
 }
 
 void loadGlobalMemoryFrom(std::istream& iss, RLMachine& machine) {
-  boost::iostreams::filtering_stream<boost::iostreams::input> filtered_input;
-  filtered_input.push(boost::iostreams::zlib_decompressor());
+  SaveCodec::InputStream filtered_input;
+  SaveCodec::Detect(iss).PushDecompressor(filtered_input);
   filtered_input.push(iss);
 
-  boost::archive::text_iarchive ia(filtered_input);
-  System& sys = machine.system();
-  int version;
-  ia >> version;
-
-  // Load global memory.
-  ia >> machine.memory().global();
-
-  // When Karmic Koala came out, support for all boost earlier than 1.36 was
-  // dropped. For years, I had used boost 1.35 on Ubuntu. It turns out that
-  // boost 1.35 had a serious bug in it, where it wouldn't save vectors of
-  // primitive data types correctly. These global data files no longer load
-  // correctly.
-  //
-  // After flirting with moving to Google protobuf (can't; doesn't handle
-  // complex object graphs like GraphicsObject and its copy-on-write stuff),
-  // and then trying to fix the problem in a forked copy of the serialization
-  // headers which was unsuccessful, I'm just saying to hell with the user's
-  // settings. Most people don't change these values and save games and global
-  // memory still work (per above.)
-  if (version == CURRENT_GLOBAL_VERSION) {
-    ia >> sys.globals() >> sys.graphics().globals() >> sys.event().globals() >>
-        sys.text().globals() >> sys.sound().globals();
-
-    // Restore options which may have System specific implementations. (This
-    // will probably expand as more of RealLive is implemented).
-    sys.sound().RestoreFromGlobals();
+  if (readSaveFormat(filtered_input) == SAVE_FORMAT_BINARY) {
+    loadGlobalMemoryArchive<boost::archive::binary_iarchive>(filtered_input,
+                                                             machine);
+  } else {
+    loadGlobalMemoryArchive<boost::archive::text_iarchive>(filtered_input,
+                                                           machine);
   }
 }
 
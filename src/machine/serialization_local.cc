@@ -25,7 +25,8 @@
 //
 // -----------------------------------------------------------------------
 
-// include headers that implement a archive in simple text format
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/serialization/split_free.hpp>
@@ -34,8 +35,9 @@
 #include <boost/date_time/posix_time/time_serialize.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/zlib.hpp>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -47,7 +49,10 @@
 #include "libreallive/intmemref.h"
 #include "machine/memory.h"
 #include "machine/rlmachine.h"
+#include "machine/save_codec.h"
 #include "machine/save_game_header.h"
+#include "machine/save_game_index.h"
+#include "machine/save_writer.h"
 #include "machine/serialization.h"
 #include "machine/stack_frame.h"
 #include "systems/base/anm_graphics_object_data.h"
@@ -75,6 +80,62 @@ const int CURRENT_LOCAL_VERSION = 2;
 
 namespace {
 
+const char kBinaryArchiveMagic[] = {'R', 'L', 'V', 'B'};
+
+// Bumped when the binary archive layout changes in a way that
+// CURRENT_LOCAL_VERSION and the per class versions don't describe.
+const char kBinaryArchiveVersion = 1;
+
+template <typename OArchive>
+SaveGameHeader saveGameArchive(std::ostream& oss, RLMachine& machine) {
+  using Serialization::CURRENT_LOCAL_VERSION;
+
+  const SaveGameHeader header(machine.system().graphics().window_subtitle());
+
+  OArchive oa(oss);
+  oa << CURRENT_LOCAL_VERSION << header
+     << const_cast<const LocalMemory&>(machine.memory().local())
+     << const_cast<const RLMachine&>(machine)
+     << const_cast<const System&>(machine.system())
+     << const_cast<const GraphicsSystem&>(machine.system().graphics())
+     << const_cast<const TextSystem&>(machine.system().text())
+     << const_cast<const SoundSystem&>(machine.system().sound());
+
+  return header;
+}
+
+template <typename IArchive>
+SaveGameHeader loadHeaderArchive(std::istream& iss) {
+  int version;
+  SaveGameHeader header;
+
+  // Only load the header
+  IArchive ia(iss);
+  ia >> version >> header;
+
+  return header;
+}
+
+template <typename IArchive>
+void loadLocalMemoryArchive(std::istream& iss, Memory& memory) {
+  int version;
+  SaveGameHeader header;
+
+  IArchive ia(iss);
+  ia >> version >> header >> memory.local();
+}
+
+template <typename IArchive>
+void loadGameArchive(std::istream& iss, RLMachine& machine) {
+  int version;
+  SaveGameHeader header;
+
+  IArchive ia(iss);
+  ia >> version >> header >> machine.memory().local() >> machine >>
+      machine.system() >> machine.system().graphics() >>
+      machine.system().text() >> machine.system().sound();
+}
+
 template <typename TYPE>
 void checkInFileOpened(TYPE& file, const fs::path& home) {
   if (!file) {
@@ -83,36 +144,86 @@ void checkInFileOpened(TYPE& file, const fs::path& home) {
   }
 }
 
+// Snapshots the game and queues it to be written to |slot| with
+// |compression|, keeping the save game index up to date.
+void writeGameForSlot(RLMachine& machine,
+                      int slot,
+                      Serialization::SaveCompression compression) {
+  std::ostringstream snapshot;
+  const SaveGameHeader header = Serialization::snapshotGameTo(
+      snapshot, machine, machine.save_writer().archive_format());
+
+  SaveGameIndex& index = machine.save_game_index();
+  const uint64_t token = index.Record(slot, header);
+  machine.save_writer().Write(
+      Serialization::buildSaveGameFilename(machine, slot),
+      snapshot.str(),
+      compression,
+      [&index, slot, token](bool succeeded) {
+        index.Written(slot, token, succeeded);
+      });
+}
+
 }  // namespace
 
 namespace Serialization {
 
+void writeSaveFormat(std::ostream& oss, SaveFormat format) {
+  if (format == SAVE_FORMAT_BINARY) {
+    oss.write(kBinaryArchiveMagic, sizeof(kBinaryArchiveMagic));
+    oss.put(kBinaryArchiveVersion);
+  }
+}
+
+SaveFormat readSaveFormat(std::istream& iss) {
+  if (iss.peek() != kBinaryArchiveMagic[0])
+    return SAVE_FORMAT_TEXT;
+
+  char magic[sizeof(kBinaryArchiveMagic)];
+  iss.read(magic, sizeof(magic));
+  char version = 0;
+  iss.get(version);
+  if (!iss || !std::equal(magic, magic + sizeof(magic), kBinaryArchiveMagic))
+    throw rlvm::Exception(_("Save file is corrupted."));
+  if (version > kBinaryArchiveVersion) {
+    throw rlvm::Exception(
+        _("Save file was written by a newer version of rlvm."));
+  }
+
+  return SAVE_FORMAT_BINARY;
+}
+
 void saveGameForSlot(RLMachine& machine, int slot) {
-  fs::path path = buildSaveGameFilename(machine, slot);
-  fs::ofstream file(path, std::ios::binary);
-  checkInFileOpened(file, path);
+  writeGameForSlot(machine, slot, machine.save_writer().compression());
+}
 
-  saveGameTo(file, machine);
+void quickSaveGameForSlot(RLMachine& machine, int slot) {
+  writeGameForSlot(machine, slot, SAVE_COMPRESSION_LZ);
 }
 
-void saveGameTo(std::ostream& oss, RLMachine& machine) {
-  boost::iostreams::filtering_stream<boost::iostreams::output> filtered_output;
-  filtered_output.push(boost::iostreams::zlib_compressor());
+void saveGameTo(std::ostream& oss,
+                RLMachine& machine,
+                SaveFormat format,
+                SaveCompression compression) {
+  SaveCodec::OutputStream filtered_output;
+  SaveCodec::For(compression).PushCompressor(filtered_output);
   filtered_output.push(oss);
 
-  const SaveGameHeader header(machine.system().graphics().window_subtitle());
+  snapshotGameTo(filtered_output, machine, format);
+}
 
+SaveGameHeader snapshotGameTo(std::ostream& oss,
+                              RLMachine& machine,
+                              SaveFormat format) {
   g_current_machine = &machine;
 
+  SaveGameHeader header;
   try {
-    boost::archive::text_oarchive oa(filtered_output);
-    oa << CURRENT_LOCAL_VERSION << header
-       << const_cast<const LocalMemory&>(machine.memory().local())
-       << const_cast<const RLMachine&>(machine)
-       << const_cast<const System&>(machine.system())
-       << const_cast<const GraphicsSystem&>(machine.system().graphics())
-       << const_cast<const TextSystem&>(machine.system().text())
-       << const_cast<const SoundSystem&>(machine.system().sound());
+    writeSaveFormat(oss, format);
+    if (format == SAVE_FORMAT_BINARY)
+      header = saveGameArchive<boost::archive::binary_oarchive>(oss, machine);
+    else
+      header = saveGameArchive<boost::archive::text_oarchive>(oss, machine);
   }
   catch (std::exception& e) {
     std::cerr << "--- WARNING: ERROR DURING SAVING FILE: " << e.what() << " ---"
@@ -123,40 +234,48 @@ void saveGameTo(std::ostream& oss, RLMachine& machine) {
   }
 
   g_current_machine = NULL;
+  return header;
+}
+
+bool saveExistsForSlot(RLMachine& machine, int slot) {
+  fs::path path = buildSaveGameFilename(machine, slot);
+  return machine.save_writer().IsPending(path) || fs::exists(path);
 }
 
 fs::path buildSaveGameFilename(RLMachine& machine, int slot) {
-  std::ostringstream oss;
-  oss << "save" << std::setw(3) << std::setfill('0') << slot << ".sav.gz";
+  return machine.system().GameSaveDirectory() /
+         SaveGameIndex::FilenameForSlot(slot);
+}
 
-  return machine.system().GameSaveDirectory() / oss.str();
+bool lookupHeaderForSlot(RLMachine& machine,
+                         int slot,
+                         SaveGameHeader* header) {
+  return machine.save_game_index().Lookup(slot, header);
 }
 
 SaveGameHeader loadHeaderForSlot(RLMachine& machine, int slot) {
-  fs::path path = buildSaveGameFilename(machine, slot);
-  fs::ifstream file(path, std::ios::binary);
-  checkInFileOpened(file, path);
+  SaveGameHeader header;
+  if (!lookupHeaderForSlot(machine, slot, &header)) {
+    throw rlvm::Exception(str(format(_("Could not open save game file %1%")) %
+                              buildSaveGameFilename(machine, slot)));
+  }
 
-  return loadHeaderFrom(file);
+  return header;
 }
 
 SaveGameHeader loadHeaderFrom(std::istream& iss) {
-  boost::iostreams::filtering_stream<boost::iostreams::input> filtered_input;
-  filtered_input.push(boost::iostreams::zlib_decompressor());
+  SaveCodec::InputStream filtered_input;
+  SaveCodec::Detect(iss).PushDecompressor(filtered_input);
   filtered_input.push(iss);
 
-  int version;
-  SaveGameHeader header;
-
-  // Only load the header
-  boost::archive::text_iarchive ia(filtered_input);
-  ia >> version >> header;
-
-  return header;
+  if (readSaveFormat(filtered_input) == SAVE_FORMAT_BINARY)
+    return loadHeaderArchive<boost::archive::binary_iarchive>(filtered_input);
+  return loadHeaderArchive<boost::archive::text_iarchive>(filtered_input);
 }
 
 void loadLocalMemoryForSlot(RLMachine& machine, int slot, Memory& memory) {
   fs::path path = buildSaveGameFilename(machine, slot);
+  machine.save_writer().WaitFor(path);
   fs::ifstream file(path, std::ios::binary);
   checkInFileOpened(file, path);
 
@@ -164,20 +283,22 @@ void loadLocalMemoryForSlot(RLMachine& machine, int slot, Memory& memory) {
 }
 
 void loadLocalMemoryFrom(std::istream& iss, Memory& memory) {
-  boost::iostreams::filtering_stream<boost::iostreams::input> filtered_input;
-  filtered_input.push(boost::iostreams::zlib_decompressor());
+  SaveCodec::InputStream filtered_input;
+  SaveCodec::Detect(iss).PushDecompressor(filtered_input);
   filtered_input.push(iss);
 
-  int version;
-  SaveGameHeader header;
-
-  // Only load the header
-  boost::archive::text_iarchive ia(filtered_input);
-  ia >> version >> header >> memory.local();
+  if (readSaveFormat(filtered_input) == SAVE_FORMAT_BINARY) {
+    loadLocalMemoryArchive<boost::archive::binary_iarchive>(filtered_input,
+                                                            memory);
+  } else {
+    loadLocalMemoryArchive<boost::archive::text_iarchive>(filtered_input,
+                                                          memory);
+  }
 }
 
 void loadGameForSlot(RLMachine& machine, int slot) {
   fs::path path = buildSaveGameFilename(machine, slot);
+  machine.save_writer().WaitFor(path);
   fs::ifstream file(path, std::ios::binary);
   checkInFileOpened(file, path);
 
@@ -185,13 +306,10 @@ void loadGameForSlot(RLMachine& machine, int slot) {
 }
 
 void loadGameFrom(std::istream& iss, RLMachine& machine) {
-  boost::iostreams::filtering_stream<boost::iostreams::input> filtered_input;
-  filtered_input.push(boost::iostreams::zlib_decompressor());
+  SaveCodec::InputStream filtered_input;
+  SaveCodec::Detect(iss).PushDecompressor(filtered_input);
   filtered_input.push(iss);
 
-  int version;
-  SaveGameHeader header;
-
   g_current_machine = &machine;
 
   try {
@@ -199,10 +317,10 @@ void loadGameFrom(std::istream& iss, RLMachine& machine) {
     // often hold references to objects in the System heiarchy.
     machine.Reset();
 
-    boost::archive::text_iarchive ia(filtered_input);
-    ia >> version >> header >> machine.memory().local() >> machine >>
-        machine.system() >> machine.system().graphics() >>
-        machine.system().text() >> machine.system().sound();
+    if (readSaveFormat(filtered_input) == SAVE_FORMAT_BINARY)
+      loadGameArchive<boost::archive::binary_iarchive>(filtered_input, machine);
+    else
+      loadGameArchive<boost::archive::text_iarchive>(filtered_input, machine);
 
     machine.system().graphics().ReplayGraphicsStack(machine);
 
@@ -25,6 +25,8 @@
 //
 // -----------------------------------------------------------------------
 
+#include <boost/archive/binary_iarchive.hpp>  // NOLINT
+#include <boost/archive/binary_oarchive.hpp>  // NOLINT
 #include <boost/archive/text_iarchive.hpp>  // NOLINT
 #include <boost/archive/text_oarchive.hpp>  // NOLINT
 
@@ -42,19 +44,19 @@
 // -----------------------------------------------------------------------
 // StackFrame
 // -----------------------------------------------------------------------
-StackFrame::StackFrame() : scenario(NULL), ip(), frame_type() {
+StackFrame::StackFrame() : scenario(NULL), ip(0), frame_type() {
   memset(intL, 0, sizeof(intL));
 }
 
 StackFrame::StackFrame(libreallive::Scenario const* s,
-                       const libreallive::Scenario::const_iterator& i,
+                       libreallive::pointer_t i,
                        FrameType t)
     : scenario(s), ip(i), frame_type(t) {
   memset(intL, 0, sizeof(intL));
 }
 
 StackFrame::StackFrame(libreallive::Scenario const* s,
-                       const libreallive::Scenario::const_iterator& i,
+                       libreallive::pointer_t i,
                        LongOperation* op)
     : scenario(s), ip(i), long_op(op), frame_type(TYPE_LONGOP) {
   memset(intL, 0, sizeof(intL));
@@ -64,7 +66,7 @@ StackFrame::~StackFrame() {}
 
 std::ostream& operator<<(std::ostream& os, const StackFrame& frame) {
   os << "{seen=" << frame.scenario->scene_number()
-     << ", offset=" << distance(frame.scenario->begin(), frame.ip);
+     << ", offset=" << frame.ip;
 
   if (frame.long_op)
     os << " [LONG OP=" << typeid(*frame.long_op).name() << "]";
@@ -77,7 +79,7 @@ std::ostream& operator<<(std::ostream& os, const StackFrame& frame) {
 template <class Archive>
 void StackFrame::save(Archive& ar, unsigned int version) const {
   int scene_number = scenario->scene_number();
-  int position = distance(scenario->begin(), ip);
+  int position = ip;
   ar& scene_number& position& frame_type& intL& strK;
 }
 
@@ -95,17 +97,14 @@ void StackFrame::load(Archive& ar, unsigned int version) {
     throw rlvm::Exception(oss.str());
   }
 
-  if (offset > distance(scenario->begin(), scenario->end()) || offset < 0) {
+  if (offset < 0 || static_cast<size_t>(offset) > scenario->size()) {
     std::ostringstream oss;
     oss << offset << " is an illegal bytecode offset for SEEN #" << scene_number
         << " in save file!";
     throw rlvm::Exception(oss.str());
   }
 
-  libreallive::Scenario::const_iterator position_it = scenario->begin();
-  advance(position_it, offset);
-
-  *this = StackFrame(scenario, position_it, type);
+  *this = StackFrame(scenario, offset, type);
 
   if (version >= 1) {
     ar& intL;
@@ -133,6 +132,14 @@ template void StackFrame::save<boost::archive::text_oarchive>(
     boost::archive::text_oarchive& ar,
     unsigned int version) const;
 
+template void StackFrame::save<boost::archive::binary_oarchive>(
+    boost::archive::binary_oarchive& ar,
+    unsigned int version) const;
+
 template void StackFrame::load<boost::archive::text_iarchive>(
     boost::archive::text_iarchive& ar,
     unsigned int version);
+
+template void StackFrame::load<boost::archive::binary_iarchive>(
+    boost::archive::binary_iarchive& ar,
+    unsigned int version);
@@ -54,8 +54,8 @@ struct StackFrame {
   // The scenario in the SEEN file for this stack frame.
   libreallive::Scenario const* scenario;
 
-  // The instruction pointer in the stack frame.
-  libreallive::Scenario::const_iterator ip;
+  // The instruction pointer in the stack frame, as an index into |scenario|.
+  libreallive::pointer_t ip;
 
   // Pointer to the owned LongOperation if this is of TYPE_LONGOP.
   std::shared_ptr<LongOperation> long_op;
@@ -81,12 +81,12 @@ struct StackFrame {
 
   // Constructor for normal stack frames added by RealLive code.
   StackFrame(libreallive::Scenario const* s,
-             const libreallive::Scenario::const_iterator& i,
+             libreallive::pointer_t i,
              FrameType t);
 
   // Constructor for frames that are just LongOperations.
   StackFrame(libreallive::Scenario const* s,
-             const libreallive::Scenario::const_iterator& i,
+             libreallive::pointer_t i,
              LongOperation* op);
 
   ~StackFrame();
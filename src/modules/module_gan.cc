@@ -81,7 +81,7 @@ struct WaitForGanToFinish : public LongOperation {
   }
 
   bool operator()(RLMachine& machine) {
-    GraphicsObject& obj = GetObject(machine);
+    const GraphicsObject& obj = GetObject(machine);
     bool done = true;
 
     if (obj.has_object_data()) {
@@ -30,6 +30,7 @@
 #include <boost/algorithm/string.hpp>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -1445,12 +1446,12 @@ void ReplayGraphicsStackCommand(RLMachine& machine,
     for (auto const& command : stack) {
       if (command != "") {
         // Parse the string as a chunk of Reallive bytecode.
-        libreallive::ConstructionData cdata(0, libreallive::pointer_t());
-        libreallive::BytecodeElement* element =
+        libreallive::ConstructionData cdata(0, NULL);
+        std::unique_ptr<libreallive::BytecodeElement> element(
             libreallive::BytecodeElement::Read(
-                command.c_str(), command.c_str() + command.size(), cdata);
+                command.c_str(), command.c_str() + command.size(), cdata));
         libreallive::CommandElement* command =
-            dynamic_cast<libreallive::CommandElement*>(element);
+            dynamic_cast<libreallive::CommandElement*>(element.get());
         if (command) {
           machine.ExecuteCommand(*command);
         }
@@ -29,9 +29,12 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <numeric>
 #include <vector>
 
+#include "libreallive/intmemref.h"
+#include "machine/memory.h"
 #include "machine/rloperation.h"
 #include "machine/rloperation/argc_t.h"
 #include "machine/rloperation/complex_t.h"
@@ -42,6 +45,79 @@
 
 namespace {
 
+// Most calls work on ranges of full width integers, which Memory hands out as
+// plain arrays so the loops below compile down to fills, copies and
+// reductions. These return NULL for anything else (the store register,
+// bit-packed views, intL[], ranges that run off the end of a bank), and the
+// opcode then falls back to going through the IntReferenceIterator one
+// location at a time.
+const int* ReadableSpan(const IntReferenceIterator& it, int count) {
+  if (!it.memory())
+    return NULL;
+  return it.memory()->GetIntSpan(
+      libreallive::IntMemRef(it.type(), it.location()), count);
+}
+
+int* WritableSpan(const IntReferenceIterator& it, int count) {
+  if (!it.memory())
+    return NULL;
+  return it.memory()->GetMutableIntSpan(
+      libreallive::IntMemRef(it.type(), it.location()), count);
+}
+
+// Returns the number of locations in the inclusive range [first, last], or 0
+// if they aren't in the same bank.
+int RangeLength(const IntReferenceIterator& first,
+                const IntReferenceIterator& last) {
+  if (first.memory() != last.memory() || first.type() != last.type())
+    return 0;
+  return last.location() - first.location() + 1;
+}
+
+// Returns the number of locations spanned by |count| locations |step| apart,
+// or 0 if that can't be a range within one bank.
+int SteppedLength(int step, int count) {
+  if (step <= 0 || count <= 0 || step > SIZE_OF_MEM_BANK ||
+      count > SIZE_OF_MEM_BANK) {
+    return 0;
+  }
+  return (count - 1) * step + 1;
+}
+
+void FillRange(IntReferenceIterator first,
+               IntReferenceIterator last,
+               int value) {
+  const int count = RangeLength(first, last);
+  if (int* span = WritableSpan(first, count)) {
+    std::fill_n(span, count, value);
+  } else {
+    ++last;  // RealLive ranges are inclusive
+    fill(first, last, value);
+  }
+}
+
+void FillStepped(IntReferenceIterator origin, int step, int count, int value) {
+  const int length = SteppedLength(step, count);
+  if (int* span = WritableSpan(origin, length)) {
+    for (int i = 0; i < count; ++i)
+      span[i * step] = value;
+  } else {
+    for (int i = 0; i < count; ++i) {
+      *origin = value;
+      advance(origin, step);
+    }
+  }
+}
+
+int SumRange(IntReferenceIterator first, IntReferenceIterator last) {
+  const int count = RangeLength(first, last);
+  if (const int* span = ReadableSpan(first, count))
+    return std::accumulate(span, span + count, 0);
+
+  ++last;  // RealLive ranges are inclusive
+  return accumulate(first, last, 0);
+}
+
 // Implement op<1:Mem:00000, 0>, fun setarray(int, intC+).
 //
 // Sets a block of integers, starting with origin, to the given values. values
@@ -51,7 +127,10 @@ struct setarray : public RLOpcode<IntReference_T, Argc_T<IntConstant_T>> {
   void operator()(RLMachine& machine,
                   IntReferenceIterator origin,
                   std::vector<int> values) {
-    copy(values.begin(), values.end(), origin);
+    if (int* span = WritableSpan(origin, values.size()))
+      std::copy(values.begin(), values.end(), span);
+    else
+      copy(values.begin(), values.end(), origin);
   }
 };
 
@@ -62,8 +141,7 @@ struct setrng_0 : public RLOpcode<IntReference_T, IntReference_T> {
   void operator()(RLMachine& machine,
                   IntReferenceIterator first,
                   IntReferenceIterator last) {
-    ++last;  // RealLive ranges are inclusive
-    fill(first, last, 0);
+    FillRange(first, last, 0);
   }
 };
 
@@ -76,8 +154,7 @@ struct setrng_1
                   IntReferenceIterator first,
                   IntReferenceIterator last,
                   int value) {
-    ++last;  // RealLive ranges are inclusive
-    fill(first, last, value);
+    FillRange(first, last, value);
   }
 };
 
@@ -91,6 +168,13 @@ struct cpyrng
                   IntReferenceIterator source,
                   IntReferenceIterator dest,
                   int count) {
+    if (const int* from = ReadableSpan(source, count)) {
+      if (int* to = WritableSpan(dest, count)) {
+        memmove(to, from, count * sizeof(int));
+        return;
+      }
+    }
+
     std::vector<int> tmpCopy;
     std::copy_n(source, count, std::back_inserter(tmpCopy));
     std::copy(tmpCopy.begin(), tmpCopy.end(), dest);
@@ -107,6 +191,13 @@ struct setarray_stepped
                   IntReferenceIterator origin,
                   int step,
                   std::vector<int> values) {
+    const int count = values.size();
+    if (int* span = WritableSpan(origin, SteppedLength(step, count))) {
+      for (int i = 0; i < count; ++i)
+        span[i * step] = values[i];
+      return;
+    }
+
     // Sigh. No more simple STL statements
     for (std::vector<int>::iterator it = values.begin();
          it != values.end();
@@ -127,10 +218,7 @@ struct setrng_stepped_0
                   IntReferenceIterator origin,
                   int step,
                   int count) {
-    for (int i = 0; i < count; ++i) {
-      *origin = 0;
-      advance(origin, step);
-    }
+    FillStepped(origin, step, count, 0);
   }
 };
 
@@ -147,10 +235,7 @@ struct setrng_stepped_1 : public RLOpcode<IntReference_T,
                   int step,
                   int count,
                   int value) {
-    for (int i = 0; i < count; ++i) {
-      *origin = value;
-      advance(origin, step);
-    }
+    FillStepped(origin, step, count, value);
   }
 };
 
@@ -164,12 +249,16 @@ struct cpyvars : public RLOpcode<IntReference_T,
                   IntReferenceIterator origin,
                   int offset,
                   std::vector<IntReferenceIterator> values) {
+    int* span = WritableSpan(origin, values.size());
     for (std::vector<IntReferenceIterator>::iterator it = values.begin();
          it != values.end();
          ++it) {
       IntReferenceIterator irIt = *it;
       advance(irIt, offset);
-      *origin++ = *irIt;
+      if (span)
+        *span++ = *irIt;
+      else
+        *origin++ = *irIt;
     }
   }
 };
@@ -181,8 +270,7 @@ struct sum : public RLStoreOpcode<IntReference_T, IntReference_T> {
   int operator()(RLMachine& machine,
                  IntReferenceIterator first,
                  IntReferenceIterator last) {
-    last++;
-    return accumulate(first, last, 0);
+    return SumRange(first, last);
   }
 };
 
@@ -196,11 +284,8 @@ struct sums
       std::vector<std::tuple<IntReferenceIterator,
       IntReferenceIterator>> ranges) {
     int total = 0;
-    for (auto it = ranges.cbegin(); it != ranges.cend(); ++it) {
-      IntReferenceIterator last = std::get<1>(*it);
-      ++last;
-      total += accumulate(std::get<0>(*it), last, 0);
-    }
+    for (auto it = ranges.cbegin(); it != ranges.cend(); ++it)
+      total += SumRange(std::get<0>(*it), std::get<1>(*it));
     return total;
   }
 };
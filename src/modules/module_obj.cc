@@ -39,8 +39,9 @@
 using libreallive::ExpressionPiece;
 
 void EnsureIsParentObject(GraphicsObject& parent, int size) {
-  if (parent.has_object_data()) {
-    if (parent.GetObjectData().IsParentLayer()) {
+  const GraphicsObject& const_parent = parent;
+  if (const_parent.has_object_data()) {
+    if (const_parent.GetObjectData().IsParentLayer()) {
       return;
     }
   }
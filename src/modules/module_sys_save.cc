@@ -49,6 +49,7 @@
 #include "machine/rloperation/references.h"
 #include "machine/rloperation/special_t.h"
 #include "machine/save_game_header.h"
+#include "machine/save_writer.h"
 #include "machine/serialization.h"
 #include "systems/base/colour.h"
 #include "systems/base/surface.h"
@@ -67,8 +68,7 @@ namespace {
 
 struct SaveExists : public RLStoreOpcode<IntConstant_T> {
   int operator()(RLMachine& machine, int slot) {
-    fs::path saveFile = Serialization::buildSaveGameFilename(machine, slot);
-    return fs::exists(saveFile) ? 1 : 0;
+    return Serialization::saveExistsForSlot(machine, slot) ? 1 : 0;
   }
 };
 
@@ -83,11 +83,11 @@ struct SaveDate : public RLStoreOpcode<IntConstant_T,
                  IntReferenceIterator mIt,
                  IntReferenceIterator dIt,
                  IntReferenceIterator wdIt) {
-    int fileExists = SaveExists()(machine, slot);
+    SaveGameHeader header;
+    int fileExists =
+        Serialization::lookupHeaderForSlot(machine, slot, &header) ? 1 : 0;
 
     if (fileExists) {
-      SaveGameHeader header = Serialization::loadHeaderForSlot(machine, slot);
-
       *yIt = header.save_time.date().year();
       *mIt = header.save_time.date().month();
       *dIt = header.save_time.date().day();
@@ -109,11 +109,11 @@ struct SaveTime : public RLStoreOpcode<IntConstant_T,
                  IntReferenceIterator mmIt,
                  IntReferenceIterator ssIt,
                  IntReferenceIterator msIt) {
-    int fileExists = SaveExists()(machine, slot);
+    SaveGameHeader header;
+    int fileExists =
+        Serialization::lookupHeaderForSlot(machine, slot, &header) ? 1 : 0;
 
     if (fileExists) {
-      SaveGameHeader header = Serialization::loadHeaderForSlot(machine, slot);
-
       *hhIt = header.save_time.time_of_day().hours();
       *mmIt = header.save_time.time_of_day().minutes();
       *ssIt = header.save_time.time_of_day().seconds();
@@ -143,11 +143,11 @@ struct SaveDateTime : public RLStoreOpcode<IntConstant_T,
                  IntReferenceIterator mmIt,
                  IntReferenceIterator ssIt,
                  IntReferenceIterator msIt) {
-    int fileExists = SaveExists()(machine, slot);
+    SaveGameHeader header;
+    int fileExists =
+        Serialization::lookupHeaderForSlot(machine, slot, &header) ? 1 : 0;
 
     if (fileExists) {
-      SaveGameHeader header = Serialization::loadHeaderForSlot(machine, slot);
-
       *yIt = header.save_time.date().year();
       *mIt = header.save_time.date().month();
       *dIt = header.save_time.date().day();
@@ -183,11 +183,11 @@ struct SaveInfo : public RLStoreOpcode<IntConstant_T,
                  IntReferenceIterator ssIt,
                  IntReferenceIterator msIt,
                  StringReferenceIterator titleIt) {
-    int fileExists = SaveExists()(machine, slot);
+    SaveGameHeader header;
+    int fileExists =
+        Serialization::lookupHeaderForSlot(machine, slot, &header) ? 1 : 0;
 
     if (fileExists) {
-      SaveGameHeader header = Serialization::loadHeaderForSlot(machine, slot);
-
       *yIt = header.save_time.date().year();
       *mIt = header.save_time.date().month();
       *dIt = header.save_time.date().day();
@@ -267,6 +267,9 @@ struct GetSaveFlag : public RLStoreOpcode<IntConstant_T, GetSaveFlagList> {
 // been saved.
 struct LatestSave : public RLStoreOpcode<> {
   int operator()(RLMachine& machine) {
+    // Saves still being written don't have their final mtime yet.
+    machine.save_writer().WaitForAll();
+
     fs::path saveDir = machine.system().GameSaveDirectory();
     int latestSlot = -1;
     time_t latestTime = std::numeric_limits<time_t>::min();
@@ -292,7 +295,7 @@ struct LatestSave : public RLStoreOpcode<> {
 
 struct save : public RLOpcode<IntConstant_T> {
   void operator()(RLMachine& machine, int slot) {
-    Serialization::saveGlobalMemory(machine);
+    Serialization::journalGlobalMemory(machine);
     Serialization::saveGameForSlot(machine, slot);
   }
 };
@@ -462,7 +462,7 @@ void GCNPlatform::MenuSave(RLMachine& machine) {
 // -----------------------------------------------------------------------
 
 void GCNPlatform::DoSave(RLMachine& machine, int slot) {
-  Serialization::saveGlobalMemory(machine);
+  Serialization::journalGlobalMemory(machine);
   Serialization::saveGameForSlot(machine, slot);
 }
 
@@ -104,7 +104,17 @@ void GtkRLVMInstance::DoNativeWork() {
 void GtkRLVMInstance::ReportFatalError(const std::string& message_text,
                                        const std::string& informative_text) {
   RLVMInstance::ReportFatalError(message_text, informative_text);
+  ShowErrorDialog(message_text, informative_text);
+}
+
+void GtkRLVMInstance::ReportError(const std::string& message_text,
+                                  const std::string& informative_text) {
+  RLVMInstance::ReportError(message_text, informative_text);
+  ShowErrorDialog(message_text, informative_text);
+}
 
+void GtkRLVMInstance::ShowErrorDialog(const std::string& message_text,
+                                      const std::string& informative_text) {
   GtkWidget* message = gtk_message_dialog_new(NULL,
                                               GTK_DIALOG_MODAL,
                                               GTK_MESSAGE_ERROR,
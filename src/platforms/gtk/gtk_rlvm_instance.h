@@ -45,10 +45,18 @@ class GtkRLVMInstance : public RLVMInstance {
   virtual void ReportFatalError(const std::string& message_text,
                                 const std::string& informative_text);
 
+  virtual void ReportError(const std::string& message_text,
+                           const std::string& informative_text);
+
   virtual bool AskUserPrompt(const std::string& message_text,
                              const std::string& informative_text,
                              const std::string& true_button,
                              const std::string& false_button);
+
+ private:
+  // Runs a modal error dialog.
+  void ShowErrorDialog(const std::string& message_text,
+                       const std::string& informative_text);
 };
 
 #endif  // SRC_PLATFORMS_GTK_GTK_RLVM_INSTANCE_H_
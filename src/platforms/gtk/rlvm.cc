@@ -33,6 +33,7 @@
 #include <iostream>
 #include <string>
 
+#include "machine/serialization.h"
 #include "platforms/gtk/gtk_rlvm_instance.h"
 #include "systems/base/system.h"
 #include "utilities/file.h"
@@ -87,7 +88,25 @@ int main(int argc, char* argv[]) {
   opts.add_options()("help", "Produce help message")(
       "help-debug", "Print help message for people working on rlvm")(
       "version", "Display version and license information")(
-      "font", po::value<string>(), "Specifies TrueType font to use.");
+      "font", po::value<string>(), "Specifies TrueType font to use.")(
+      "preload-scenarios",
+      "Parse every SEEN in the background on startup instead of on first "
+      "use")(
+      "no-scenario-cache",
+      "Don't keep decompressed SEENs in the save directory between runs")(
+      "preparse-parameters",
+      "Parse the parameters of every command on startup instead of on first "
+      "use, and report the ones that fail")(
+      "scenario-budget", po::value<int>(),
+      "Keep at most this many megabytes of parsed SEENs in memory, dropping "
+      "the least recently used ones")(
+      "save-compression", po::value<string>(),
+      "Compress saves and global memory with 'zlib' (the default; smaller) "
+      "or 'lz' (faster). Older versions of rlvm can only load zlib saves "
+      "written with --save-format=text")(
+      "save-format", po::value<string>(),
+      "Write saves and global memory as 'binary' (the default; faster, but "
+      "older versions of rlvm can't load them) or 'text'");
 
   po::options_description debugOpts("Debugging Options");
   debugOpts.add_options()(
@@ -98,7 +117,10 @@ int main(int argc, char* argv[]) {
       "undefined-opcodes", "Display a message on undefined opcodes")(
       "count-undefined",
       "On exit, present a summary table about how many times each undefined "
-      "opcode was called")("trace", "Prints opcodes as they are run)");
+      "opcode was called")("trace", "Prints opcodes as they are run)")(
+      "profile-opcodes", po::value<string>(),
+      "On exit, write the time spent in each opcode and on each SEEN line to "
+      "this file; as JSON if it ends in .json, otherwise as CSV");
 
   // Declare the final option to be game-root
   po::options_description hidden("Hidden");
@@ -210,12 +232,56 @@ int main(int argc, char* argv[]) {
   if (vm.count("trace"))
     instance.set_tracing();
 
+  if (vm.count("profile-opcodes"))
+    instance.set_opcode_profile(vm["profile-opcodes"].as<string>());
+
   if (vm.count("load-save"))
     instance.set_load_save(vm["load-save"].as<int>());
 
   if (vm.count("font"))
     instance.set_custom_font(vm["font"].as<string>());
 
+  if (vm.count("preload-scenarios"))
+    instance.set_preload_scenarios();
+
+  if (vm.count("no-scenario-cache"))
+    instance.set_no_scenario_cache();
+
+  if (vm.count("preparse-parameters"))
+    instance.set_preparse_parameters();
+
+  if (vm.count("scenario-budget")) {
+    int megabytes = vm["scenario-budget"].as<int>();
+    if (megabytes > 0)
+      instance.set_scenario_budget(static_cast<size_t>(megabytes) << 20);
+  }
+
+  if (vm.count("save-compression")) {
+    string compression = vm["save-compression"].as<string>();
+    if (compression == "zlib") {
+      instance.set_save_compression(Serialization::SAVE_COMPRESSION_ZLIB);
+    } else if (compression == "lz") {
+      instance.set_save_compression(Serialization::SAVE_COMPRESSION_LZ);
+    } else {
+      cerr << "ERROR: Unknown save compression '" << compression
+           << "'; use 'lz' or 'zlib'." << endl;
+      return -1;
+    }
+  }
+
+  if (vm.count("save-format")) {
+    string format = vm["save-format"].as<string>();
+    if (format == "text") {
+      instance.set_save_format(Serialization::SAVE_FORMAT_TEXT);
+    } else if (format == "binary") {
+      instance.set_save_format(Serialization::SAVE_FORMAT_BINARY);
+    } else {
+      cerr << "ERROR: Unknown save format '" << format
+           << "'; use 'binary' or 'text'." << endl;
+      return -1;
+    }
+  }
+
   instance.Run(gamerootPath);
 
   return 0;
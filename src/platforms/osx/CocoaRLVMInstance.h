@@ -47,6 +47,8 @@ class CocoaRLVMInstance : public RLVMInstance {
   // Overridden from RLVMInstance:
   virtual void ReportFatalError(const std::string& message_text,
                                 const std::string& informative_text);
+  virtual void ReportError(const std::string& message_text,
+                           const std::string& informative_text);
   virtual bool AskUserPrompt(const std::string& message_text,
                              const std::string& informative_text,
                              const std::string& true_button,
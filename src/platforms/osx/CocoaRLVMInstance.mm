@@ -85,10 +85,11 @@ boost::filesystem::path CocoaRLVMInstance::SelectGameDirectory() {
   return out_path;
 }
 
-void CocoaRLVMInstance::ReportFatalError(const std::string& message_text,
-                                         const std::string& informative_text) {
-  RLVMInstance::ReportFatalError(message_text, informative_text);
+namespace {
 
+// Runs a modal alert for an error.
+void ShowErrorAlert(const std::string& message_text,
+                    const std::string& informative_text) {
   NSString* message = UTF8ToNSString(message_text);
   NSString* information = UTF8ToNSString(informative_text);
 
@@ -100,6 +101,20 @@ void CocoaRLVMInstance::ReportFatalError(const std::string& message_text,
   [alert runModal];
 }
 
+}  // namespace
+
+void CocoaRLVMInstance::ReportFatalError(const std::string& message_text,
+                                         const std::string& informative_text) {
+  RLVMInstance::ReportFatalError(message_text, informative_text);
+  ShowErrorAlert(message_text, informative_text);
+}
+
+void CocoaRLVMInstance::ReportError(const std::string& message_text,
+                                    const std::string& informative_text) {
+  RLVMInstance::ReportError(message_text, informative_text);
+  ShowErrorAlert(message_text, informative_text);
+}
+
 bool CocoaRLVMInstance::AskUserPrompt(const std::string& message_text,
                                       const std::string& informative_text,
                                       const std::string& true_button,
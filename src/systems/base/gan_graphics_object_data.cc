@@ -29,6 +29,8 @@
 // (which translates binary GAN files to and from an XML
 // representation), found at rldev/src/rlxml/gan.ml.
 
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 
@@ -359,10 +361,18 @@ template void GanGraphicsObjectData::save<boost::archive::text_oarchive>(
     boost::archive::text_oarchive& ar,
     unsigned int version) const;
 
+template void GanGraphicsObjectData::save<boost::archive::binary_oarchive>(
+    boost::archive::binary_oarchive& ar,
+    unsigned int version) const;
+
 template void GanGraphicsObjectData::load<boost::archive::text_iarchive>(
     boost::archive::text_iarchive& ar,
     unsigned int version);
 
+template void GanGraphicsObjectData::load<boost::archive::binary_iarchive>(
+    boost::archive::binary_iarchive& ar,
+    unsigned int version);
+
 // -----------------------------------------------------------------------
 
 BOOST_CLASS_EXPORT(GanGraphicsObjectData);
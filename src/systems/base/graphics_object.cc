@@ -25,6 +25,8 @@
 //
 // -----------------------------------------------------------------------
 
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 
@@ -89,6 +91,14 @@ const Rect EMPTY_CLIP = Rect(Point(0, 0), Size(-1, -1));
 const boost::shared_ptr<GraphicsObject::Impl> GraphicsObject::s_empty_impl(
     new GraphicsObject::Impl);
 
+namespace {
+
+// Source of GraphicsObject::data_revision_. Objects only live on the main
+// thread.
+uint64_t next_data_revision = 1;
+
+}  // namespace
+
 // -----------------------------------------------------------------------
 // GraphicsObject::TextProperties
 // -----------------------------------------------------------------------
@@ -137,9 +147,11 @@ GraphicsObject::Impl::ButtonProperties::ButtonProperties()
 // -----------------------------------------------------------------------
 // GraphicsObject
 // -----------------------------------------------------------------------
-GraphicsObject::GraphicsObject() : impl_(s_empty_impl) {}
+GraphicsObject::GraphicsObject()
+    : impl_(s_empty_impl), data_revision_(next_data_revision++) {}
 
-GraphicsObject::GraphicsObject(const GraphicsObject& rhs) : impl_(rhs.impl_) {
+GraphicsObject::GraphicsObject(const GraphicsObject& rhs)
+    : impl_(rhs.impl_), data_revision_(rhs.data_revision_) {
   if (rhs.object_data_) {
     object_data_.reset(rhs.object_data_->Clone());
     object_data_->set_owned_by(*this);
@@ -155,13 +167,23 @@ GraphicsObject::~GraphicsObject() { DeleteObjectMutators(); }
 
 GraphicsObject& GraphicsObject::operator=(const GraphicsObject& obj) {
   DeleteObjectMutators();
-  impl_ = obj.impl_;
-
-  if (obj.object_data_) {
-    object_data_.reset(obj.object_data_->Clone());
-    object_data_->set_owned_by(*this);
-  } else {
-    object_data_.reset();
+  if (impl_ != obj.impl_)
+    impl_ = obj.impl_;
+
+  // Our clone is still equal to |obj|'s data; keep it. Layers are always
+  // recloned since their children can be changed through references that
+  // outlive the GetObjectData() call.
+  bool same_data = obj.object_data_ && object_data_ &&
+                   data_revision_ == obj.data_revision_ &&
+                   !object_data_->IsParentLayer();
+  if (!same_data) {
+    if (obj.object_data_) {
+      object_data_.reset(obj.object_data_->Clone());
+      object_data_->set_owned_by(*this);
+    } else {
+      object_data_.reset();
+    }
+    data_revision_ = obj.data_revision_;
   }
 
   for (auto const& mutator : obj.object_mutators_)
@@ -171,6 +193,7 @@ GraphicsObject& GraphicsObject::operator=(const GraphicsObject& obj) {
 }
 
 void GraphicsObject::SetObjectData(GraphicsObjectData* obj) {
+  TouchObjectData();
   object_data_.reset(obj);
   object_data_->set_owned_by(*this);
 }
@@ -282,6 +305,13 @@ int GraphicsObject::PixelHeight() const {
     return 0;
 }
 
+Rect GraphicsObject::DstRect(const GraphicsObject* parent) const {
+  if (has_object_data())
+    return object_data_->DstRect(*this, parent);
+  else
+    return Rect();
+}
+
 int GraphicsObject::GetPattNo() const {
   if (GetButtonUsingOverides())
     return GetButtonPatternOverride();
@@ -422,6 +452,15 @@ void GraphicsObject::SetOwnClipRect(const Rect& rect) {
 }
 
 GraphicsObjectData& GraphicsObject::GetObjectData() {
+  if (object_data_) {
+    TouchObjectData();
+    return *object_data_;
+  } else {
+    throw rlvm::Exception("null object data");
+  }
+}
+
+const GraphicsObjectData& GraphicsObject::GetObjectData() const {
   if (object_data_) {
     return *object_data_;
   } else {
@@ -862,6 +901,10 @@ void GraphicsObject::DeleteObjectMutators() {
   object_mutators_.clear();
 }
 
+void GraphicsObject::TouchObjectData() {
+  data_revision_ = next_data_revision++;
+}
+
 void GraphicsObject::Render(int objNum,
                             const GraphicsObject* parent,
                             std::ostream* tree) {
@@ -875,6 +918,7 @@ void GraphicsObject::Render(int objNum,
 }
 
 void GraphicsObject::FreeObjectData() {
+  TouchObjectData();
   object_data_.reset();
   DeleteObjectMutators();
 }
@@ -885,6 +929,7 @@ void GraphicsObject::InitializeParams() {
 }
 
 void GraphicsObject::FreeDataAndInitializeParams() {
+  TouchObjectData();
   object_data_.reset();
   impl_ = s_empty_impl;
   DeleteObjectMutators();
@@ -892,6 +937,9 @@ void GraphicsObject::FreeDataAndInitializeParams() {
 
 void GraphicsObject::Execute(RLMachine& machine) {
   if (object_data_) {
+    // Only playing animations and layers change their data here.
+    if (object_data_->is_currently_playing() || object_data_->IsParentLayer())
+      TouchObjectData();
     object_data_->Execute(machine);
   }
 
@@ -910,6 +958,8 @@ void GraphicsObject::Execute(RLMachine& machine) {
 template <class Archive>
 void GraphicsObject::serialize(Archive& ar, unsigned int version) {
   ar& impl_& object_data_;
+  if (Archive::is_loading::value)
+    TouchObjectData();
 }
 
 // -----------------------------------------------------------------------
@@ -918,10 +968,18 @@ template void GraphicsObject::serialize<boost::archive::text_oarchive>(
     boost::archive::text_oarchive& ar,
     unsigned int version);
 
+template void GraphicsObject::serialize<boost::archive::binary_oarchive>(
+    boost::archive::binary_oarchive& ar,
+    unsigned int version);
+
 template void GraphicsObject::serialize<boost::archive::text_iarchive>(
     boost::archive::text_iarchive& ar,
     unsigned int version);
 
+template void GraphicsObject::serialize<boost::archive::binary_iarchive>(
+    boost::archive::binary_iarchive& ar,
+    unsigned int version);
+
 // -----------------------------------------------------------------------
 // GraphicsObject::Impl
 // -----------------------------------------------------------------------
@@ -1139,10 +1197,18 @@ template void GraphicsObject::Impl::serialize<boost::archive::text_oarchive>(
     boost::archive::text_oarchive& ar,
     unsigned int version);
 
+template void GraphicsObject::Impl::serialize<boost::archive::binary_oarchive>(
+    boost::archive::binary_oarchive& ar,
+    unsigned int version);
+
 template void GraphicsObject::Impl::serialize<boost::archive::text_iarchive>(
     boost::archive::text_iarchive& ar,
     unsigned int version);
 
+template void GraphicsObject::Impl::serialize<boost::archive::binary_iarchive>(
+    boost::archive::binary_iarchive& ar,
+    unsigned int version);
+
 // -----------------------------------------------------------------------
 // GraphicsObject::Impl::TextProperties
 // -----------------------------------------------------------------------
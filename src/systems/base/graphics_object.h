@@ -116,6 +116,10 @@ class GraphicsObject {
   int PixelWidth() const;
   int PixelHeight() const;
 
+  // Where the object data is drawn on screen, placed relative to |parent| if
+  // it is non-NULL.
+  Rect DstRect(const GraphicsObject* parent) const;
+
   // Object attribute accessors
   int GetPattNo() const;
   void SetPattNo(const int in);
@@ -189,7 +193,10 @@ class GraphicsObject {
 
   bool has_object_data() const { return object_data_.get(); }
 
+  // Non-const access to the object data counts as a change to it, since
+  // callers use it to play animations, set layer children, etc.
   GraphicsObjectData& GetObjectData();
+  const GraphicsObjectData& GetObjectData() const;
   void SetObjectData(GraphicsObjectData* obj);
 
   // Render!
@@ -315,6 +322,13 @@ class GraphicsObject {
   // Whether we have the default shared data. Only used in unit testing.
   bool is_cleared() const { return impl_ == s_empty_impl; }
 
+  // Identifies the state of |object_data_|. Copies share the revision of
+  // their source and every change takes a fresh one, so two objects with the
+  // same revision hold equal data. operator= uses this to keep the clone it
+  // already has, which makes taking a savepoint snapshot of the mostly
+  // unchanged object arrays cheap.
+  uint64_t data_revision() const { return data_revision_; }
+
  private:
   // Makes the internal copy for our copy-on-write semantics. This function
   // checks to see if our Impl object has only one reference to it. If it
@@ -324,6 +338,9 @@ class GraphicsObject {
   // Immediately delete all mutators; doesn't run their SetToEnd() method.
   void DeleteObjectMutators();
 
+  // Gives |object_data_| a new revision; called whenever it may change.
+  void TouchObjectData();
+
   // Implementation data structure. GraphicsObject::Impl is the internal data
   // store for GraphicsObjects' copy-on-write semantics.
   struct Impl {
@@ -518,6 +535,8 @@ class GraphicsObject {
   // The actual data used to render the object
   boost::scoped_ptr<GraphicsObjectData> object_data_;
 
+  uint64_t data_revision_;
+
   // Tasks that run every tick. Used to mutate object parameters over time (and
   // how we check from a blocking LongOperation if the mutation is ongoing).
   //
@@ -28,6 +28,8 @@
 #include "systems/base/graphics_system.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/serialization/deque.hpp>
@@ -777,9 +779,10 @@ LazyArray<GraphicsObject>& GraphicsSystem::GetForegroundObjects() {
 // -----------------------------------------------------------------------
 
 bool GraphicsSystem::AnimationsPlaying() const {
-  for (GraphicsObject& object : graphics_object_impl_->foreground_objects) {
+  for (const GraphicsObject& object :
+       graphics_object_impl_->foreground_objects) {
     if (object.has_object_data()) {
-      GraphicsObjectData& data = object.GetObjectData();
+      const GraphicsObjectData& data = object.GetObjectData();
       if (data.IsAnimation() && data.is_currently_playing())
         return true;
     }
@@ -950,6 +953,14 @@ void GraphicsSystem::load(Archive& ar, unsigned int version) {
 template void GraphicsSystem::load<boost::archive::text_iarchive>(
     boost::archive::text_iarchive& ar,
     unsigned int version);
+
+template void GraphicsSystem::load<boost::archive::binary_iarchive>(
+    boost::archive::binary_iarchive& ar,
+    unsigned int version);
 template void GraphicsSystem::save<boost::archive::text_oarchive>(
     boost::archive::text_oarchive& ar,
     unsigned int version) const;
+
+template void GraphicsSystem::save<boost::archive::binary_oarchive>(
+    boost::archive::binary_oarchive& ar,
+    unsigned int version) const;
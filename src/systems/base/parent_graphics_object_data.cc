@@ -24,6 +24,8 @@
 // Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
 // -----------------------------------------------------------------------
 
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/serialization/export.hpp>
@@ -125,5 +127,11 @@ template void ParentGraphicsObjectData::serialize<
 template void ParentGraphicsObjectData::serialize<
     boost::archive::text_oarchive>(boost::archive::text_oarchive& ar,
                                    unsigned int version);
+template void ParentGraphicsObjectData::serialize<
+    boost::archive::binary_iarchive>(boost::archive::binary_iarchive& ar,
+                                     unsigned int version);
+template void ParentGraphicsObjectData::serialize<
+    boost::archive::binary_oarchive>(boost::archive::binary_oarchive& ar,
+                                     unsigned int version);
 
 BOOST_CLASS_EXPORT(ParentGraphicsObjectData);
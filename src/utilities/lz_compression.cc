@@ -0,0 +1,186 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+#include "utilities/lz_compression.h"
+
+#include <cstdint>
+#include <cstring>
+
+// Each sequence is a token byte, then the literal run, then the back
+// reference. The token's high nibble is the literal length and its low nibble
+// the match length minus kMinMatch; a nibble of 15 is followed by bytes that
+// are added to it until one is less than 255. The back reference is a little
+// endian 16 bit distance. The last sequence of a block has literals only.
+
+namespace {
+
+const size_t kMinMatch = 4;
+
+const int kHashBits = 13;
+
+// Start skipping ahead when no match has been found for this many bytes, so
+// incompressible data passes through quickly.
+const int kSkipTrigger = 6;
+
+uint32_t Read32(const char* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint32_t Hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+void AppendLength(size_t length, std::string* dst) {
+  for (; length >= 255; length -= 255)
+    *dst += static_cast<char>(255);
+  *dst += static_cast<char>(length);
+}
+
+void AppendSequence(const char* literals,
+                    size_t literal_length,
+                    size_t offset,
+                    size_t match_length,
+                    std::string* dst) {
+  size_t match_code = match_length ? match_length - kMinMatch : 0;
+  *dst += static_cast<char>(((literal_length < 15 ? literal_length : 15) << 4) |
+                            (match_code < 15 ? match_code : 15));
+  if (literal_length >= 15)
+    AppendLength(literal_length - 15, dst);
+  dst->append(literals, literal_length);
+
+  if (match_length) {
+    *dst += static_cast<char>(offset & 0xff);
+    *dst += static_cast<char>(offset >> 8);
+    if (match_code >= 15)
+      AppendLength(match_code - 15, dst);
+  }
+}
+
+// Adds the extension bytes that follow a nibble of 15 to |length|.
+bool ReadLength(const unsigned char*& ip,
+                const unsigned char* end,
+                size_t* length) {
+  unsigned char byte;
+  do {
+    if (ip == end)
+      return false;
+    byte = *ip++;
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+}  // namespace
+
+void LzCompress(const char* src, size_t size, std::string* dst) {
+  // Positions are stored plus one, so that zero means empty.
+  uint32_t table[1 << kHashBits] = {0};
+
+  size_t anchor = 0;
+  size_t ip = 0;
+  size_t misses = 0;
+  while (ip + kMinMatch <= size) {
+    uint32_t sequence = Read32(src + ip);
+    uint32_t& slot = table[Hash(sequence)];
+    size_t candidate = slot;
+    slot = ip + 1;
+
+    if (candidate && ip - (candidate - 1) <= 0xffff &&
+        Read32(src + candidate - 1) == sequence) {
+      size_t match = candidate - 1;
+      size_t length = kMinMatch;
+      while (ip + length < size && src[match + length] == src[ip + length])
+        ++length;
+
+      AppendSequence(src + anchor, ip - anchor, ip - match, length, dst);
+      ip += length;
+      anchor = ip;
+      misses = 0;
+
+      // Remember where the match ended so the next one can refer to it.
+      if (ip + kMinMatch <= size && ip >= 2)
+        table[Hash(Read32(src + ip - 2))] = ip - 2 + 1;
+    } else {
+      ip += 1 + (misses++ >> kSkipTrigger);
+    }
+  }
+
+  AppendSequence(src + anchor, size - anchor, 0, 0, dst);
+}
+
+bool LzDecompress(const char* src, size_t size, char* dst, size_t dst_size) {
+  const unsigned char* ip = reinterpret_cast<const unsigned char*>(src);
+  const unsigned char* const end = ip + size;
+  size_t op = 0;
+
+  while (ip != end) {
+    unsigned char token = *ip++;
+
+    size_t literal_length = token >> 4;
+    if (literal_length == 15 && !ReadLength(ip, end, &literal_length))
+      return false;
+    if (literal_length > static_cast<size_t>(end - ip) ||
+        literal_length > dst_size - op) {
+      return false;
+    }
+    memcpy(dst + op, ip, literal_length);
+    ip += literal_length;
+    op += literal_length;
+
+    // The last sequence has no back reference.
+    if (ip == end)
+      break;
+
+    if (end - ip < 2)
+      return false;
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+
+    size_t match_length = token & 0x0f;
+    if (match_length == 15 && !ReadLength(ip, end, &match_length))
+      return false;
+    match_length += kMinMatch;
+
+    if (offset == 0 || offset > op || match_length > dst_size - op)
+      return false;
+
+    // Overlapping references repeat the bytes just written, so copy forward
+    // a byte at a time unless the regions are far enough apart.
+    char* out = dst + op;
+    const char* match = out - offset;
+    if (offset >= match_length) {
+      memcpy(out, match, match_length);
+    } else {
+      for (size_t i = 0; i < match_length; ++i)
+        out[i] = match[i];
+    }
+    op += match_length;
+  }
+
+  return op == dst_size;
+}
@@ -0,0 +1,50 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+#ifndef SRC_UTILITIES_LZ_COMPRESSION_H_
+#define SRC_UTILITIES_LZ_COMPRESSION_H_
+
+#include <cstddef>
+#include <string>
+
+// A small LZ77 block compressor in the style of LZ4: a block is a series of
+// byte aligned literal runs and back references with no entropy coding, so
+// both directions run close to memory speed at the cost of a worse ratio than
+// zlib.
+//
+// Back references are 16 bits, so a block may be at most kMaxLzBlockSize
+// bytes; longer data has to be split by the caller.
+const size_t kMaxLzBlockSize = 64 * 1024;
+
+// Appends the compressed form of the |size| bytes at |src| to |dst|.
+void LzCompress(const char* src, size_t size, std::string* dst);
+
+// Decompresses the |size| bytes at |src|, which must decompress to exactly
+// |dst_size| bytes, into |dst|. Returns false if the data is corrupt; never
+// reads or writes outside the buffers.
+bool LzDecompress(const char* src, size_t size, char* dst, size_t dst_size);
+
+#endif  // SRC_UTILITIES_LZ_COMPRESSION_H_
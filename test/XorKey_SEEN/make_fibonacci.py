@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+#
+# Builds fibonacci.TXT, a copy of Module_Jmp_SEEN/fibonacci.TXT as a compiler
+# that applies a second level xor (version 110002) would have written it,
+# using CLANNAD Full Voice's key. rlc can't produce such files, so this
+# decompresses the original, applies the key, and stores the result again as
+# literals only. The keys are read from src/libreallive/compression.cc.
+#
+# Run from the source root: python3 test/XorKey_SEEN/make_fibonacci.py
+
+import re
+import struct
+
+COMPRESSION_CC = 'src/libreallive/compression.cc'
+SOURCE = 'test/Module_Jmp_SEEN/fibonacci.TXT'
+TARGET = 'test/XorKey_SEEN/fibonacci.TXT'
+
+# A SEEN.TXT starts with 10000 (offset, length) pairs, one per scenario.
+TOC_SIZE = 10000 * 8
+
+
+def hex_bytes(text):
+  return bytes(int(x, 16) for x in re.findall(r'0x[0-9a-fA-F]+', text))
+
+
+source = open(COMPRESSION_CC).read()
+mask = hex_bytes(re.search(r'xor_mask\[256\] = \{(.*?)\};', source,
+                           re.S).group(1))
+match = re.search(r'clannad_full_voice_xor_mask\[\] = \{\s*\{\{(.*?)\},'
+                  r'\s*(\d+), (\d+)\}', source, re.S)
+key = hex_bytes(match.group(1))
+key_offset = int(match.group(2))
+key_length = int(match.group(3))
+
+
+def first_level_xor(data):
+  return bytes(c ^ mask[i % len(mask)] for i, c in enumerate(data))
+
+
+def decompress(block, length):
+  data = first_level_xor(block)
+  pos = 8
+  out = bytearray()
+  bit = 1
+  flag = data[pos]
+  pos += 1
+  while pos < len(data) and len(out) < length:
+    if bit == 256:
+      bit = 1
+      flag = data[pos]
+      pos += 1
+    if flag & bit:
+      out.append(data[pos])
+      pos += 1
+    else:
+      count = data[pos] | (data[pos + 1] << 8)
+      pos += 2
+      start = len(out) - (count >> 4)
+      for i in range((count & 0x0f) + 2):
+        out.append(out[start + i])
+    bit <<= 1
+  return bytes(out[:length])
+
+
+def compress_as_literals(data):
+  body = bytearray()
+  for i in range(0, len(data), 8):
+    group = data[i:i + 8]
+    body.append((1 << len(group)) - 1)
+    body += group
+  sizes = struct.pack('<ii', 8 + len(body), len(data))
+  return first_level_xor(sizes + bytes(body))
+
+
+archive = open(SOURCE, 'rb').read()
+offset, length = struct.unpack_from('<ii', archive, 1 * 8)
+scenario = bytearray(archive[offset:offset + length])
+data_offset, data_length, compressed_length = struct.unpack_from(
+    '<iii', scenario, 0x20)
+assert data_offset + compressed_length == len(scenario)
+
+bytecode = bytearray(decompress(
+    scenario[data_offset:data_offset + compressed_length], data_length))
+assert key_offset + key_length <= len(bytecode)
+for i in range(key_length):
+  bytecode[key_offset + i] ^= key[i % len(key)]
+
+block = compress_as_literals(bytes(bytecode))
+scenario = scenario[:data_offset] + block
+struct.pack_into('<i', scenario, 0x04, 110002)
+struct.pack_into('<i', scenario, 0x28, len(block))
+
+toc = bytearray(TOC_SIZE)
+struct.pack_into('<ii', toc, 1 * 8, TOC_SIZE, len(scenario))
+open(TARGET, 'wb').write(bytes(toc) + bytes(scenario))
@@ -0,0 +1,295 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+// -----------------------------------------------------------------------
+
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libreallive/archive.h"
+#include "libreallive/bytecode.h"
+#include "libreallive/intmemref.h"
+#include "machine/rlmachine.h"
+#include "modules/module_jmp.h"
+#include "test_system/test_system.h"
+
+#include "test_utils.h"
+
+namespace fs = boost::filesystem;
+
+using libreallive::Archive;
+using libreallive::IntMemRef;
+using libreallive::Scenario;
+
+TEST(ArchiveTest, PreloadParsesEveryScenario) {
+  Archive arc(locateTestCase("Module_Jmp_SEEN/farcallTest_0.TXT"));
+  EXPECT_FALSE(arc.IsScenarioLoaded(1));
+  EXPECT_FALSE(arc.IsScenarioLoaded(2));
+
+  arc.PreloadAllScenarios(2);
+
+  EXPECT_TRUE(arc.IsScenarioLoaded(1));
+  EXPECT_TRUE(arc.IsScenarioLoaded(2));
+  EXPECT_EQ(NULL, arc.GetScenario(3));
+}
+
+// Every thread that asks for a scenario while it is being preloaded must get
+// the same instance.
+TEST(ArchiveTest, ConcurrentGetScenarioReturnsOneInstance) {
+  Archive arc(locateTestCase("Module_Jmp_SEEN/farcallTest_0.TXT"));
+  arc.StartPreloading(2);
+
+  std::vector<Scenario*> seen(8);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i)
+    threads.emplace_back([&arc, &seen, i]() { seen[i] = arc.GetScenario(2); });
+  for (auto& thread : threads)
+    thread.join();
+  arc.WaitForPreload();
+
+  ASSERT_NE(static_cast<Scenario*>(NULL), seen[0]);
+  for (Scenario* scenario : seen)
+    EXPECT_EQ(seen[0], scenario);
+}
+
+// A farcall into a scenario that was built by a preload thread behaves like
+// one that was parsed lazily.
+TEST(ArchiveTest, FarcallIntoPreloadedScenario) {
+  Archive arc(locateTestCase("Module_Jmp_SEEN/farcallTest_0.TXT"));
+  arc.StartPreloading(1);
+
+  TestSystem system;
+  RLMachine rlmachine(system, arc);
+  rlmachine.AttachModule(new JmpModule);
+  rlmachine.SetIntValue(IntMemRef('B', 0), 2);
+  rlmachine.ExecuteUntilHalted();
+  arc.WaitForPreload();
+
+  EXPECT_EQ(1, rlmachine.GetIntValue(IntMemRef('A', 0)));
+  EXPECT_EQ(2, rlmachine.GetIntValue(IntMemRef('A', 1)));
+  EXPECT_EQ(1, rlmachine.GetIntValue(IntMemRef('A', 2)));
+}
+
+// Instruction pointers are indices into the scenario, and every entrypoint
+// resolves to the index of the element that declares it.
+TEST(ArchiveTest, EntrypointsResolveToElementIndices) {
+  Archive arc(locateTestCase("Module_Jmp_SEEN/farcallTest_0.TXT"));
+  Scenario* scenario = arc.GetScenario(2);
+  ASSERT_NE(static_cast<Scenario*>(NULL), scenario);
+
+  int entrypoints = 0;
+  for (libreallive::pointer_t i = 0; i < scenario->size(); ++i) {
+    int entrypoint = scenario->GetElement(i)->GetEntrypoint();
+    if (entrypoint != libreallive::BytecodeElement::kInvalidEntrypoint) {
+      EXPECT_EQ(i, scenario->FindEntrypoint(entrypoint));
+      entrypoints++;
+    }
+  }
+  EXPECT_LT(0, entrypoints);
+}
+
+// Without a budget, scenarios are never evicted.
+TEST(ArchiveTest, EvictScenariosWithoutBudgetKeepsEverything) {
+  Archive arc(locateTestCase("Module_Jmp_SEEN/farcallTest_0.TXT"));
+  arc.GetScenario(1);
+  arc.GetScenario(2);
+
+  arc.EvictScenarios(std::set<int>());
+
+  EXPECT_TRUE(arc.IsScenarioLoaded(1));
+  EXPECT_TRUE(arc.IsScenarioLoaded(2));
+}
+
+// Pinned scenarios survive even a budget they don't fit in.
+TEST(ArchiveTest, EvictScenariosKeepsPinnedScenarios) {
+  Archive arc(locateTestCase("Module_Jmp_SEEN/farcallTest_0.TXT"));
+  arc.set_scenario_budget(1);
+  arc.GetScenario(1);
+  arc.GetScenario(2);
+
+  std::map<int, size_t> usage = arc.GetScenarioMemoryUsage();
+  ASSERT_EQ(2u, usage.size());
+  EXPECT_LT(0u, usage[1]);
+  EXPECT_EQ(usage[1] + usage[2], arc.GetResidentScenarioBytes());
+
+  arc.EvictScenarios(std::set<int>{2});
+  EXPECT_FALSE(arc.IsScenarioLoaded(1));
+  EXPECT_TRUE(arc.IsScenarioLoaded(2));
+
+  // An evicted scenario is parsed again on demand.
+  ASSERT_NE(static_cast<Scenario*>(NULL), arc.GetScenario(1));
+  EXPECT_TRUE(arc.IsScenarioLoaded(1));
+}
+
+// When only one scenario fits, the least recently used one goes.
+TEST(ArchiveTest, EvictScenariosDropsLeastRecentlyUsed) {
+  Archive arc(locateTestCase("Module_Jmp_SEEN/farcallTest_0.TXT"));
+  arc.GetScenario(1);
+  arc.GetScenario(2);
+  arc.GetScenario(1);
+
+  std::map<int, size_t> usage = arc.GetScenarioMemoryUsage();
+  arc.set_scenario_budget(std::max(usage[1], usage[2]));
+  arc.EvictScenarios(std::set<int>());
+
+  EXPECT_TRUE(arc.IsScenarioLoaded(1));
+  EXPECT_FALSE(arc.IsScenarioLoaded(2));
+}
+
+// A farcall under a budget too small for anything still works, since the
+// scenarios on the call stack are pinned.
+TEST(ArchiveTest, FarcallUnderTinyScenarioBudget) {
+  Archive arc(locateTestCase("Module_Jmp_SEEN/farcallTest_0.TXT"));
+  arc.set_scenario_budget(1);
+
+  TestSystem system;
+  RLMachine rlmachine(system, arc);
+  rlmachine.AttachModule(new JmpModule);
+  rlmachine.SetIntValue(IntMemRef('B', 0), 3);
+  rlmachine.ExecuteUntilHalted();
+
+  EXPECT_EQ(1, rlmachine.GetIntValue(IntMemRef('A', 0)));
+  EXPECT_EQ(3, rlmachine.GetIntValue(IntMemRef('A', 1)));
+  EXPECT_EQ(1, rlmachine.GetIntValue(IntMemRef('A', 2)));
+}
+
+namespace {
+
+// Owns a scratch path for a scenario cache (or a copy of an archive) and
+// deletes it afterwards.
+class ScopedScratchPath {
+ public:
+  ScopedScratchPath()
+      : path_(fs::temp_directory_path() /
+              fs::unique_path("rlvm-scenario-cache-%%%%-%%%%")) {}
+  ~ScopedScratchPath() {
+    boost::system::error_code ec;
+    fs::remove(path_, ec);
+  }
+
+  std::string str() const { return path_.string(); }
+
+ private:
+  fs::path path_;
+};
+
+// Checks that every scenario in |cached| parses to the same instructions as
+// an uncached copy of the archive at |file|. Instructions are compared by
+// their source representation, so a stale entry whose instructions merely
+// have the same lengths is still caught.
+void ExpectSameAsUncached(const std::string& file, Archive& cached) {
+  Archive uncached(file);
+  TestSystem system;
+  RLMachine machine(system, uncached);
+  for (auto it = uncached.begin(); it != uncached.end(); ++it) {
+    Scenario* expected = uncached.GetScenario(it->first);
+    Scenario* actual = cached.GetScenario(it->first);
+    ASSERT_EQ(expected->size(), actual->size());
+    for (libreallive::pointer_t i = 0; i < expected->size(); ++i) {
+      std::ostringstream expected_source, actual_source;
+      expected->GetElement(i)->PrintSourceRepresentation(&machine,
+                                                         expected_source);
+      actual->GetElement(i)->PrintSourceRepresentation(&machine,
+                                                       actual_source);
+      EXPECT_EQ(expected->GetElement(i)->GetBytecodeLength(),
+                actual->GetElement(i)->GetBytecodeLength());
+      EXPECT_EQ(expected_source.str(), actual_source.str());
+    }
+  }
+}
+
+std::string ReadWholeFile(const std::string& path) {
+  fs::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+}  // namespace
+
+TEST(ArchiveTest, ScenarioCacheRoundTrip) {
+  ScopedScratchPath cache;
+  std::string file = locateTestCase("Module_Jmp_SEEN/farcallTest_0.TXT");
+
+  {
+    Archive cold(file);
+    cold.UseScenarioCache(cache.str());
+    EXPECT_TRUE(cold.has_scenario_cache());
+    EXPECT_TRUE(fs::exists(cache.str()));
+  }
+
+  Archive warm(file);
+  warm.UseScenarioCache(cache.str());
+  EXPECT_TRUE(warm.has_scenario_cache());
+  ExpectSameAsUncached(file, warm);
+}
+
+// A cache built from one archive must not be used for another; it gets
+// rebuilt instead.
+TEST(ArchiveTest, ScenarioCacheRebuiltForDifferentArchive) {
+  ScopedScratchPath cache;
+  {
+    Archive first(locateTestCase("Module_Jmp_SEEN/farcallTest_0.TXT"));
+    first.UseScenarioCache(cache.str());
+  }
+
+  std::string file = locateTestCase("Module_Str_SEEN/strcpy_0.TXT");
+  Archive second(file);
+  second.UseScenarioCache(cache.str());
+  EXPECT_TRUE(second.has_scenario_cache());
+  ExpectSameAsUncached(file, second);
+}
+
+// Changing the archive in place must invalidate its cache: the stale entries
+// are rejected, the cache is rewritten, and the new scenarios are what run.
+TEST(ArchiveTest, ScenarioCacheRejectedWhenArchiveChanges) {
+  ScopedScratchPath cache;
+  ScopedScratchPath archive;
+  fs::copy_file(locateTestCase("Module_Jmp_SEEN/farcallTest_0.TXT"),
+                archive.str());
+  {
+    Archive original(archive.str());
+    original.UseScenarioCache(cache.str());
+    ASSERT_TRUE(original.has_scenario_cache());
+  }
+  std::string stale_cache = ReadWholeFile(cache.str());
+
+  fs::copy_file(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"),
+                archive.str(),
+                fs::copy_option::overwrite_if_exists);
+  Archive changed(archive.str());
+  changed.UseScenarioCache(cache.str());
+  EXPECT_TRUE(changed.has_scenario_cache());
+  EXPECT_NE(stale_cache, ReadWholeFile(cache.str()));
+  ExpectSameAsUncached(archive.str(), changed);
+}
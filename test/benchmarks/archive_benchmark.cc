@@ -0,0 +1,176 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+// -----------------------------------------------------------------------
+
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmarks/benchmark_utils.h"
+#include "libreallive/archive.h"
+#include "test_utils.h"
+
+namespace fs = boost::filesystem;
+
+using libreallive::Archive;
+
+namespace {
+
+const int kRepetitions = 50;
+
+// Number of scenarios in |archive|.
+int ScenarioCount(Archive& archive) {
+  int count = 0;
+  for (auto it = archive.begin(); it != archive.end(); ++it)
+    ++count;
+  return count;
+}
+
+// Touches every scenario in |archive| the way the VM does on a Jump/Farcall.
+void GetEveryScenario(Archive& archive) {
+  for (auto it = archive.begin(); it != archive.end(); ++it)
+    archive.GetScenario(it->first);
+}
+
+}  // namespace
+
+// How long the first jump to each scenario takes when nothing has been parsed
+// yet. This is the hitch players see when the VM first enters a SEEN.
+TEST(ArchiveBenchmark, ColdJumpLatency) {
+  std::vector<std::string> files = AllTestArchives();
+  int scenarios = 0;
+  double total = 0;
+  for (int i = 0; i < kRepetitions; ++i) {
+    for (const std::string& file : files) {
+      Archive archive(locateTestCase(file));
+      scenarios += ScenarioCount(archive);
+      total += NanosecondsPerIteration(1, [&]() { GetEveryScenario(archive); });
+    }
+  }
+
+  ReportBenchmark("ArchiveBenchmark.ColdJumpLatency", total / scenarios / 1000,
+                  "us/scenario");
+}
+
+// The same first jump, after a background preload has finished.
+TEST(ArchiveBenchmark, PreloadedJumpLatency) {
+  std::vector<std::string> files = AllTestArchives();
+  int scenarios = 0;
+  double total = 0;
+  for (int i = 0; i < kRepetitions; ++i) {
+    for (const std::string& file : files) {
+      Archive archive(locateTestCase(file));
+      archive.PreloadAllScenarios(0);
+      scenarios += ScenarioCount(archive);
+      total += NanosecondsPerIteration(1, [&]() { GetEveryScenario(archive); });
+    }
+  }
+
+  ReportBenchmark("ArchiveBenchmark.PreloadedJumpLatency",
+                  total / scenarios / 1000, "us/scenario");
+}
+
+// Startup throughput: open every test archive and preload all of them at
+// once, compared with parsing the same scenarios serially on one thread.
+TEST(ArchiveBenchmark, PreloadThroughput) {
+  std::vector<std::string> files = AllTestArchives();
+  int scenarios = 0;
+  double serial = 0;
+  double parallel = 0;
+  for (int i = 0; i < kRepetitions; ++i) {
+    std::vector<std::unique_ptr<Archive>> archives;
+    for (const std::string& file : files) {
+      archives.emplace_back(new Archive(locateTestCase(file)));
+      scenarios += ScenarioCount(*archives.back());
+    }
+
+    serial += NanosecondsPerIteration(1, [&]() {
+      for (auto& archive : archives)
+        GetEveryScenario(*archive);
+    });
+
+    archives.clear();
+    for (const std::string& file : files)
+      archives.emplace_back(new Archive(locateTestCase(file)));
+
+    parallel += NanosecondsPerIteration(1, [&]() {
+      for (auto& archive : archives)
+        archive->StartPreloading(0);
+      for (auto& archive : archives)
+        archive->WaitForPreload();
+    });
+  }
+
+  ReportBenchmark("ArchiveBenchmark.SerialParse",
+                  scenarios / (serial / 1e9), "scenarios/s");
+  ReportBenchmark("ArchiveBenchmark.PreloadParse",
+                  scenarios / (parallel / 1e9), "scenarios/s");
+}
+
+// Startup with the on disk scenario cache: opening each archive and touching
+// every scenario with no cache (the first run, which also writes the cache),
+// with a valid cache from a previous run, and with the cache turned off.
+TEST(ArchiveBenchmark, ScenarioCacheStartup) {
+  std::vector<std::string> files = AllTestArchives();
+  fs::path cache =
+      fs::temp_directory_path() / fs::unique_path("rlvm-bench-%%%%-%%%%");
+  int scenarios = 0;
+  double uncached = 0;
+  double cold = 0;
+  double warm = 0;
+  for (int i = 0; i < kRepetitions; ++i) {
+    for (const std::string& file : files) {
+      fs::remove(cache);
+      uncached += NanosecondsPerIteration(1, [&]() {
+        Archive archive(locateTestCase(file));
+        GetEveryScenario(archive);
+        scenarios += ScenarioCount(archive);
+      });
+      cold += NanosecondsPerIteration(1, [&]() {
+        Archive archive(locateTestCase(file));
+        archive.UseScenarioCache(cache.string());
+        GetEveryScenario(archive);
+      });
+      warm += NanosecondsPerIteration(1, [&]() {
+        Archive archive(locateTestCase(file));
+        archive.UseScenarioCache(cache.string());
+        GetEveryScenario(archive);
+      });
+    }
+  }
+  fs::remove(cache);
+
+  ReportBenchmark("ArchiveBenchmark.UncachedStartup",
+                  uncached / scenarios / 1000, "us/scenario");
+  ReportBenchmark("ArchiveBenchmark.ColdCacheStartup",
+                  cold / scenarios / 1000, "us/scenario");
+  ReportBenchmark("ArchiveBenchmark.WarmCacheStartup",
+                  warm / scenarios / 1000, "us/scenario");
+}
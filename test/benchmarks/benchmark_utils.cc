@@ -0,0 +1,62 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+// -----------------------------------------------------------------------
+
+
+#include "benchmarks/benchmark_utils.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "libreallive/archive.h"
+#include "libreallive/scenario.h"
+#include "test_utils.h"
+
+std::string LargestTestScenario(int* scenario) {
+  std::string largest_file;
+  long largest_size = -1;
+  for (const std::string& file : AllTestArchives()) {
+    libreallive::Archive archive(locateTestCase(file));
+    for (auto it = archive.begin(); it != archive.end(); ++it) {
+      libreallive::Scenario* seen = archive.GetScenario(it->first);
+      long size = seen->size();
+      if (size > largest_size) {
+        largest_size = size;
+        largest_file = file;
+        *scenario = it->first;
+      }
+    }
+  }
+
+  return largest_file;
+}
+
+void ReportBenchmark(const std::string& name,
+                     double value,
+                     const std::string& unit) {
+  std::cout << "[ BENCH ] " << name << ": " << value << " " << unit
+            << std::endl;
+}
@@ -0,0 +1,62 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+// -----------------------------------------------------------------------
+
+
+#ifndef TEST_BENCHMARKS_BENCHMARK_UTILS_H_
+#define TEST_BENCHMARKS_BENCHMARK_UTILS_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Finds the scenario with the most instructions in the test data, so that
+// benchmarks which work on a single scenario get the least trivial one there
+// is. Returns its archive (see AllTestArchives()) and stores its number in
+// |scenario|; ties go to the first one found. Parses every test scenario, so
+// call it once, outside the timed loop.
+std::string LargestTestScenario(int* scenario);
+
+// Prints one line of benchmark output in a format that's easy to grep and
+// diff between runs:
+//
+//   [ BENCH ] ArchiveBenchmark.ColdJump: 12.34 us/scenario
+void ReportBenchmark(const std::string& name,
+                     double value,
+                     const std::string& unit);
+
+// Runs |fn| |iterations| times and returns the mean wall time of one call in
+// nanoseconds.
+template <typename Function>
+double NanosecondsPerIteration(int iterations, Function fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i)
+    fn();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         iterations;
+}
+
+#endif  // TEST_BENCHMARKS_BENCHMARK_UTILS_H_
@@ -0,0 +1,73 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+// -----------------------------------------------------------------------
+
+
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "benchmarks/benchmark_utils.h"
+#include "libreallive/archive.h"
+#include "libreallive/compression.h"
+#include "libreallive/scenario.h"
+#include "test_utils.h"
+
+using libreallive::Archive;
+using libreallive::read_i32;
+
+namespace {
+
+const int kRepetitions = 2000;
+
+}  // namespace
+
+// Raw Decompress() throughput over every scenario in the test data, measured
+// in bytes of decompressed bytecode. The test scenarios are small, so this
+// includes a fair amount of per call overhead.
+TEST(CompressionBenchmark, DecompressThroughput) {
+  double total = 0;
+  double bytes = 0;
+  for (const std::string& file : AllTestArchives()) {
+    Archive archive(locateTestCase(file));
+    for (auto it = archive.begin(); it != archive.end(); ++it) {
+      const char* data = it->second.data;
+      std::vector<char> output(read_i32(data + 0x24));
+      total += kRepetitions * NanosecondsPerIteration(kRepetitions, [&]() {
+        libreallive::compression::Decompress(data + read_i32(data + 0x20),
+                                             read_i32(data + 0x28),
+                                             output.data(),
+                                             output.size(),
+                                             NULL);
+      });
+      bytes += static_cast<double>(output.size()) * kRepetitions;
+    }
+  }
+
+  ReportBenchmark("CompressionBenchmark.DecompressThroughput",
+                  bytes / total * 1000, "MB/s");
+}
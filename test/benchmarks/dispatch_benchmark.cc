@@ -0,0 +1,194 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+// -----------------------------------------------------------------------
+
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <vector>
+
+#include "benchmarks/benchmark_utils.h"
+#include "libreallive/archive.h"
+#include "libreallive/bytecode.h"
+#include "libreallive/intmemref.h"
+#include "libreallive/scenario.h"
+#include "machine/rlmachine.h"
+#include "modules/module_jmp.h"
+#include "modules/module_str.h"
+#include "modules/modules.h"
+#include "test_system/test_system.h"
+#include "test_utils.h"
+
+using libreallive::Archive;
+using libreallive::CommandElement;
+using libreallive::IntMemRef;
+
+namespace {
+
+const int kRuns = 20;
+const int kUnimplementedRuns = 2000;
+const int kIterations = 1000000;
+
+// Computes fib(intD[0]) recursively with gosub_with()/ret_with(); see the
+// listing above LargeJmpTest.fibonacci. Nearly every instruction is a jump
+// module command or an expression, so this is mostly interpreter overhead.
+const char kFibonacci[] = "Module_Jmp_SEEN/fibonacci.TXT";
+const int kFibonacciInput = 16;
+
+// Big enough that computing it takes several time slices.
+const int kSlicedFibonacciInput = 22;
+const std::chrono::milliseconds kSlice(10);
+
+// Computes fib(kSlicedFibonacciInput) in kSlice long slices, each run by
+// |run_slice|, and returns the mean number of instructions in a slice. The
+// last slice, which is cut short by the machine halting, isn't counted.
+template <typename RunSlice>
+double InstructionsPerSlice(RunSlice run_slice) {
+  Archive archive(locateTestCase(kFibonacci));
+  TestSystem system;
+  RLMachine machine(system, archive);
+  machine.AttachModule(new JmpModule);
+  machine.AttachModule(new StrModule);
+  machine.SetIntValue(IntMemRef('D', 0), kSlicedFibonacciInput);
+
+  long long instructions = 0;
+  int slices = 0;
+  while (true) {
+    int executed = run_slice(machine);
+    if (machine.halted())
+      break;
+    instructions += executed;
+    slices++;
+  }
+  return slices ? static_cast<double>(instructions) / slices : 0;
+}
+
+}  // namespace
+
+// Instructions per second while running fibonacci headless, with nothing but
+// the interpreter loop between instructions.
+TEST(DispatchBenchmark, Fibonacci) {
+  Archive archive(locateTestCase(kFibonacci));
+  TestSystem system;
+
+  long long instructions = 0;
+  std::chrono::steady_clock::duration elapsed(0);
+  for (int i = 0; i < kRuns; ++i) {
+    RLMachine machine(system, archive);
+    machine.AttachModule(new JmpModule);
+    machine.AttachModule(new StrModule);
+    machine.SetIntValue(IntMemRef('D', 0), kFibonacciInput);
+
+    auto start = std::chrono::steady_clock::now();
+    while (!machine.halted()) {
+      machine.ExecuteNextInstruction();
+      instructions++;
+    }
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  ReportBenchmark("DispatchBenchmark.Fibonacci",
+                  instructions / seconds / 1e6,
+                  "M instructions/s");
+}
+
+// Resolving a command to its RLOperation with every module attached, which is
+// what ExecuteCommand() does the first time it sees a command.
+TEST(DispatchBenchmark, GetOperation) {
+  Archive archive(locateTestCase(kFibonacci));
+  TestSystem system;
+  RLMachine machine(system, archive);
+  AddAllModules(machine);
+
+  std::vector<const CommandElement*> commands;
+  libreallive::Scenario* scenario = archive.GetScenario(1);
+  for (size_t i = 0; i < scenario->size(); ++i) {
+    const CommandElement* command =
+        dynamic_cast<const CommandElement*>(scenario->GetElement(i));
+    if (command)
+      commands.push_back(command);
+  }
+  ASSERT_FALSE(commands.empty());
+
+  size_t i = 0;
+  ReportBenchmark("DispatchBenchmark.GetOperation",
+                  NanosecondsPerIteration(kIterations, [&]() {
+                    machine.GetOperation(*commands[i++ % commands.size()]);
+                  }),
+                  "ns/lookup");
+}
+
+// How much a 10ms slice of the main loop gets through, with the clock read
+// after every instruction (as RLVMInstance::Run() used to) and with
+// RLMachine::ExecuteSlice().
+TEST(DispatchBenchmark, InstructionsPerSlice) {
+  ReportBenchmark(
+      "DispatchBenchmark.InstructionsPerSlice.ClockPerInstruction",
+      InstructionsPerSlice([](RLMachine& machine) {
+        auto start = std::chrono::steady_clock::now();
+        int executed = 0;
+        do {
+          machine.ExecuteNextInstruction();
+          executed++;
+        } while (!machine.halted() &&
+                 std::chrono::steady_clock::now() - start < kSlice);
+        return executed;
+      }),
+      "instructions/slice");
+
+  ReportBenchmark(
+      "DispatchBenchmark.InstructionsPerSlice.ExecuteSlice",
+      InstructionsPerSlice(
+          [](RLMachine& machine) { return machine.ExecuteSlice(kSlice); }),
+      "instructions/slice");
+}
+
+// Runs fibonacci.TXT with no modules attached, so every command in it is an
+// unimplemented opcode that gets skipped, and reports the mean time per
+// instruction.
+TEST(DispatchBenchmark, UnimplementedOpcodes) {
+  Archive archive(locateTestCase(kFibonacci));
+  TestSystem system;
+
+  long long instructions = 0;
+  std::chrono::steady_clock::duration elapsed(0);
+  for (int i = 0; i < kUnimplementedRuns; ++i) {
+    RLMachine machine(system, archive);
+
+    auto start = std::chrono::steady_clock::now();
+    while (!machine.halted()) {
+      machine.ExecuteNextInstruction();
+      instructions++;
+    }
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+
+  ReportBenchmark(
+      "DispatchBenchmark.UnimplementedOpcodes",
+      std::chrono::duration<double, std::nano>(elapsed).count() / instructions,
+      "ns/instruction");
+}
@@ -0,0 +1,110 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+// -----------------------------------------------------------------------
+
+
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "benchmarks/benchmark_utils.h"
+#include "libreallive/archive.h"
+#include "libreallive/bytecode.h"
+#include "libreallive/expression.h"
+#include "libreallive/scenario.h"
+#include "machine/rlmachine.h"
+#include "test_system/test_system.h"
+#include "test_utils.h"
+
+using libreallive::Archive;
+using libreallive::ExpressionElement;
+using libreallive::Scenario;
+
+namespace {
+
+const int kRepetitions = 20000;
+
+const char* kExpressionTests[] = {
+    "ExpressionTest_SEEN/basicOperators.TXT",
+    "ExpressionTest_SEEN/comparisonOperators.TXT",
+    "ExpressionTest_SEEN/logicalOperators.TXT",
+    "ExpressionTest_SEEN/previousErrors.TXT",
+    NULL};
+
+// Times every expression statement in the expression test scenarios, each
+// evaluated through |evaluate|, and returns the mean time of one evaluation
+// in nanoseconds.
+template <typename Function>
+double TimeExpressions(Function evaluate) {
+  TestSystem system;
+  double total = 0;
+  long count = 0;
+  for (const char** test = kExpressionTests; *test; ++test) {
+    Archive archive(locateTestCase(*test));
+    RLMachine machine(system, archive);
+    Scenario* scenario = archive.GetScenario(archive.begin()->first);
+
+    std::vector<const ExpressionElement*> expressions;
+    for (auto const* element : *scenario) {
+      auto expression = dynamic_cast<const ExpressionElement*>(element);
+      if (expression)
+        expressions.push_back(expression);
+    }
+
+    total += NanosecondsPerIteration(kRepetitions, [&]() {
+      for (const ExpressionElement* expression : expressions)
+        evaluate(machine, *expression);
+    }) * kRepetitions;
+    count += expressions.size() * kRepetitions;
+  }
+
+  return total / count;
+}
+
+}  // namespace
+
+// Evaluating the expression statements of the ExpressionTest scenarios by
+// walking the parsed ExpressionPiece trees, as all parameters still are.
+TEST(ExpressionBenchmark, TreeEvaluation) {
+  ReportBenchmark("ExpressionBenchmark.TreeEvaluation",
+                  TimeExpressions([](RLMachine& machine,
+                                     const ExpressionElement& expression) {
+                    expression.ParsedExpression().GetIntegerValue(machine);
+                  }),
+                  "ns/expression");
+}
+
+// The same expressions through the compiled stack code that
+// RLMachine::ExecuteExpression() uses.
+TEST(ExpressionBenchmark, CompiledEvaluation) {
+  ReportBenchmark("ExpressionBenchmark.CompiledEvaluation",
+                  TimeExpressions([](RLMachine& machine,
+                                     const ExpressionElement& expression) {
+                    expression.Evaluate(machine);
+                  }),
+                  "ns/expression");
+}
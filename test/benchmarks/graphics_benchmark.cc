@@ -0,0 +1,72 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+// -----------------------------------------------------------------------
+
+
+#include "gtest/gtest.h"
+
+#include "benchmarks/benchmark_utils.h"
+#include "libreallive/archive.h"
+#include "machine/rlmachine.h"
+#include "systems/base/graphics_object.h"
+#include "systems/base/graphics_object_of_file.h"
+#include "systems/base/graphics_system.h"
+#include "test_system/test_system.h"
+#include "utilities/lazy_array.h"
+#include "test_utils.h"
+
+using libreallive::Archive;
+
+namespace {
+
+const int kSnapshots = 20000;
+
+// How many foreground objects a busy scene has set up.
+const int kObjects = 100;
+
+}  // namespace
+
+// A savepoint with kObjects foreground objects, where each line of text moves
+// one of them, as a scene with a few sprites does.
+TEST(GraphicsBenchmark, TakeSavepointSnapshot) {
+  Archive archive(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  TestSystem system;
+  RLMachine machine(system, archive);
+  GraphicsSystem& graphics = system.graphics();
+  LazyArray<GraphicsObject>& objects = graphics.GetForegroundObjects();
+  for (int i = 0; i < kObjects; ++i) {
+    objects[i].SetObjectData(new GraphicsObjectOfFile(system, "image"));
+    objects[i].SetVisible(1);
+  }
+
+  int i = 0;
+  ReportBenchmark("GraphicsBenchmark.TakeSavepointSnapshot",
+                  NanosecondsPerIteration(kSnapshots, [&]() {
+                    objects[i % kObjects].SetX(i);
+                    graphics.TakeSavepointSnapshot();
+                    ++i;
+                  }),
+                  "ns/snapshot");
+}
@@ -0,0 +1,97 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+// -----------------------------------------------------------------------
+
+
+#include "gtest/gtest.h"
+
+#include "benchmarks/benchmark_utils.h"
+#include "libreallive/archive.h"
+#include "libreallive/scenario.h"
+#include "machine/rlmachine.h"
+#include "test_system/test_system.h"
+#include "test_utils.h"
+
+using libreallive::Archive;
+
+namespace {
+
+const int kIterations = 1000000;
+
+// SEEN0001 farcalls into one of the three entrypoints of SEEN0002, which
+// returns straight away.
+const char kFarcallTest[] = "Module_Jmp_SEEN/farcallTest_0.TXT";
+
+}  // namespace
+
+// Looking up an already parsed scenario by number, as every jump and farcall
+// does first.
+TEST(JumpBenchmark, GetScenario) {
+  Archive archive(locateTestCase(kFarcallTest));
+  archive.GetScenario(1);
+  archive.GetScenario(2);
+
+  int i = 0;
+  ReportBenchmark("JumpBenchmark.GetScenario",
+                  NanosecondsPerIteration(kIterations, [&]() {
+                    archive.GetScenario(1 + (i++ & 1));
+                  }),
+                  "ns/lookup");
+}
+
+// The farcall(2, n) / ret pair from farcallTest, cycling through the
+// entrypoints.
+TEST(JumpBenchmark, FarcallAndReturn) {
+  Archive archive(locateTestCase(kFarcallTest));
+  TestSystem system;
+  RLMachine machine(system, archive);
+
+  int i = 0;
+  ReportBenchmark("JumpBenchmark.FarcallAndReturn",
+                  NanosecondsPerIteration(kIterations, [&]() {
+                    machine.Farcall(2, 1 + (i++ % 3));
+                    machine.ReturnFromFarcall();
+                  }),
+                  "ns/call");
+}
+
+// jump(2, n), bouncing between the entrypoints of SEEN0002 and the start of
+// SEEN0001.
+TEST(JumpBenchmark, Jump) {
+  Archive archive(locateTestCase(kFarcallTest));
+  TestSystem system;
+  RLMachine machine(system, archive);
+
+  int i = 0;
+  ReportBenchmark("JumpBenchmark.Jump",
+                  NanosecondsPerIteration(kIterations, [&]() {
+                    int n = i++ % 4;
+                    if (n == 0)
+                      machine.Jump(1, 0);
+                    else
+                      machine.Jump(2, n);
+                  }),
+                  "ns/jump");
+}
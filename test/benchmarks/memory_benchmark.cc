@@ -0,0 +1,192 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+// -----------------------------------------------------------------------
+
+
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmarks/benchmark_utils.h"
+#include "libreallive/alldefs.h"
+#include "libreallive/archive.h"
+#include "libreallive/bytecode.h"
+#include "libreallive/compiled_expression.h"
+#include "libreallive/expression.h"
+#include "libreallive/intmemref.h"
+#include "machine/memory.h"
+#include "machine/rlmachine.h"
+#include "modules/module_mem.h"
+#include "test_system/test_system.h"
+#include "test_utils.h"
+
+using libreallive::Archive;
+using libreallive::CommandElement;
+using libreallive::IntMemRef;
+
+namespace {
+
+const int kIterations = 1000000;
+
+// Roughly how many variables a scene touches between two savepoints.
+const int kWritesPerSavepoint = 500;
+
+const char kBanks[] = {'A', 'B', 'C', 'D', 'E', 'F'};
+
+const int kMemIterations = 20000;
+
+// Builds the Mem module command |opcode|, |overload| (1:11:opcode) with
+// |parameters|, which are in the form PrintableToParsableString() takes.
+std::unique_ptr<CommandElement> BuildMemCommand(
+    int opcode,
+    int overload,
+    const std::vector<std::string>& parameters) {
+  std::string repr(8, '\0');
+  repr[0] = '#';
+  repr[1] = 1;
+  repr[2] = 11;
+  libreallive::insert_i16(repr, 3, opcode);
+  libreallive::insert_i16(repr, 5, parameters.size());
+  repr[7] = overload;
+
+  repr += '(';
+  for (const std::string& parameter : parameters)
+    repr += libreallive::PrintableToParsableString(parameter);
+  repr += ')';
+  return std::unique_ptr<CommandElement>(
+      libreallive::BuildFunctionElement(repr.c_str()));
+}
+
+// intA[0] and intA[1999].
+const char kFirstOfBankA[] = "$ 00 [ $ FF 00 00 00 00 ]";
+const char kLastOfBankA[] = "$ 00 [ $ FF CF 07 00 00 ]";
+
+}  // namespace
+
+// Writes to local integer memory, spread over the banks, with a savepoint
+// every kWritesPerSavepoint writes.
+TEST(MemoryBenchmark, SetIntValue) {
+  Archive archive(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  TestSystem system;
+  RLMachine machine(system, archive);
+  Memory& memory = machine.memory();
+
+  int i = 0;
+  ReportBenchmark("MemoryBenchmark.SetIntValue",
+                  NanosecondsPerIteration(kIterations, [&]() {
+                    IntMemRef ref(kBanks[i % 6], (i * 7) % SIZE_OF_MEM_BANK);
+                    memory.SetIntValue(ref, i);
+                    if (++i % kWritesPerSavepoint == 0)
+                      memory.TakeSavepointSnapshot();
+                  }),
+                  "ns/write");
+}
+
+// The same for strS[].
+TEST(MemoryBenchmark, SetStringValue) {
+  Archive archive(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  TestSystem system;
+  RLMachine machine(system, archive);
+  Memory& memory = machine.memory();
+
+  const std::string value = "A short line of dialogue";
+  int i = 0;
+  ReportBenchmark("MemoryBenchmark.SetStringValue",
+                  NanosecondsPerIteration(kIterations, [&]() {
+                    memory.SetStringValue(libreallive::STRS_LOCATION,
+                                          (i * 7) % SIZE_OF_MEM_BANK,
+                                          value);
+                    if (++i % kWritesPerSavepoint == 0)
+                      memory.TakeSavepointSnapshot();
+                  }),
+                  "ns/write");
+}
+
+// setrng(intA[0], intA[1999], 5), through the opcode.
+TEST(MemoryBenchmark, SetrngWholeBank) {
+  Archive archive(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  TestSystem system;
+  RLMachine machine(system, archive);
+  machine.AttachModule(new MemModule);
+  std::unique_ptr<CommandElement> setrng = BuildMemCommand(
+      1, 1, {kFirstOfBankA, kLastOfBankA, "$ FF 05 00 00 00"});
+
+  ReportBenchmark("MemoryBenchmark.SetrngWholeBank",
+                  NanosecondsPerIteration(kMemIterations, [&]() {
+                    machine.ExecuteCommand(*setrng);
+                  }),
+                  "ns/call");
+  EXPECT_EQ(5, machine.GetIntValue(IntMemRef('A', 1999)));
+}
+
+// sum(intA[0], intA[1999]), through the opcode.
+TEST(MemoryBenchmark, SumWholeBank) {
+  Archive archive(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  TestSystem system;
+  RLMachine machine(system, archive);
+  machine.AttachModule(new MemModule);
+  for (int i = 0; i < SIZE_OF_MEM_BANK; ++i)
+    machine.SetIntValue(IntMemRef('A', i), i);
+  std::unique_ptr<CommandElement> sum =
+      BuildMemCommand(100, 0, {kFirstOfBankA, kLastOfBankA});
+
+  ReportBenchmark("MemoryBenchmark.SumWholeBank",
+                  NanosecondsPerIteration(kMemIterations, [&]() {
+                    machine.ExecuteCommand(*sum);
+                  }),
+                  "ns/call");
+  EXPECT_EQ(1999 * 2000 / 2, machine.store_register());
+}
+
+// intAb[intC[0]] + intA2b[intC[0]] + intA4b[intC[0]] + intA8b[intC[0]], the
+// shape of a script testing flags, through the compiled expression.
+TEST(MemoryBenchmark, CompiledBitPackedReads) {
+  Archive archive(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  TestSystem system;
+  RLMachine machine(system, archive);
+  machine.SetIntValue(IntMemRef('C', 0), 1234);
+  for (int i = 0; i < SIZE_OF_MEM_BANK; ++i)
+    machine.SetIntValue(IntMemRef('A', i), 0x5a5a5a5a ^ i);
+
+  std::string parsable = libreallive::PrintableToParsableString(
+      "$ 1a [ $ 02 [ $ ff 00 00 00 00 ] ] 5c 00 "
+      "$ 34 [ $ 02 [ $ ff 00 00 00 00 ] ] 5c 00 "
+      "$ 4e [ $ 02 [ $ ff 00 00 00 00 ] ] 5c 00 "
+      "$ 68 [ $ 02 [ $ ff 00 00 00 00 ] ]");
+  const char* start = parsable.c_str();
+  libreallive::ExpressionPiece piece(libreallive::GetExpression(start));
+  libreallive::CompiledExpression program(piece);
+  ASSERT_TRUE(program.is_valid());
+
+  int total = 0;
+  ReportBenchmark("MemoryBenchmark.CompiledBitPackedReads",
+                  NanosecondsPerIteration(kIterations, [&]() {
+                    total += program.Run(machine);
+                  }),
+                  "ns/expression");
+  EXPECT_EQ(piece.GetIntegerValue(machine) * kIterations, total);
+}
@@ -0,0 +1,251 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+// -----------------------------------------------------------------------
+
+
+#include "gtest/gtest.h"
+
+#include <sstream>
+#include <string>
+
+#include "benchmarks/benchmark_utils.h"
+#include "libreallive/archive.h"
+#include "libreallive/intmemref.h"
+#include "machine/global_memory_journal.h"
+#include "machine/memory.h"
+#include "machine/rlmachine.h"
+#include "machine/save_codec.h"
+#include "machine/serialization.h"
+#include "systems/base/graphics_object.h"
+#include "systems/base/graphics_system.h"
+#include "test_system/test_system.h"
+#include "utilities/lazy_array.h"
+#include "test_utils.h"
+
+using libreallive::Archive;
+using libreallive::IntMemRef;
+using Serialization::SaveCompression;
+using Serialization::SaveFormat;
+
+namespace {
+
+const int kSaves = 50;
+
+// How many foreground objects a busy scene has set up.
+const int kObjects = 100;
+
+const char kLocalBanks[] = {'A', 'B', 'C', 'D', 'E', 'F'};
+const char kGlobalBanks[] = {'G', 'Z'};
+
+// Fills memory the way a game some hours in has it: every bank written, a
+// line of text in each string variable, a few thousand lines marked as read
+// and a screen of positioned objects. (The objects have no data since loading
+// a file needs real surfaces.)
+void FillMachine(RLMachine& machine) {
+  for (char bank : kLocalBanks) {
+    for (int i = 0; i < SIZE_OF_MEM_BANK; ++i)
+      machine.SetIntValue(IntMemRef(bank, i), (i * 7919) % 10007);
+  }
+  for (char bank : kGlobalBanks) {
+    for (int i = 0; i < SIZE_OF_MEM_BANK; ++i)
+      machine.SetIntValue(IntMemRef(bank, i), i % 3);
+  }
+
+  Memory& memory = machine.memory();
+  for (int i = 0; i < SIZE_OF_MEM_BANK; ++i) {
+    const std::string line = "A line of dialogue " + std::to_string(i);
+    memory.SetStringValue(libreallive::STRS_LOCATION, i, line);
+    memory.SetStringValue(libreallive::STRM_LOCATION, i, line);
+  }
+  for (int scene = 0; scene < 50; ++scene) {
+    for (int line = 0; line < 200; ++line)
+      memory.RecordKidoku(scene, line);
+  }
+
+  System& system = machine.system();
+  LazyArray<GraphicsObject>& objects =
+      system.graphics().GetForegroundObjects();
+  for (int i = 0; i < kObjects; ++i) {
+    objects[i].SetVisible(1);
+    objects[i].SetX(i);
+    objects[i].SetY(i * 2);
+    objects[i].SetAlpha(i);
+  }
+
+  machine.MarkSavepoint();
+}
+
+// Reports the time to save and load a game and the global memory in
+// |format| with |compression|, and the size of each compressed file.
+void BenchmarkFormat(const std::string& format_name,
+                     SaveFormat format,
+                     SaveCompression compression) {
+  Archive archive(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  TestSystem system;
+  RLMachine machine(system, archive);
+  FillMachine(machine);
+
+  std::string game;
+  ReportBenchmark("SaveBenchmark.SaveGame" + format_name,
+                  NanosecondsPerIteration(kSaves, [&]() {
+                    std::ostringstream oss;
+                    Serialization::saveGameTo(oss, machine, format,
+                                              compression);
+                    game = oss.str();
+                  }) / 1000,
+                  "us/save");
+  ReportBenchmark("SaveBenchmark.GameSize" + format_name, game.size(),
+                  "bytes");
+  ReportBenchmark("SaveBenchmark.LoadGame" + format_name,
+                  NanosecondsPerIteration(kSaves, [&]() {
+                    std::istringstream iss(game);
+                    Serialization::loadGameFrom(iss, machine);
+                  }) / 1000,
+                  "us/load");
+  EXPECT_EQ(7919, machine.GetIntValue(IntMemRef('A', 1)));
+
+  std::string global;
+  ReportBenchmark("SaveBenchmark.SaveGlobalMemory" + format_name,
+                  NanosecondsPerIteration(kSaves, [&]() {
+                    std::ostringstream oss;
+                    Serialization::saveGlobalMemoryTo(oss, machine, format,
+                                                      compression);
+                    global = oss.str();
+                  }) / 1000,
+                  "us/save");
+  ReportBenchmark("SaveBenchmark.GlobalMemorySize" + format_name,
+                  global.size(),
+                  "bytes");
+  ReportBenchmark("SaveBenchmark.LoadGlobalMemory" + format_name,
+                  NanosecondsPerIteration(kSaves, [&]() {
+                    std::istringstream iss(global);
+                    Serialization::loadGlobalMemoryFrom(iss, machine);
+                  }) / 1000,
+                  "us/load");
+  EXPECT_TRUE(machine.memory().HasBeenRead(49, 199));
+}
+
+// Reports the time |compression| takes to compress and decompress the
+// uncompressed binary archives of the game and global memory, apart from the
+// time spent building them.
+void BenchmarkCodec(const std::string& codec_name,
+                    SaveCompression compression) {
+  Archive archive(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  TestSystem system;
+  RLMachine machine(system, archive);
+  FillMachine(machine);
+
+  std::ostringstream snapshot;
+  Serialization::snapshotGameTo(
+      snapshot, machine, Serialization::SAVE_FORMAT_BINARY);
+  Serialization::snapshotGlobalMemoryTo(
+      snapshot, machine, Serialization::SAVE_FORMAT_BINARY);
+  const std::string uncompressed = snapshot.str();
+  const SaveCodec& codec = SaveCodec::For(compression);
+
+  std::string compressed;
+  ReportBenchmark("SaveBenchmark.Compress" + codec_name,
+                  NanosecondsPerIteration(kSaves, [&]() {
+                    std::ostringstream oss;
+                    {
+                      SaveCodec::OutputStream output;
+                      codec.PushCompressor(output);
+                      output.push(oss);
+                      output.write(uncompressed.data(), uncompressed.size());
+                    }
+                    compressed = oss.str();
+                  }) / 1000,
+                  "us/save");
+  ReportBenchmark("SaveBenchmark.CompressedSize" + codec_name,
+                  compressed.size(),
+                  "bytes");
+
+  std::string decompressed(uncompressed.size(), '\0');
+  ReportBenchmark("SaveBenchmark.Decompress" + codec_name,
+                  NanosecondsPerIteration(kSaves, [&]() {
+                    std::istringstream iss(compressed);
+                    SaveCodec::InputStream input;
+                    SaveCodec::Detect(iss).PushDecompressor(input);
+                    input.push(iss);
+                    input.read(&decompressed[0], decompressed.size());
+                  }) / 1000,
+                  "us/load");
+  EXPECT_EQ(uncompressed, decompressed);
+}
+
+}  // namespace
+
+// Save games and global memory as zlib compressed text archives, the format
+// rlvm has always written.
+TEST(SaveBenchmark, TextArchive) {
+  BenchmarkFormat("Text", Serialization::SAVE_FORMAT_TEXT,
+                  Serialization::SAVE_COMPRESSION_ZLIB);
+}
+
+// The same data as binary archives.
+TEST(SaveBenchmark, BinaryArchive) {
+  BenchmarkFormat("Binary", Serialization::SAVE_FORMAT_BINARY,
+                  Serialization::SAVE_COMPRESSION_ZLIB);
+}
+
+// Binary archives with the LZ codec, what quicksaves are written with.
+TEST(SaveBenchmark, BinaryArchiveLz) {
+  BenchmarkFormat("BinaryLz", Serialization::SAVE_FORMAT_BINARY,
+                  Serialization::SAVE_COMPRESSION_LZ);
+}
+
+// Just the compression, for the archives of a game a few hours in.
+TEST(SaveBenchmark, Codecs) {
+  BenchmarkCodec("Zlib", Serialization::SAVE_COMPRESSION_ZLIB);
+  BenchmarkCodec("Lz", Serialization::SAVE_COMPRESSION_LZ);
+}
+
+// What persisting global memory costs with the journal: a record of what a
+// scene typically changes between two journalGlobalMemory() calls, against
+// the SaveGlobalMemory numbers above.
+TEST(SaveBenchmark, GlobalMemoryJournal) {
+  Archive archive(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  TestSystem system;
+  RLMachine machine(system, archive);
+  FillMachine(machine);
+
+  const GlobalMemory& global = machine.memory().global();
+  GlobalMemoryJournal journal;
+  journal.SetBaseline(global, "settings", 0);
+
+  int i = 0;
+  ReportBenchmark("SaveBenchmark.JournalGlobalMemory",
+                  NanosecondsPerIteration(kSaves, [&]() {
+                    for (int j = 0; j < 20; ++j, ++i) {
+                      machine.SetIntValue(IntMemRef('G', i % 2000), i);
+                      machine.memory().RecordKidoku(50 + i / 200, i % 200);
+                    }
+                    journal.Record(global, "settings");
+                  }) / 1000,
+                  "us/record");
+  ReportBenchmark("SaveBenchmark.JournalRecordSize",
+                  static_cast<double>(journal.size()) / kSaves,
+                  "bytes");
+}
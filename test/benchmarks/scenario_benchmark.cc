@@ -0,0 +1,185 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+// -----------------------------------------------------------------------
+
+
+#include "gtest/gtest.h"
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "benchmarks/benchmark_utils.h"
+#include "libreallive/archive.h"
+#include "libreallive/scenario.h"
+#include "machine/rlmachine.h"
+#include "machine/serialization.h"
+#include "machine/stack_frame.h"
+#include "test_system/test_system.h"
+#include "test_utils.h"
+
+using libreallive::Archive;
+using libreallive::Scenario;
+
+namespace {
+
+const int kRepetitions = 200;
+const int kSerializationIterations = 20000;
+
+// Bytes currently handed out by the allocator, or -1 when the platform gives
+// us no way of asking.
+long HeapBytesInUse() {
+#if defined(__GLIBC__)
+  return mallinfo2().uordblks;
+#else
+  return -1;
+#endif
+}
+
+}  // namespace
+
+// Time to parse one scenario into bytecode elements, averaged over every
+// scenario in the test data.
+TEST(ScenarioBenchmark, ParseTime) {
+  std::vector<std::string> files = AllTestArchives();
+  long scenarios = 0;
+  long instructions = 0;
+  double total = 0;
+  for (int i = 0; i < kRepetitions; ++i) {
+    for (const std::string& file : files) {
+      Archive archive(locateTestCase(file));
+      for (auto it = archive.begin(); it != archive.end(); ++it) {
+        Scenario* scenario = NULL;
+        total += NanosecondsPerIteration(
+            1, [&]() { scenario = archive.GetScenario(it->first); });
+        scenarios++;
+        instructions += scenario->size();
+      }
+    }
+  }
+
+  ReportBenchmark("ScenarioBenchmark.ParseTime", total / scenarios / 1000,
+                  "us/scenario");
+  ReportBenchmark("ScenarioBenchmark.ParseTimePerInstruction",
+                  total / instructions, "ns/instruction");
+}
+
+// Time to build the largest test scenario from already decompressed bytecode,
+// which is mostly reading elements and resolving their jump targets.
+TEST(ScenarioBenchmark, ParseLargestScenario) {
+  int scene = 0;
+  Archive archive(locateTestCase(LargestTestScenario(&scene)));
+  libreallive::FilePos file;
+  for (auto it = archive.begin(); it != archive.end(); ++it) {
+    if (it->first == scene)
+      file = it->second;
+  }
+
+  std::vector<char> bytecode;
+  libreallive::DecompressScenario(file, "", NULL, &bytecode);
+  libreallive::FilePos decompressed(bytecode.data(), bytecode.size());
+
+  size_t instructions = 0;
+  double time = NanosecondsPerIteration(kRepetitions * 10, [&]() {
+    Scenario scenario(file, scene, "", NULL, decompressed);
+    instructions = scenario.size();
+  });
+
+  ReportBenchmark("ScenarioBenchmark.ParseLargestScenario", time / 1000,
+                  "us/scenario");
+  ReportBenchmark("ScenarioBenchmark.ParseLargestScenarioPerInstruction",
+                  time / instructions, "ns/instruction");
+}
+
+// Heap held by a parsed scenario, measured as the allocator's growth across
+// the parse.
+TEST(ScenarioBenchmark, ResidentMemory) {
+  if (HeapBytesInUse() < 0)
+    return;
+
+  long scenarios = 0;
+  long instructions = 0;
+  long bytes = 0;
+  for (const std::string& file : AllTestArchives()) {
+    Archive archive(locateTestCase(file));
+    for (auto it = archive.begin(); it != archive.end(); ++it) {
+      long before = HeapBytesInUse();
+      Scenario* scenario = archive.GetScenario(it->first);
+      bytes += HeapBytesInUse() - before;
+      scenarios++;
+      instructions += scenario->size();
+    }
+  }
+
+  ReportBenchmark("ScenarioBenchmark.ResidentMemory",
+                  static_cast<double>(bytes) / scenarios, "bytes/scenario");
+  ReportBenchmark("ScenarioBenchmark.ResidentMemoryPerInstruction",
+                  static_cast<double>(bytes) / instructions,
+                  "bytes/instruction");
+}
+
+// Saving and restoring a call stack frame whose instruction pointer sits on
+// the last instruction of the largest test scenario, which is the worst case
+// for translating between instruction pointers and save file offsets.
+TEST(ScenarioBenchmark, StackFrameSaveLoad) {
+  int scene = 0;
+  Archive archive(locateTestCase(LargestTestScenario(&scene)));
+  TestSystem system(locateTestCase("Gameexe_data/Gameexe.ini"));
+  RLMachine machine(system, archive);
+  Serialization::g_current_machine = &machine;
+
+  Scenario* scenario = archive.GetScenario(scene);
+  StackFrame frame(scenario, scenario->size() - 1, StackFrame::TYPE_FARCALL);
+
+  std::string saved;
+  double save = NanosecondsPerIteration(kSerializationIterations, [&]() {
+    std::ostringstream oss;
+    {
+      boost::archive::text_oarchive oa(oss);
+      oa << const_cast<const StackFrame&>(frame);
+    }
+    saved = oss.str();
+  });
+
+  double load = NanosecondsPerIteration(kSerializationIterations, [&]() {
+    std::istringstream iss(saved);
+    boost::archive::text_iarchive ia(iss);
+    StackFrame loaded;
+    ia >> loaded;
+  });
+
+  Serialization::g_current_machine = NULL;
+
+  ReportBenchmark("ScenarioBenchmark.StackFrameSave", save / 1000, "us/frame");
+  ReportBenchmark("ScenarioBenchmark.StackFrameLoad", load / 1000, "us/frame");
+}
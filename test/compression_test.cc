@@ -0,0 +1,129 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "libreallive/archive.h"
+#include "libreallive/compression.h"
+#include "libreallive/intmemref.h"
+#include "libreallive/scenario.h"
+#include "machine/rlmachine.h"
+#include "modules/module_jmp.h"
+#include "test_system/test_system.h"
+#include "utilities/exception.h"
+#include "test_utils.h"
+
+using libreallive::Archive;
+using libreallive::FilePos;
+using libreallive::Header;
+using libreallive::IntMemRef;
+
+namespace {
+
+// Module_Jmp_SEEN/fibonacci.TXT, rebuilt by make_fibonacci.py as compiler
+// version 110002 with CLANNAD Full Voice's second level xor applied. Its
+// bytecode is long enough to be covered by the whole key.
+const char kSecondLevelXorFixture[] = "XorKey_SEEN/fibonacci.TXT";
+const char kClannadFullVoiceRegname[] = "KEY\\CLANNAD_FV";
+
+}  // namespace
+
+// Decompresses every scenario in the test data and compares the result with a
+// hash of the output of the original byte at a time decoder, so any change to
+// Decompress() has to stay bit exact.
+TEST(CompressionTest, DecompressesTestScenariosBitExact) {
+  const uint64_t kExpectedHash = 0xcf244d4beb89da75ULL;
+
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  int scenarios = 0;
+  for (const std::string& file : AllTestArchives()) {
+    Archive archive(locateTestCase(file));
+    for (auto it = archive.begin(); it != archive.end(); ++it) {
+      const char* data = it->second.data;
+      Header header(data, it->second.length);
+      ASSERT_FALSE(header.use_xor_2_) << file;
+
+      std::vector<char> output(libreallive::read_i32(data + 0x24));
+      libreallive::compression::Decompress(
+          data + libreallive::read_i32(data + 0x20),
+          libreallive::read_i32(data + 0x28),
+          output.data(),
+          output.size(),
+          NULL);
+
+      for (char c : output) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+      }
+      scenarios++;
+    }
+  }
+
+  EXPECT_EQ(75, scenarios);
+  EXPECT_EQ(kExpectedHash, hash);
+}
+
+// The second level key is removed after decompression, giving back the
+// bytecode of the scenario the fixture was built from.
+TEST(CompressionTest, RemovesSecondLevelXor) {
+  Archive plain(locateTestCase("Module_Jmp_SEEN/fibonacci.TXT"));
+  Archive keyed(locateTestCase(kSecondLevelXorFixture));
+  const FilePos& plain_file = plain.begin()->second;
+  const FilePos& keyed_file = keyed.begin()->second;
+  ASSERT_TRUE(Header(keyed_file.data, keyed_file.length).use_xor_2_);
+
+  std::vector<char> expected, actual;
+  libreallive::DecompressScenario(plain_file, "", NULL, &expected);
+  libreallive::DecompressScenario(
+      keyed_file,
+      kClannadFullVoiceRegname,
+      libreallive::compression::clannad_full_voice_xor_mask,
+      &actual);
+  EXPECT_EQ(expected, actual);
+}
+
+// The archive picks the key from #REGNAME, and the scenario runs as normal.
+TEST(CompressionTest, ArchiveUsesSecondLevelXorForRegname) {
+  Archive arc(locateTestCase(kSecondLevelXorFixture),
+              kClannadFullVoiceRegname);
+  TestSystem system;
+  RLMachine rlmachine(system, arc);
+  rlmachine.AttachModule(new JmpModule);
+  rlmachine.SetIntValue(IntMemRef('D', 0), 10);
+  rlmachine.ExecuteUntilHalted();
+  EXPECT_EQ(55, rlmachine.GetIntValue(IntMemRef('E', 0)));
+}
+
+// Without a known #REGNAME there is no key, which the player is told about.
+TEST(CompressionTest, SecondLevelXorNeedsKnownRegname) {
+  Archive arc(locateTestCase(kSecondLevelXorFixture), "KEY\\UNKNOWN");
+  EXPECT_THROW(arc.GetScenario(1), rlvm::UserPresentableError);
+}
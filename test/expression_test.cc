@@ -28,11 +28,14 @@
 #include "gtest/gtest.h"
 
 #include "libreallive/archive.h"
+#include "libreallive/bytecode.h"
+#include "libreallive/compiled_expression.h"
 #include "libreallive/expression.h"
 #include "libreallive/intmemref.h"
 #include "machine/rlmachine.h"
 #include "modules/module_jmp.h"
 #include "test_system/test_system.h"
+#include "utilities/exception.h"
 
 #include "test_utils.h"
 
@@ -129,6 +132,139 @@ TEST(ExpressionTest, PreviousErrors) {
   EXPECT_EQ(10, values[5]) << "Incorect value for intB[5]";
 }
 
+// Runs every expression statement in the expression test scenarios through
+// both the ExpressionPiece tree and its compiled form, each on its own
+// machine, and checks that they agree on every result and on memory.
+TEST(ExpressionTest, CompiledExpressionsMatchTree) {
+  const char* scenarios[] = {"ExpressionTest_SEEN/basicOperators.TXT",
+                             "ExpressionTest_SEEN/comparisonOperators.TXT",
+                             "ExpressionTest_SEEN/logicalOperators.TXT",
+                             "ExpressionTest_SEEN/previousErrors.TXT"};
+  int compiled = 0;
+  for (const char* scenario : scenarios) {
+    TestSystem system;
+    libreallive::Archive arc(locateTestCase(scenario));
+    RLMachine tree_machine(system, arc);
+    RLMachine compiled_machine(system, arc);
+
+    for (auto const* element : *arc.GetScenario(arc.begin()->first)) {
+      auto expression =
+          dynamic_cast<const libreallive::ExpressionElement*>(element);
+      if (!expression)
+        continue;
+
+      const libreallive::ExpressionPiece& piece = expression->ParsedExpression();
+      libreallive::CompiledExpression program(piece);
+      if (!program.is_valid())
+        continue;
+
+      compiled++;
+      EXPECT_EQ(piece.GetIntegerValue(tree_machine),
+                program.Run(compiled_machine))
+          << scenario << ": " << piece.GetDebugString();
+    }
+
+    for (char bank = 'A'; bank <= 'F'; ++bank) {
+      for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(tree_machine.GetIntValue(IntMemRef(bank, i)),
+                  compiled_machine.GetIntValue(IntMemRef(bank, i)))
+            << scenario << ": int" << bank << "[" << i << "]";
+      }
+    }
+  }
+
+  EXPECT_LT(0, compiled);
+}
+
+// Constant subexpressions fold away, including negation, which the parser
+// leaves as a unary expression.
+TEST(ExpressionTest, CompiledExpressionsFoldConstants) {
+  const struct {
+    const char* expression;
+    int value;
+  } cases[] = {
+      // intL[1] = -5
+      {"$ 0b [ $ ff 01 00 00 00 ] 5c 1e 5c 01 $ ff 05 00 00 00", -5},
+      // intL[1] = -1 + 2 * 3
+      {"$ 0b [ $ ff 01 00 00 00 ] 5c 1e 5c 01 $ ff 01 00 00 00 "
+       "5c 00 $ ff 02 00 00 00 5c 02 $ ff 03 00 00 00",
+       5},
+  };
+
+  TestSystem system;
+  libreallive::Archive arc(
+      locateTestCase("ExpressionTest_SEEN/basicOperators.TXT"));
+  RLMachine rlmachine(system, arc);
+  for (const auto& test : cases) {
+    string parsable = libreallive::PrintableToParsableString(test.expression);
+    const char* start = parsable.c_str();
+    libreallive::ExpressionPiece piece(libreallive::GetAssignment(start));
+
+    libreallive::CompiledExpression program(piece);
+    ASSERT_TRUE(program.is_valid()) << test.expression;
+    EXPECT_EQ(2u, program.size()) << test.expression;
+    EXPECT_EQ(test.value, program.Run(rlmachine)) << test.expression;
+    EXPECT_EQ(test.value, rlmachine.GetIntValue(IntMemRef('L', 1)));
+  }
+}
+
+// Bit-packed references of every width, with constant and computed locations,
+// read and write the same bits whether compiled or walked as a tree.
+TEST(ExpressionTest, CompiledBitPackedReferencesMatchTree) {
+  const char* expressions[] = {
+      // intA4b[3] = intB8b[5]
+      "$ 4e [ $ ff 03 00 00 00 ] 5c 1e $ 69 [ $ ff 05 00 00 00 ]",
+      // intAb[intC[0]] = 1
+      "$ 1a [ $ 02 [ $ ff 00 00 00 00 ] ] 5c 1e $ ff 01 00 00 00",
+      // intD2b[7] += intB16b[intC[0]]
+      "$ 37 [ $ ff 07 00 00 00 ] 5c 14 $ 83 [ $ 02 [ $ ff 00 00 00 00 ] ]",
+      // intE8b[intC[0]] = intAb[37] + intA4b[3]
+      "$ 6c [ $ 02 [ $ ff 00 00 00 00 ] ] 5c 1e "
+      "$ 1a [ $ ff 25 00 00 00 ] 5c 00 $ 4e [ $ ff 03 00 00 00 ]",
+  };
+
+  TestSystem system;
+  libreallive::Archive arc(
+      locateTestCase("ExpressionTest_SEEN/basicOperators.TXT"));
+  RLMachine tree_machine(system, arc);
+  RLMachine compiled_machine(system, arc);
+  for (RLMachine* machine : {&tree_machine, &compiled_machine}) {
+    machine->SetIntValue(IntMemRef('C', 0), 37);
+    for (int i = 0; i < 20; ++i)
+      machine->SetIntValue(IntMemRef('B', i), 0x01020304 * (i + 1));
+  }
+
+  for (const char* expression : expressions) {
+    string parsable = libreallive::PrintableToParsableString(expression);
+    const char* start = parsable.c_str();
+    libreallive::ExpressionPiece piece(libreallive::GetAssignment(start));
+    libreallive::CompiledExpression program(piece);
+    ASSERT_TRUE(program.is_valid()) << expression;
+
+    EXPECT_EQ(piece.GetIntegerValue(tree_machine),
+              program.Run(compiled_machine))
+        << expression;
+  }
+
+  for (char bank = 'A'; bank <= 'F'; ++bank) {
+    for (int i = 0; i < 40; ++i) {
+      EXPECT_EQ(tree_machine.GetIntValue(IntMemRef(bank, i)),
+                compiled_machine.GetIntValue(IntMemRef(bank, i)))
+          << "int" << bank << "[" << i << "]";
+    }
+  }
+  EXPECT_EQ(1, compiled_machine.GetIntValue(IntMemRef('A', "b", 37)));
+
+  // A computed location past the end of the view is still an error.
+  compiled_machine.SetIntValue(IntMemRef('C', 0), 64000);
+  string parsable = libreallive::PrintableToParsableString(
+      "$ 1a [ $ 02 [ $ ff 00 00 00 00 ] ] 5c 1e $ ff 01 00 00 00");
+  const char* start = parsable.c_str();
+  libreallive::ExpressionPiece piece(libreallive::GetAssignment(start));
+  EXPECT_THROW(libreallive::CompiledExpression(piece).Run(compiled_machine),
+               rlvm::Exception);
+}
+
 // In later games, you found newline metadata inside special parameters. Make
 // sure that the expression parser can deal with that.
 TEST(ExpressionTest, ParseWithNewlineInIt) {
@@ -148,3 +284,33 @@ TEST(ExpressionTest, ParseQuotedEnglishString) {
 
   ASSERT_EQ(16, libreallive::NextString(s.c_str()));
 }
+
+// Operands parsed while an arena is current live in the arena; copies taken
+// once it's no longer current must still be usable after it is gone.
+TEST(ExpressionTest, ArenaParsedExpressionsCopyOutOfArena) {
+  string parsable = libreallive::PrintableToParsableString(
+      "$ 00 [ $ ff 01 00 00 00 ] 5c 00 $ ff 02 00 00 00");
+
+  const char* start = parsable.c_str();
+  libreallive::ExpressionPiece heap_piece(libreallive::GetExpression(start));
+
+  std::unique_ptr<libreallive::ExpressionPiece> copy;
+  {
+    libreallive::ExpressionArena arena;
+    {
+      libreallive::ScopedExpressionArena scope(&arena);
+      start = parsable.c_str();
+      libreallive::ExpressionPiece piece(libreallive::GetExpression(start));
+      EXPECT_LT(0u, arena.size());
+      EXPECT_EQ(heap_piece.GetDebugString(), piece.GetDebugString());
+
+      copy.reset(new libreallive::ExpressionPiece(piece));
+    }
+    EXPECT_EQ(nullptr, libreallive::ExpressionArena::current());
+
+    libreallive::ExpressionPiece escaped(*copy);
+    copy.reset(new libreallive::ExpressionPiece(escaped));
+  }
+
+  EXPECT_EQ(heap_piece.GetDebugString(), copy->GetDebugString());
+}
@@ -0,0 +1,277 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+#include "gtest/gtest.h"
+
+#include <boost/filesystem/operations.hpp>
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+#include "libreallive/archive.h"
+#include "libreallive/intmemref.h"
+#include "machine/global_memory_journal.h"
+#include "machine/memory.h"
+#include "machine/rlmachine.h"
+#include "machine/save_writer.h"
+#include "machine/serialization.h"
+#include "test_system/test_system.h"
+#include "test_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+void ExpectSameGlobalMemory(const GlobalMemory& expected,
+                            const GlobalMemory& actual) {
+  for (int i = 0; i < SIZE_OF_MEM_BANK; ++i) {
+    EXPECT_EQ(expected.intG[i], actual.intG[i]) << "intG[" << i << "]";
+    EXPECT_EQ(expected.intZ[i], actual.intZ[i]) << "intZ[" << i << "]";
+    EXPECT_EQ(expected.strM[i], actual.strM[i]) << "strM[" << i << "]";
+  }
+  for (int i = 0; i < SIZE_OF_NAME_BANK; ++i)
+    EXPECT_EQ(expected.global_names[i], actual.global_names[i]);
+  EXPECT_TRUE(expected.kidoku_data == actual.kidoku_data);
+}
+
+void RecordKidoku(GlobalMemory* global, int scenario, int kidoku) {
+  boost::dynamic_bitset<>& bits = global->kidoku_data[scenario];
+  if (bits.size() <= static_cast<size_t>(kidoku))
+    bits.resize(kidoku + 1, false);
+  bits[kidoku] = true;
+}
+
+class GlobalMemoryJournalTest : public ::testing::Test {
+ protected:
+  GlobalMemoryJournalTest() {
+    RecordKidoku(&base_, 1, 10);
+    base_.intG[0] = 5;
+    journal_.SetBaseline(base_, "settings 0", 0);
+
+    current_ = base_;
+    current_.intG[3] = 7;
+    current_.intZ[1999] = -1;
+    current_.strM[5] = "flag";
+    RecordKidoku(&current_, 1, 3);
+    RecordKidoku(&current_, 1, 40);
+    RecordKidoku(&current_, 9, 0);
+    first_ = journal_.Record(current_, "settings 0");
+    after_first_ = current_;
+
+    current_.intG[3] = 8;
+    current_.global_names[2] = "Nagisa";
+    RecordKidoku(&current_, 9, 2);
+    second_ = journal_.Record(current_, "settings 1");
+  }
+
+  // Replays |records| over |global| starting from "settings 0", and returns
+  // the length that replayed.
+  uint64_t Replay(const std::string& records,
+                  GlobalMemory* global,
+                  std::string* settings) {
+    *settings = "settings 0";
+    std::istringstream iss(records);
+    GlobalMemoryJournal journal;
+    return journal.Replay(iss, global, settings);
+  }
+
+  GlobalMemory base_;
+  GlobalMemory current_;
+  GlobalMemory after_first_;
+  GlobalMemoryJournal journal_;
+  std::string first_;
+  std::string second_;
+};
+
+}  // namespace
+
+TEST_F(GlobalMemoryJournalTest, ReplayReproducesRecordedState) {
+  EXPECT_FALSE(first_.empty());
+  EXPECT_FALSE(second_.empty());
+  EXPECT_EQ(first_.size() + second_.size(), journal_.size());
+  EXPECT_EQ("", journal_.Record(current_, "settings 1"));
+
+  GlobalMemory replayed = base_;
+  std::string settings;
+  EXPECT_EQ(first_.size() + second_.size(),
+            Replay(first_ + second_, &replayed, &settings));
+  ExpectSameGlobalMemory(current_, replayed);
+  EXPECT_EQ("settings 1", settings);
+}
+
+TEST_F(GlobalMemoryJournalTest, RecordsAreSmall) {
+  // A handful of changed cells, not whole banks.
+  EXPECT_LT(first_.size(), 512u);
+  EXPECT_LT(second_.size(), 512u);
+}
+
+TEST_F(GlobalMemoryJournalTest, StopsAtTornRecord) {
+  GlobalMemory replayed = base_;
+  std::string settings;
+  std::string torn = first_ + second_.substr(0, second_.size() - 3);
+  EXPECT_EQ(first_.size(), Replay(torn, &replayed, &settings));
+  ExpectSameGlobalMemory(after_first_, replayed);
+  EXPECT_EQ("settings 0", settings);
+}
+
+TEST_F(GlobalMemoryJournalTest, StopsAtCorruptRecord) {
+  GlobalMemory replayed = base_;
+  std::string settings;
+  std::string corrupt = first_ + second_;
+  corrupt[corrupt.size() - 1] ^= 0x55;
+  EXPECT_EQ(first_.size(), Replay(corrupt, &replayed, &settings));
+  ExpectSameGlobalMemory(after_first_, replayed);
+}
+
+TEST_F(GlobalMemoryJournalTest, StopsAtMissingRecord) {
+  current_.intZ[0] = 12;
+  std::string third = journal_.Record(current_, "settings 1");
+
+  GlobalMemory replayed = base_;
+  std::string settings;
+  EXPECT_EQ(first_.size(), Replay(first_ + third, &replayed, &settings));
+  ExpectSameGlobalMemory(after_first_, replayed);
+}
+
+// A crash after a new global.sav.gz is written but before the journal is
+// removed replays the journal over state that already includes it.
+TEST_F(GlobalMemoryJournalTest, ReplayOverNewerBaseChangesNothing) {
+  GlobalMemory replayed = current_;
+  std::string settings;
+  Replay(first_ + second_, &replayed, &settings);
+  ExpectSameGlobalMemory(current_, replayed);
+}
+
+TEST_F(GlobalMemoryJournalTest, ReplaysClearedKidoku) {
+  current_.kidoku_data[1].reset(40);
+  current_.kidoku_data[1].resize(20);
+  current_.kidoku_data.erase(9);
+  std::string third = journal_.Record(current_, "settings 1");
+
+  GlobalMemory replayed = base_;
+  std::string settings;
+  Replay(first_ + second_ + third, &replayed, &settings);
+  ExpectSameGlobalMemory(current_, replayed);
+}
+
+// Points $HOME, and so the game's save directory, at a scratch directory.
+class GlobalMemoryJournalMachineTest : public ::testing::Test {
+ protected:
+  GlobalMemoryJournalMachineTest()
+      : home_(fs::temp_directory_path() /
+              fs::unique_path("rlvm-journal-%%%%-%%%%")),
+        arc_(locateTestCase("Module_Str_SEEN/strcpy_0.TXT")) {
+    const char* home = getenv("HOME");
+    if (home)
+      old_home_ = home;
+    fs::create_directories(home_);
+    setenv("HOME", home_.string().c_str(), 1);
+    system_.gameexe()("REGNAME") = "JournalTest";
+  }
+
+  ~GlobalMemoryJournalMachineTest() {
+    setenv("HOME", old_home_.c_str(), 1);
+    boost::system::error_code ec;
+    fs::remove_all(home_, ec);
+  }
+
+  fs::path home_;
+  std::string old_home_;
+  libreallive::Archive arc_;
+  TestSystem system_;
+};
+
+TEST_F(GlobalMemoryJournalMachineTest, LoadReplaysJournal) {
+  fs::path journal_path;
+  fs::path base_path;
+  {
+    RLMachine machine(system_, arc_);
+    journal_path = Serialization::buildGlobalMemoryJournalFilename(machine);
+    base_path = Serialization::buildGlobalMemoryFilename(machine);
+    Serialization::loadGlobalMemory(machine);
+
+    machine.SetIntValue(libreallive::IntMemRef('G', 10), 1234);
+    machine.memory().RecordKidoku(2, 7);
+    Serialization::journalGlobalMemory(machine);
+    machine.SetStringValue(libreallive::STRM_LOCATION, 4, "journaled");
+    Serialization::journalGlobalMemory(machine);
+  }
+
+  EXPECT_TRUE(fs::exists(journal_path));
+  EXPECT_FALSE(fs::exists(base_path));
+
+  {
+    RLMachine machine(system_, arc_);
+    Serialization::loadGlobalMemory(machine);
+    EXPECT_EQ(1234, machine.GetIntValue(libreallive::IntMemRef('G', 10)));
+    EXPECT_TRUE(machine.memory().HasBeenRead(2, 7));
+    EXPECT_EQ("journaled",
+              machine.memory().GetStringValue(libreallive::STRM_LOCATION, 4));
+
+    // Rewriting global.sav.gz folds the journal into it.
+    machine.SetIntValue(libreallive::IntMemRef('Z', 1), 99);
+    Serialization::saveGlobalMemory(machine);
+    machine.save_writer().WaitForAll();
+    EXPECT_TRUE(fs::exists(base_path));
+    EXPECT_FALSE(fs::exists(journal_path));
+  }
+
+  RLMachine machine(system_, arc_);
+  Serialization::loadGlobalMemory(machine);
+  EXPECT_EQ(1234, machine.GetIntValue(libreallive::IntMemRef('G', 10)));
+  EXPECT_EQ(99, machine.GetIntValue(libreallive::IntMemRef('Z', 1)));
+  EXPECT_TRUE(machine.memory().HasBeenRead(2, 7));
+}
+
+TEST_F(GlobalMemoryJournalMachineTest, DiscardsTornTail) {
+  fs::path journal_path;
+  {
+    RLMachine machine(system_, arc_);
+    journal_path = Serialization::buildGlobalMemoryJournalFilename(machine);
+    Serialization::loadGlobalMemory(machine);
+    machine.SetIntValue(libreallive::IntMemRef('G', 0), 1);
+    Serialization::journalGlobalMemory(machine);
+    machine.SetIntValue(libreallive::IntMemRef('G', 0), 2);
+    Serialization::journalGlobalMemory(machine);
+  }
+  fs::resize_file(journal_path, fs::file_size(journal_path) - 1);
+
+  {
+    RLMachine machine(system_, arc_);
+    Serialization::loadGlobalMemory(machine);
+    EXPECT_EQ(1, machine.GetIntValue(libreallive::IntMemRef('G', 0)));
+
+    // New records go after the last intact one.
+    machine.SetIntValue(libreallive::IntMemRef('G', 1), 3);
+    Serialization::journalGlobalMemory(machine);
+  }
+
+  RLMachine machine(system_, arc_);
+  Serialization::loadGlobalMemory(machine);
+  EXPECT_EQ(1, machine.GetIntValue(libreallive::IntMemRef('G', 0)));
+  EXPECT_EQ(3, machine.GetIntValue(libreallive::IntMemRef('G', 1)));
+}
@@ -264,6 +264,60 @@ TEST_F(GraphicsObjectTest, GetObjectData) {
   EXPECT_EQ(data, &obj.GetObjectData());
 }
 
+// Assigning over a copy of unchanged data, as a savepoint snapshot does,
+// keeps the existing clone instead of making another one.
+TEST_F(GraphicsObjectTest, AssignmentKeepsUnchangedData) {
+  GraphicsObject live;
+  live.SetObjectData(new GraphicsObjectOfFile(system, FILE_NAME));
+  GraphicsObject saved;
+  const GraphicsObject& const_saved = saved;
+
+  saved = live;
+  const GraphicsObjectData* first_clone = &const_saved.GetObjectData();
+  EXPECT_NE(first_clone, &static_cast<const GraphicsObject&>(live)
+                              .GetObjectData());
+
+  // Changing only the parameters shares them and leaves the data alone.
+  live.SetX(20);
+  saved = live;
+  EXPECT_EQ(first_clone, &const_saved.GetObjectData());
+  EXPECT_EQ(20, saved.x());
+  EXPECT_EQ(live.data_revision(), saved.data_revision());
+
+  // Neither does hit testing, which buttons do on every mouse motion.
+  live.DstRect(NULL);
+  saved = live;
+  EXPECT_EQ(first_clone, &const_saved.GetObjectData());
+
+  // Mutable access counts as a change.
+  live.GetObjectData().set_is_currently_playing(true);
+  saved = live;
+  EXPECT_NE(first_clone, &const_saved.GetObjectData());
+  EXPECT_TRUE(const_saved.GetObjectData().is_currently_playing());
+
+  live.FreeObjectData();
+  saved = live;
+  EXPECT_FALSE(saved.has_object_data());
+}
+
+// Layers are always recloned, since their children are changed through
+// references.
+TEST_F(GraphicsObjectTest, AssignmentReclonesLayers) {
+  GraphicsObject parent;
+  ParentGraphicsObjectData* parent_data = new ParentGraphicsObjectData(10);
+  parent.SetObjectData(parent_data);
+  GraphicsObject& child = parent_data->GetObject(5);
+
+  GraphicsObject saved;
+  saved = parent;
+  child.SetX(30);
+  saved = parent;
+
+  ParentGraphicsObjectData& saved_data =
+      static_cast<ParentGraphicsObjectData&>(saved.GetObjectData());
+  EXPECT_EQ(30, saved_data.GetObject(5).x());
+}
+
 // TODO: Use the above mock to test more of the insides of GraphicsObject...
 
 TEST_F(GraphicsObjectTest, TestColourFilter) {
@@ -0,0 +1,103 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+#include "libreallive/archive.h"
+#include "libreallive/intmemref.h"
+#include "machine/long_operation.h"
+#include "modules/modules.h"
+#include "test_system/headless_machine.h"
+#include "test_system/headless_system.h"
+#include "test_utils.h"
+
+using libreallive::IntMemRef;
+
+namespace {
+
+// Runs fibonacci.ke (see large_jmp_test.cc) for fib(15), which takes
+// thousands of instructions and never waits.
+class HeadlessTest : public ::testing::Test {
+ protected:
+  HeadlessTest()
+      : arc(locateTestCase("Module_Jmp_SEEN/fibonacci.TXT")),
+        system(locateTestCase("Gameexe_data/Gameexe.ini"),
+               locateTestCase("Gameroot") + "/"),
+        machine(system, arc) {
+    AddAllModules(machine);
+    machine.SetIntValue(IntMemRef('D', 0), 15);
+  }
+
+  libreallive::Archive arc;
+  HeadlessSystem system;
+  HeadlessMachine machine;
+};
+
+// A long operation that never finishes, like a wait for input the test
+// systems never give.
+class EndlessWait : public LongOperation {
+ public:
+  virtual bool operator()(RLMachine& machine) override { return false; }
+};
+
+}  // namespace
+
+// Each frame runs up to its instruction limit and moves the virtual clock on
+// by exactly one step.
+TEST_F(HeadlessTest, RunsFixedNumberOfFrames) {
+  for (int i = 0; i < 5; ++i)
+    EXPECT_EQ(100, system.RunFrame(machine, 20, 100));
+
+  EXPECT_FALSE(machine.halted());
+  EXPECT_EQ(100u, system.clock().GetTicks());
+}
+
+// Running frames until the machine halts gives the same answer as running the
+// fixture directly.
+TEST_F(HeadlessTest, RunsFixtureToCompletion) {
+  int frames = 0;
+  while (!machine.halted() && frames < 1000) {
+    system.RunFrame(machine, 20, 1000);
+    frames++;
+  }
+
+  EXPECT_TRUE(machine.halted());
+  EXPECT_EQ(610, machine.GetIntValue(IntMemRef('E', 0)));
+}
+
+// Frames spent in a long operation that never ends run no instructions and
+// only move the clock on, which is why rlvm_headless also limits frames.
+TEST_F(HeadlessTest, EndlessLongOperationRunsNoInstructions) {
+  machine.PushLongOperation(new EndlessWait);
+  for (int i = 0; i < 5; ++i)
+    EXPECT_EQ(0, system.RunFrame(machine, 20, 100));
+
+  EXPECT_FALSE(machine.halted());
+  EXPECT_EQ(100u, system.clock().GetTicks());
+}
@@ -28,6 +28,7 @@
 #include "gtest/gtest.h"
 
 #include "libreallive/archive.h"
+#include "libreallive/bytecode.h"
 #include "libreallive/intmemref.h"
 #include "machine/rlmachine.h"
 #include "modules/module_jmp.h"
@@ -577,6 +578,37 @@ TEST(LargeJmpTest, farcall) {
   }
 }
 
+// Same as above, but with every command's parameters parsed up front on two
+// threads (one per scenario).
+TEST(LargeJmpTest, farcallWithPreparsedParameters) {
+  libreallive::Archive arc(
+      locateTestCase("Module_Jmp_SEEN/farcallTest_0.TXT"));
+  TestSystem system;
+  RLMachine rlmachine(system, arc);
+  rlmachine.AttachModule(new JmpModule);
+  EXPECT_TRUE(rlmachine.PreparseParameters(2).empty());
+
+  for (auto const& entry : arc) {
+    Scenario* scenario = arc.GetScenario(entry.first);
+    ASSERT_NE(static_cast<Scenario*>(NULL), scenario);
+    for (libreallive::pointer_t i = 0; i < scenario->size(); ++i) {
+      const CommandElement* command =
+          dynamic_cast<const CommandElement*>(scenario->GetElement(i));
+      if (command && rlmachine.GetOperation(*command)) {
+        EXPECT_TRUE(command->AreParametersParsed())
+            << "SEEN" << entry.first << ", instruction " << i;
+      }
+    }
+  }
+
+  rlmachine.SetIntValue(IntMemRef('B', 0), 2);
+  rlmachine.ExecuteUntilHalted();
+
+  EXPECT_EQ(1, rlmachine.GetIntValue(IntMemRef('A', 0)));
+  EXPECT_EQ(2, rlmachine.GetIntValue(IntMemRef('A', 1)));
+  EXPECT_EQ(1, rlmachine.GetIntValue(IntMemRef('A', 2)));
+}
+
 // -----------------------------------------------------------------------
 
 // Tests gosub_with
@@ -27,15 +27,31 @@
 
 #include "gtest/gtest.h"
 
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <utility>
 #include <string>
 #include <vector>
 
+#include "libreallive/alldefs.h"
+#include "libreallive/bytecode.h"
 #include "machine/memory.h"
+#include "machine/opcode_log.h"
+#include "machine/opcode_profiler.h"
 #include "machine/rlmachine.h"
+#include "machine/rlmodule.h"
+#include "machine/rloperation.h"
 #include "machine/serialization.h"
+#include "modules/module_jmp.h"
 #include "modules/module_str.h"
+#include "systems/base/graphics_object.h"
+#include "systems/base/graphics_system.h"
+#include "systems/base/parent_graphics_object_data.h"
 #include "utilities/exception.h"
 #include "libreallive/intmemref.h"
 #include "test_utils.h"
@@ -78,6 +94,16 @@ class RLMachineTest : public FullSystemTest {
     }
   }
 
+  // Returns the local memory of |machine| as it would be written to a save.
+  string SerializeLocalMemory(RLMachine& machine) {
+    stringstream ss;
+    {
+      boost::archive::text_oarchive oa(ss);
+      oa << const_cast<const LocalMemory&>(machine.memory().local());
+    }
+    return ss.str();
+  }
+
   void verifyStrMemoryCountingFrom(RLMachine& loadMachine,
                                    int type,
                                    int count) {
@@ -93,6 +119,172 @@ TEST_F(RLMachineTest, RejectsDoubleAttachs) {
   EXPECT_THROW({ rlmachine.AttachModule(new StrModule); }, rlvm::Exception);
 }
 
+namespace {
+
+// Counts how many times it has been executed.
+struct CountingOpcode : public RLOpcode<> {
+  explicit CountingOpcode(int* count) : count_(count) {}
+  virtual void operator()(RLMachine& machine) override { (*count_)++; }
+
+  int* count_;
+};
+
+class CountingModule : public RLModule {
+ public:
+  explicit CountingModule(int* count) : RLModule("Counting", 1, 250) {
+    AddOpcode(0, 0, "count", new CountingOpcode(count));
+  }
+};
+
+// Builds the argumentless command 1:250:|opcode|, 0.
+std::unique_ptr<CommandElement> BuildCountingCommand(int opcode) {
+  string repr(8, '\0');
+  repr[0] = '#';
+  repr[1] = 1;
+  repr[2] = 250;
+  insert_i16(repr, 3, opcode);
+  repr += "()";
+  return std::unique_ptr<CommandElement>(BuildFunctionElement(repr.c_str()));
+}
+
+}  // namespace
+
+// A command remembers the operation it was dispatched to, but only for the
+// machine that looked it up.
+TEST_F(RLMachineTest, CachedDispatchIsPerMachine) {
+  int first = 0, second = 0;
+  rlmachine.AttachModule(new CountingModule(&first));
+  RLMachine other(system, arc);
+  other.AttachModule(new CountingModule(&second));
+
+  std::unique_ptr<CommandElement> command = BuildCountingCommand(0);
+  rlmachine.ExecuteCommand(*command);
+  rlmachine.ExecuteCommand(*command);
+  other.ExecuteCommand(*command);
+  rlmachine.ExecuteCommand(*command);
+
+  EXPECT_EQ(3, first);
+  EXPECT_EQ(1, second);
+}
+
+// Opcodes added to a module after it was attached are dispatched to.
+TEST_F(RLMachineTest, CachedDispatchSeesLateOpcodes) {
+  int count = 0, late = 0;
+  RLModule* module = new CountingModule(&count);
+  rlmachine.AttachModule(module);
+
+  std::unique_ptr<CommandElement> command = BuildCountingCommand(1);
+  EXPECT_THROW(rlmachine.ExecuteCommand(*command), rlvm::UnimplementedOpcode);
+
+  module->AddOpcode(1, 0, "late", new CountingOpcode(&late));
+  rlmachine.ExecuteCommand(*command);
+  EXPECT_EQ(1, late);
+  EXPECT_EQ(0, count);
+}
+
+// Opcodes no module implements are skipped by RunCommand(), which moves on to
+// the next instruction and logs them, but still throw from ExecuteCommand().
+TEST_F(RLMachineTest, RunCommandSkipsUnimplementedOpcodes) {
+  const struct {
+    int opcode;
+    const char* logged_as;
+  } cases[] = {{1, "opcode<1:250:1, 0>"},
+               {2, "unsupported [opcode<1:250:2, 0>]"}};
+
+  for (const auto& test : cases) {
+    int count = 0;
+    RLMachine machine(system, arc);
+    RLModule* module = new CountingModule(&count);
+    module->AddUnsupportedOpcode(2, 0, "unsupported");
+    machine.AttachModule(module);
+    machine.RecordUndefinedOpcodeCounts();
+
+    std::unique_ptr<CommandElement> command =
+        BuildCountingCommand(test.opcode);
+    EXPECT_THROW(machine.ExecuteCommand(*command), rlvm::UnimplementedOpcode);
+
+    // Each skip advances one instruction, so the second runs off the end of
+    // the scenario.
+    machine.GotoLocation(machine.Scenario().size() - 2);
+    EXPECT_NO_THROW(machine.RunCommand(*command));
+    EXPECT_FALSE(machine.halted());
+    EXPECT_NO_THROW(machine.RunCommand(*command));
+    EXPECT_TRUE(machine.halted());
+    EXPECT_EQ(0, count);
+
+    const OpcodeLog* log = machine.undefined_opcode_log();
+    ASSERT_TRUE(log);
+    ASSERT_EQ(1u, log->size());
+    EXPECT_EQ(test.logged_as, log->begin()->first);
+    EXPECT_EQ(2, log->begin()->second);
+  }
+}
+
+// With profiling on, each dispatched command is timed against its opcode and
+// the current line.
+TEST_F(RLMachineTest, ProfilesCommands) {
+  int count = 0;
+  rlmachine.AttachModule(new CountingModule(&count));
+  rlmachine.StartOpcodeProfiling();
+  OpcodeProfiler& profiler = *rlmachine.opcode_profiler();
+
+  std::unique_ptr<CommandElement> command = BuildCountingCommand(0);
+  for (int i = 0; i < 3; ++i)
+    rlmachine.RunCommand(*command);
+  std::unique_ptr<CommandElement> unimplemented = BuildCountingCommand(1);
+  rlmachine.RunCommand(*unimplemented);
+
+  OpcodeProfiler::OpcodeEntry& entry = profiler.GetCommandEntry(*command);
+  EXPECT_EQ("Counting", entry.module_name);
+  EXPECT_EQ("count", entry.name);
+  EXPECT_EQ(3, entry.timing.count);
+  EXPECT_LE(entry.timing.max, entry.timing.total);
+
+  stringstream csv;
+  profiler.WriteCsv(csv);
+  EXPECT_NE(string::npos, csv.str().find("\nCounting,count,1,250,0,0,3,"))
+      << csv.str();
+  EXPECT_NE(string::npos,
+            csv.str().find("\n" + std::to_string(rlmachine.SceneNumber()) +
+                           "," + std::to_string(rlmachine.line_number()) +
+                           ",3,"))
+      << csv.str();
+
+  stringstream json;
+  profiler.WriteJson(json);
+  EXPECT_NE(string::npos,
+            json.str().find("{\"module_name\": \"Counting\", \"name\": "
+                            "\"count\", \"modtype\": 1, \"module\": 250, "
+                            "\"opcode\": 0, \"overload\": 0, \"count\": 3,"))
+      << json.str();
+}
+
+// The profile is still written when the run ends in an exception.
+TEST_F(RLMachineTest, WritesProfileWhenUnwinding) {
+  namespace fs = boost::filesystem;
+  fs::path path = fs::temp_directory_path() /
+                  fs::unique_path("rlvm-profile-%%%%-%%%%.csv");
+  int count = 0;
+  rlmachine.AttachModule(new CountingModule(&count));
+  rlmachine.StartOpcodeProfiling();
+
+  std::unique_ptr<CommandElement> command = BuildCountingCommand(0);
+  try {
+    ScopedOpcodeReport report(rlmachine.opcode_profiler(), path.string());
+    rlmachine.RunCommand(*command);
+    throw rlvm::Exception("Crashed");
+  }
+  catch (rlvm::Exception&) {
+  }
+
+  fs::ifstream file(path);
+  string contents((std::istreambuf_iterator<char>(file)),
+                  std::istreambuf_iterator<char>());
+  EXPECT_NE(string::npos, contents.find("\nCounting,count,1,250,0,0,1,"))
+      << contents;
+  fs::remove(path);
+}
+
 TEST_F(RLMachineTest, ReturnFromFarcallMismatch) {
   EXPECT_THROW({ rlmachine.ReturnFromFarcall(); }, rlvm::Exception);
 }
@@ -107,6 +299,31 @@ TEST_F(RLMachineTest, Halts) {
   EXPECT_TRUE(rlmachine.halted()) << "Machine is halted.";
 }
 
+TEST_F(RLMachineTest, ExecuteSliceDoesNothingWhenHalted) {
+  rlmachine.Halt();
+  EXPECT_EQ(0, rlmachine.ExecuteSlice(std::chrono::milliseconds(10)));
+}
+
+// A pending redraw ends the slice after the instruction that asked for it.
+TEST_F(RLMachineTest, ExecuteSliceStopsOnForceWait) {
+  system.set_force_wait(true);
+  EXPECT_EQ(1, rlmachine.ExecuteSlice(std::chrono::milliseconds(10)));
+}
+
+// The instruction limit ends a slice even when there is no time limit.
+TEST(RLMachineSliceTest, ExecuteSliceStopsAtInstructionLimit) {
+  libreallive::Archive arc(locateTestCase("Module_Jmp_SEEN/fibonacci.TXT"));
+  TestSystem system;
+  RLMachine machine(system, arc);
+  machine.AttachModule(new JmpModule);
+  machine.SetIntValue(IntMemRef('D', 0), 15);
+
+  // Less than a batch, then a few batches and a remainder.
+  EXPECT_EQ(5, machine.ExecuteSlice(std::chrono::nanoseconds::max(), 5));
+  EXPECT_EQ(100, machine.ExecuteSlice(std::chrono::nanoseconds::max(), 100));
+  EXPECT_FALSE(machine.halted());
+}
+
 TEST_F(RLMachineTest, RegisterStore) {
   for (int i = 0; i < 10; ++i) {
     rlmachine.set_store_register(i);
@@ -214,6 +431,78 @@ TEST_F(RLMachineTest, Serialization) {
   }
 }
 
+// Global memory written in the text format older rlvm used still loads.
+TEST_F(RLMachineTest, SerializationFromTextArchive) {
+  stringstream ss;
+  libreallive::Archive arc(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  {
+    RLMachine saveMachine(system, arc);
+    setIntMemoryCountingFrom(saveMachine, GLOBAL_INTEGER_BANKS, 0);
+    setStrMemoryCountingFrom(saveMachine, STRM_LOCATION, 0);
+
+    Serialization::saveGlobalMemoryTo(
+        ss, saveMachine, Serialization::SAVE_FORMAT_TEXT);
+  }
+
+  {
+    RLMachine loadMachine(system, arc);
+    Serialization::loadGlobalMemoryFrom(ss, loadMachine);
+    verifyIntMemoryCountingFrom(loadMachine, GLOBAL_INTEGER_BANKS, 0);
+    verifyStrMemoryCountingFrom(loadMachine, STRM_LOCATION, 0);
+  }
+}
+
+// The local memory of a save game loads back from both archive formats.
+TEST_F(RLMachineTest, LocalMemoryFromEitherArchive) {
+  libreallive::Archive arc(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  RLMachine saveMachine(system, arc);
+  setIntMemoryCountingFrom(saveMachine, LOCAL_INTEGER_BANKS, 0);
+  setStrMemoryCountingFrom(saveMachine, STRS_LOCATION, 0);
+  saveMachine.MarkSavepoint();
+
+  for (Serialization::SaveFormat format :
+       {Serialization::SAVE_FORMAT_TEXT, Serialization::SAVE_FORMAT_BINARY}) {
+    stringstream ss;
+    Serialization::saveGameTo(ss, saveMachine, format);
+
+    RLMachine loadMachine(system, arc);
+    Serialization::loadLocalMemoryFrom(ss, loadMachine.memory());
+    verifyIntMemoryCountingFrom(loadMachine, LOCAL_INTEGER_BANKS, 0);
+    verifyStrMemoryCountingFrom(loadMachine, STRS_LOCATION, 0);
+  }
+}
+
+// Objects with a layer of child objects round trip through both archive
+// formats.
+TEST_F(RLMachineTest, LayerObjectsFromEitherArchive) {
+  libreallive::Archive arc(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  for (Serialization::SaveFormat format :
+       {Serialization::SAVE_FORMAT_TEXT, Serialization::SAVE_FORMAT_BINARY}) {
+    stringstream ss;
+    {
+      RLMachine saveMachine(system, arc);
+      GraphicsObject& parent = system.graphics().GetObject(0, 3);
+      parent.SetObjectData(new ParentGraphicsObjectData(4));
+      static_cast<ParentGraphicsObjectData&>(parent.GetObjectData())
+          .GetObject(2)
+          .SetX(42);
+      saveMachine.MarkSavepoint();
+      Serialization::saveGameTo(ss, saveMachine, format);
+    }
+
+    system.graphics().GetObject(0, 3).FreeObjectData();
+
+    RLMachine loadMachine(system, arc);
+    Serialization::loadGameFrom(ss, loadMachine);
+    GraphicsObject& parent = system.graphics().GetObject(0, 3);
+    ASSERT_TRUE(parent.has_object_data());
+    ParentGraphicsObjectData* layer =
+        dynamic_cast<ParentGraphicsObjectData*>(&parent.GetObjectData());
+    ASSERT_TRUE(layer);
+    EXPECT_EQ(42, layer->GetObject(2).x());
+  }
+}
+
 // Tests serialization of the kidoku table.
 TEST_F(RLMachineTest, SerializationOfKidoku) {
   stringstream ss;
@@ -276,3 +565,55 @@ TEST_F(RLMachineTest, SerializationOfSavepointValues) {
     verifyStrMemoryCountingFrom(loadMachine, STRS_LOCATION, 0);
   }
 }
+
+// Uncommitted writes, including repeated ones and writes through bit-packed
+// views, leave no trace in the saved local memory.
+TEST_F(RLMachineTest, SavedLocalMemoryMatchesLastSavepoint) {
+  libreallive::Archive arc(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  RLMachine committed(system, arc);
+  setIntMemoryCountingFrom(committed, LOCAL_INTEGER_BANKS, 0);
+  setStrMemoryCountingFrom(committed, STRS_LOCATION, 0);
+  committed.MarkSavepoint();
+
+  RLMachine scribbled(system, arc);
+  setIntMemoryCountingFrom(scribbled, LOCAL_INTEGER_BANKS, 0);
+  setStrMemoryCountingFrom(scribbled, STRS_LOCATION, 0);
+  scribbled.MarkSavepoint();
+  setIntMemoryCountingFrom(scribbled, LOCAL_INTEGER_BANKS, 5);
+  setIntMemoryCountingFrom(scribbled, LOCAL_INTEGER_BANKS, 7);
+  setStrMemoryCountingFrom(scribbled, STRS_LOCATION, 5);
+  for (int i = 0; i < 100; ++i)
+    scribbled.SetIntValue(IntMemRef('A', "4b", i), i % 16);
+
+  EXPECT_EQ(SerializeLocalMemory(committed), SerializeLocalMemory(scribbled));
+
+  // Committing the scribbles makes them part of the save.
+  scribbled.MarkSavepoint();
+  EXPECT_NE(SerializeLocalMemory(committed), SerializeLocalMemory(scribbled));
+  setIntMemoryCountingFrom(committed, LOCAL_INTEGER_BANKS, 7);
+  setStrMemoryCountingFrom(committed, STRS_LOCATION, 5);
+  for (int i = 0; i < 100; ++i)
+    committed.SetIntValue(IntMemRef('A', "4b", i), i % 16);
+  committed.MarkSavepoint();
+  EXPECT_EQ(SerializeLocalMemory(committed), SerializeLocalMemory(scribbled));
+}
+
+// Only whole ranges of full width intA-intZ locations are handed out as
+// arrays, and writes through them are still reverted in saves.
+TEST_F(RLMachineTest, IntSpans) {
+  Memory& memory = rlmachine.memory();
+  EXPECT_TRUE(memory.GetIntSpan(IntMemRef('A', 0), SIZE_OF_MEM_BANK));
+  EXPECT_TRUE(memory.GetIntSpan(IntMemRef('Z', 1999), 1));
+  EXPECT_FALSE(memory.GetIntSpan(IntMemRef('A', 1), SIZE_OF_MEM_BANK));
+  EXPECT_FALSE(memory.GetIntSpan(IntMemRef('A', 0), 0));
+  EXPECT_FALSE(memory.GetIntSpan(IntMemRef('A', "4b", 0), 4));
+  EXPECT_FALSE(memory.GetIntSpan(IntMemRef('L', 0), 4));
+
+  rlmachine.MarkSavepoint();
+  string saved = SerializeLocalMemory(rlmachine);
+  int* span = memory.GetMutableIntSpan(IntMemRef('C', 10), 20);
+  ASSERT_TRUE(span);
+  std::fill_n(span, 20, 42);
+  EXPECT_EQ(42, rlmachine.GetIntValue(IntMemRef('C', 29)));
+  EXPECT_EQ(saved, SerializeLocalMemory(rlmachine));
+}
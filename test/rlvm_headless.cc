@@ -0,0 +1,282 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+// Runs a game as fast as possible with the test systems standing in for the
+// display, audio and input, and reports how fast the VM went:
+//
+//   rlvm_headless [--decisions=file] [--max-instructions=N] [--max-frames=N]
+//                 <game root>
+//
+// Time only passes in whole frames of a virtual clock, and long operations
+// are fast forwarded or answered from the decision list, so the same game and
+// decisions execute the same instructions on every run. A long operation that
+// waits for something the test systems never do can last forever without
+// executing an instruction, so runs are also limited to a number of frames.
+
+#include <sys/resource.h>
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "libreallive/alldefs.h"
+#include "libreallive/archive.h"
+#include "libreallive/gameexe.h"
+#include "machine/game_hacks.h"
+#include "machine/opcode_profiler.h"
+#include "modules/modules.h"
+#include "systems/base/system_error.h"
+#include "test_system/headless_machine.h"
+#include "test_system/headless_system.h"
+#include "utilities/exception.h"
+#include "utilities/file.h"
+
+using namespace std;
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+namespace {
+
+// How many frames a run lasts unless --max-frames says otherwise: over a day
+// of virtual time at the default frame length.
+const int64_t kDefaultMaxFrames = 1000000;
+
+// The most instructions run between two frames, so that scripts that poll
+// the clock in a loop still see it move.
+const int kFrameInstructions = 10000;
+
+// Returns the peak resident set size of this process in kilobytes.
+long PeakMemoryKilobytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#if defined(__APPLE__)
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+// Reads one decision per line, skipping blank lines.
+vector<string> ReadDecisionList(const fs::path& path) {
+  fs::ifstream file(path);
+  if (!file)
+    throw rlvm::Exception("Couldn't open decision list " + path.string());
+
+  vector<string> decisions;
+  string line;
+  while (getline(file, line)) {
+    if (!line.empty() && line[line.size() - 1] == '\r')
+      line.erase(line.size() - 1);
+    if (!line.empty())
+      decisions.push_back(line);
+  }
+  return decisions;
+}
+
+void printUsage(const string& name, po::options_description& opts) {
+  cout << "Usage: " << name << " [options] <game root>" << endl;
+  cout << opts << endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  po::options_description opts("Options");
+  opts.add_options()("help", "Produce help message")(
+      "decisions", po::value<string>(),
+      "File with the text of the selection to make at each decision, one per "
+      "line")(
+      "start-seen", po::value<int>(), "Force start at SEEN#")(
+      "max-instructions", po::value<int64_t>(),
+      "Stop after executing this many instructions")(
+      "max-frames", po::value<int64_t>()->default_value(kDefaultMaxFrames),
+      "Stop after this many frames, even if no instructions ran in them, as "
+      "while stuck in a long operation; 0 for no limit")(
+      "frame-ms", po::value<int>()->default_value(100),
+      "How far the virtual clock moves each frame")(
+      "undefined-opcodes", "Display a message on undefined opcodes")(
+      "count-undefined",
+      "On exit, present a summary table about how many times each undefined "
+      "opcode was called")(
+      "profile-opcodes", po::value<string>(),
+      "On exit, write the time spent in each opcode and on each SEEN line to "
+      "this file; as JSON if it ends in .json, otherwise as CSV");
+
+  po::options_description hidden("Hidden");
+  hidden.add_options()(
+      "game-root", po::value<string>(), "Location of game root");
+
+  po::positional_options_description p;
+  p.add("game-root", 1);
+
+  po::options_description commandLineOpts;
+  commandLineOpts.add(opts).add(hidden);
+
+  po::variables_map vm;
+  try {
+    po::store(po::basic_command_line_parser<char>(argc, argv)
+                  .options(commandLineOpts)
+                  .positional(p)
+                  .run(),
+              vm);
+    po::notify(vm);
+  }
+  catch (boost::program_options::error& e) {
+    cerr << "Couldn't parse command line: " << e.what() << endl;
+    return -1;
+  }
+
+  if (vm.count("help") || !vm.count("game-root")) {
+    printUsage(argv[0], opts);
+    return vm.count("help") ? 0 : -1;
+  }
+
+  fs::path gamerootPath = vm["game-root"].as<string>();
+  if (!fs::is_directory(gamerootPath)) {
+    cerr << "ERROR: Path '" << gamerootPath << "' is not a directory." << endl;
+    return -1;
+  }
+
+  // Some games hide data in a lower subdirectory.
+  if (CorrectPathCase(gamerootPath / "Gameexe.ini").empty()) {
+    if (!CorrectPathCase(gamerootPath / "KINETICDATA" / "Gameexe.ini")
+             .empty()) {
+      gamerootPath /= "KINETICDATA/";
+    } else if (!CorrectPathCase(gamerootPath / "REALLIVEDATA" / "Gameexe.ini")
+                    .empty()) {
+      gamerootPath /= "REALLIVEDATA/";
+    }
+  }
+
+  int64_t max_instructions = 0;
+  if (vm.count("max-instructions"))
+    max_instructions = vm["max-instructions"].as<int64_t>();
+  int64_t max_frames = vm["max-frames"].as<int64_t>();
+  unsigned int frame_ms = std::max(1, vm["frame-ms"].as<int>());
+
+  try {
+    fs::path gameexePath = CorrectPathCase(gamerootPath / "Gameexe.ini");
+    fs::path seenPath = CorrectPathCase(gamerootPath / "Seen.txt");
+    if (gameexePath.empty() || seenPath.empty()) {
+      cerr << "ERROR: Path '" << gamerootPath << "' doesn't contain a "
+           << "Gameexe.ini and a Seen.txt." << endl;
+      return -1;
+    }
+
+    HeadlessSystem system(gameexePath.string(), gamerootPath.string() + "/");
+    if (vm.count("start-seen"))
+      system.gameexe()("SEEN_START") = vm["start-seen"].as<int>();
+
+    libreallive::Archive arc(seenPath.string(),
+                             system.gameexe()("REGNAME").ToString(""));
+    HeadlessMachine machine(system, arc);
+    AddAllModules(machine);
+    AddGameHacks(machine);
+
+    if (vm.count("decisions"))
+      machine.SetDecisionList(ReadDecisionList(vm["decisions"].as<string>()));
+
+    if (vm.count("undefined-opcodes"))
+      machine.SetPrintUndefinedOpcodes(true);
+
+    if (vm.count("count-undefined"))
+      machine.RecordUndefinedOpcodeCounts();
+
+    string profile_path;
+    if (vm.count("profile-opcodes")) {
+      profile_path = vm["profile-opcodes"].as<string>();
+      machine.StartOpcodeProfiling();
+    }
+    ScopedOpcodeReport opcode_report(machine.opcode_profiler(), profile_path);
+
+    machine.SetHaltOnException(false);
+
+    int64_t instructions = 0;
+    int64_t frames = 0;
+    auto start = chrono::steady_clock::now();
+    while (!machine.halted() &&
+           (max_instructions == 0 || instructions < max_instructions) &&
+           (max_frames == 0 || frames < max_frames)) {
+      int64_t frame_instructions = kFrameInstructions;
+      if (max_instructions)
+        frame_instructions =
+            std::min(frame_instructions, max_instructions - instructions);
+
+      instructions += system.RunFrame(machine, frame_ms, frame_instructions);
+      frames++;
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    if (!machine.halted() && max_frames && frames >= max_frames &&
+        (max_instructions == 0 || instructions < max_instructions)) {
+      cerr << "WARNING: Stopped at the frame limit; the game may be stuck in "
+           << "a long operation at SEEN " << machine.SceneNumber() << " line "
+           << machine.line_number() << "." << endl;
+    }
+
+    cout << "Instructions:        " << instructions << endl
+         << "Wall time:           " << elapsed.count() << " s" << endl
+         << "Instructions/second: "
+         << static_cast<int64_t>(instructions / elapsed.count()) << endl
+         << "Virtual time:        " << (frames * frame_ms) / 1000.0 << " s ("
+         << frames << " frames)" << endl
+         << "Selections:          " << machine.selections() << " ("
+         << machine.unplanned_selections() << " not on the decision list)"
+         << endl
+         // Nothing is preloaded, so these are the scenarios the run reached.
+         << "Scenarios loaded:    " << arc.GetScenarioMemoryUsage().size()
+         << endl
+         << "Peak memory:         " << PeakMemoryKilobytes() << " KiB" << endl;
+  }
+  catch (rlvm::Exception& e) {
+    cerr << "Fatal RLVM error: " << e.what() << endl;
+    return 1;
+  }
+  catch (libreallive::Error& e) {
+    cerr << "Fatal libreallive error: " << e.what() << endl;
+    return 1;
+  }
+  catch (SystemError& e) {
+    cerr << "Fatal local system error: " << e.what() << endl;
+    return 1;
+  }
+  catch (std::exception& e) {
+    cerr << "Uncaught exception: " << e.what() << endl;
+    return 1;
+  }
+
+  return 0;
+}
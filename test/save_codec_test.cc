@@ -0,0 +1,142 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+#include "gtest/gtest.h"
+
+#include <iterator>
+#include <sstream>
+#include <string>
+
+#include "libreallive/archive.h"
+#include "libreallive/intmemref.h"
+#include "machine/memory.h"
+#include "machine/rlmachine.h"
+#include "machine/save_codec.h"
+#include "machine/serialization.h"
+#include "test_system/test_system.h"
+#include "test_utils.h"
+#include "utilities/exception.h"
+
+using Serialization::SaveCompression;
+
+namespace {
+
+const SaveCompression kCompressions[] = {Serialization::SAVE_COMPRESSION_ZLIB,
+                                         Serialization::SAVE_COMPRESSION_LZ};
+
+std::string Compress(const std::string& input, SaveCompression compression) {
+  std::ostringstream oss;
+  {
+    SaveCodec::OutputStream output;
+    SaveCodec::For(compression).PushCompressor(output);
+    output.push(oss);
+    output.write(input.data(), input.size());
+  }
+  return oss.str();
+}
+
+std::string Decompress(const std::string& compressed) {
+  std::istringstream iss(compressed);
+  SaveCodec::InputStream input;
+  SaveCodec::Detect(iss).PushDecompressor(input);
+  input.push(iss);
+  input.exceptions(std::ios::badbit);
+  return std::string(std::istreambuf_iterator<char>(input),
+                     std::istreambuf_iterator<char>());
+}
+
+// Several blocks' worth of the sort of text a save archive holds.
+std::string SampleArchive() {
+  std::string archive;
+  for (int i = 0; archive.size() < 300 * 1024; ++i)
+    archive += "22 serialization::archive 10 " + std::to_string(i % 977) + " ";
+  return archive;
+}
+
+}  // namespace
+
+TEST(SaveCodecTest, RoundTripsEachCodec) {
+  const std::string archive = SampleArchive();
+  for (SaveCompression compression : kCompressions) {
+    std::string compressed = Compress(archive, compression);
+    EXPECT_LT(compressed.size(), archive.size() / 4);
+
+    std::istringstream iss(compressed);
+    EXPECT_EQ(compression, SaveCodec::Detect(iss).compression());
+    EXPECT_EQ(0, iss.tellg());
+    EXPECT_EQ(archive, Decompress(compressed));
+
+    EXPECT_EQ("", Decompress(Compress("", compression)));
+  }
+}
+
+TEST(SaveCodecTest, RejectsUnknownData) {
+  std::istringstream iss("22 serialization::archive");
+  EXPECT_THROW(SaveCodec::Detect(iss), rlvm::Exception);
+
+  std::istringstream empty("");
+  EXPECT_THROW(SaveCodec::Detect(empty), rlvm::Exception);
+}
+
+// Files cut off anywhere, including inside the magic or a block header,
+// fail to load instead of loading short or never finishing.
+TEST(SaveCodecTest, LzStreamMustBeComplete) {
+  const std::string compressed =
+      Compress(SampleArchive(), Serialization::SAVE_COMPRESSION_LZ);
+  const size_t lengths[] = {2, 4, 7, 12, 40, compressed.size() / 2,
+                            compressed.size() - 1};
+  for (size_t length : lengths) {
+    EXPECT_ANY_THROW(Decompress(compressed.substr(0, length)))
+        << "Cut to " << length << " bytes";
+  }
+}
+
+// Either codec's save games load, whichever is the default.
+TEST(SaveCodecTest, SaveGamesLoadWithEitherCodec) {
+  libreallive::Archive arc(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  TestSystem system;
+  RLMachine machine(system, arc);
+  machine.SetIntValue(libreallive::IntMemRef('A', 3), 17);
+  machine.SetIntValue(libreallive::IntMemRef('G', 4), 23);
+  machine.MarkSavepoint();
+
+  for (SaveCompression compression : kCompressions) {
+    std::ostringstream game;
+    Serialization::saveGameTo(
+        game, machine, Serialization::SAVE_FORMAT_BINARY, compression);
+    std::ostringstream global;
+    Serialization::saveGlobalMemoryTo(
+        global, machine, Serialization::SAVE_FORMAT_BINARY, compression);
+
+    RLMachine loaded(system, arc);
+    std::istringstream game_stream(game.str());
+    Serialization::loadLocalMemoryFrom(game_stream, loaded.memory());
+    std::istringstream global_stream(global.str());
+    Serialization::loadGlobalMemoryFrom(global_stream, loaded);
+    EXPECT_EQ(17, loaded.GetIntValue(libreallive::IntMemRef('A', 3)));
+    EXPECT_EQ(23, loaded.GetIntValue(libreallive::IntMemRef('G', 4)));
+  }
+}
@@ -0,0 +1,172 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/date_time/posix_time/time_serialize.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <string>
+
+#include "machine/save_game_header.h"
+#include "machine/save_game_index.h"
+#include "machine/serialization.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+class SaveGameIndexTest : public ::testing::Test {
+ protected:
+  SaveGameIndexTest()
+      : dir_(fs::temp_directory_path() /
+             fs::unique_path("rlvm-save-index-%%%%-%%%%")) {
+    fs::create_directories(dir_);
+  }
+
+  ~SaveGameIndexTest() {
+    boost::system::error_code ec;
+    fs::remove_all(dir_, ec);
+  }
+
+  fs::path SavePath(int slot) {
+    return dir_ / SaveGameIndex::FilenameForSlot(slot);
+  }
+
+  // Writes the start of a save game, which is all the index reads.
+  void WriteSave(int slot, const std::string& title) {
+    fs::ofstream file(SavePath(slot), std::ios::binary);
+    boost::iostreams::filtering_stream<boost::iostreams::output> output;
+    output.push(boost::iostreams::zlib_compressor());
+    output.push(file);
+
+    Serialization::writeSaveFormat(output, Serialization::SAVE_FORMAT_BINARY);
+    boost::archive::binary_oarchive oa(output);
+    const int version = 2;
+    const SaveGameHeader header(title);
+    oa << version << header;
+  }
+
+  std::string TitleOf(SaveGameIndex& index, int slot) {
+    SaveGameHeader header;
+    return index.Lookup(slot, &header) ? header.title : "<empty>";
+  }
+
+  fs::path dir_;
+};
+
+}  // namespace
+
+TEST_F(SaveGameIndexTest, RebuildsFromSaveFiles) {
+  WriteSave(3, "Third");
+  WriteSave(12, "Twelfth");
+
+  SaveGameIndex index(dir_);
+  EXPECT_TRUE(fs::exists(index.path()));
+  EXPECT_EQ("Third", TitleOf(index, 3));
+  EXPECT_EQ("Twelfth", TitleOf(index, 12));
+  EXPECT_EQ("<empty>", TitleOf(index, 4));
+}
+
+TEST_F(SaveGameIndexTest, ReadsHeadersFromTheIndex) {
+  WriteSave(1, "Original");
+  { SaveGameIndex index(dir_); }
+
+  // Scribble over the save without changing its size or modification time;
+  // only the index can still know the title.
+  std::time_t mtime = fs::last_write_time(SavePath(1));
+  uintmax_t size = fs::file_size(SavePath(1));
+  {
+    fs::ofstream file(SavePath(1), std::ios::binary | std::ios::trunc);
+    file << std::string(size, 'x');
+  }
+  fs::last_write_time(SavePath(1), mtime);
+
+  SaveGameIndex index(dir_);
+  EXPECT_EQ("Original", TitleOf(index, 1));
+}
+
+TEST_F(SaveGameIndexTest, RereadsChangedAndDeletedSaves) {
+  WriteSave(1, "Original");
+  WriteSave(2, "Doomed");
+  SaveGameIndex index(dir_);
+  EXPECT_EQ("Original", TitleOf(index, 1));
+
+  WriteSave(1, "A much longer replacement title");
+  fs::remove(SavePath(2));
+
+  EXPECT_EQ("A much longer replacement title", TitleOf(index, 1));
+  EXPECT_EQ("<empty>", TitleOf(index, 2));
+}
+
+TEST_F(SaveGameIndexTest, RecordedSaveIsVisibleBeforeItIsWritten) {
+  SaveGameIndex index(dir_);
+  uint64_t token = index.Record(5, SaveGameHeader("Pending"));
+  EXPECT_FALSE(fs::exists(SavePath(5)));
+  EXPECT_EQ("Pending", TitleOf(index, 5));
+
+  WriteSave(5, "Pending");
+  index.Written(5, token, true);
+  EXPECT_EQ("Pending", TitleOf(index, 5));
+
+  // The entry went to disk with the save's final modification time.
+  SaveGameIndex reopened(dir_);
+  EXPECT_EQ("Pending", TitleOf(reopened, 5));
+}
+
+TEST_F(SaveGameIndexTest, FailedWriteFallsBackToTheOldSave) {
+  WriteSave(5, "Old");
+  SaveGameIndex index(dir_);
+  uint64_t token = index.Record(5, SaveGameHeader("New"));
+  index.Written(5, token, false);
+  EXPECT_EQ("Old", TitleOf(index, 5));
+}
+
+TEST_F(SaveGameIndexTest, IgnoresWritesSupersededByALaterSave) {
+  SaveGameIndex index(dir_);
+  uint64_t first = index.Record(5, SaveGameHeader("First"));
+  index.Record(5, SaveGameHeader("Second"));
+
+  WriteSave(5, "First");
+  index.Written(5, first, true);
+  EXPECT_EQ("Second", TitleOf(index, 5));
+}
+
+TEST_F(SaveGameIndexTest, RebuildsUnreadableIndex) {
+  WriteSave(7, "Seventh");
+  {
+    fs::ofstream file(dir_ / "save_index.dat", std::ios::binary);
+    file << "garbage";
+  }
+
+  SaveGameIndex index(dir_);
+  EXPECT_EQ("Seventh", TitleOf(index, 7));
+}
@@ -0,0 +1,264 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <cstdlib>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "libreallive/archive.h"
+#include "libreallive/intmemref.h"
+#include "machine/rlmachine.h"
+#include "machine/save_codec.h"
+#include "machine/save_writer.h"
+#include "machine/serialization.h"
+#include "test_system/test_system.h"
+#include "test_utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+// Owns a scratch directory and deletes it afterwards.
+class ScopedSaveDirectory {
+ public:
+  ScopedSaveDirectory()
+      : path_(fs::temp_directory_path() /
+              fs::unique_path("rlvm-save-writer-%%%%-%%%%")) {
+    fs::create_directories(path_);
+  }
+  ~ScopedSaveDirectory() {
+    boost::system::error_code ec;
+    fs::remove_all(path_, ec);
+  }
+
+  const fs::path& path() const { return path_; }
+
+ private:
+  fs::path path_;
+};
+
+// Points $HOME, and so the game's save directory, at |path| until destroyed.
+class ScopedHome {
+ public:
+  explicit ScopedHome(const fs::path& path) {
+    const char* home = getenv("HOME");
+    if (home)
+      old_home_ = home;
+    setenv("HOME", path.string().c_str(), 1);
+  }
+  ~ScopedHome() { setenv("HOME", old_home_.c_str(), 1); }
+
+ private:
+  std::string old_home_;
+};
+
+std::string ReadCompressedFile(const fs::path& path) {
+  fs::ifstream file(path, std::ios::binary);
+  SaveCodec::InputStream filtered_input;
+  SaveCodec::Detect(file).PushDecompressor(filtered_input);
+  filtered_input.push(file);
+  return std::string(std::istreambuf_iterator<char>(filtered_input),
+                     std::istreambuf_iterator<char>());
+}
+
+}  // namespace
+
+TEST(SaveWriterTest, WritesCompressedFile) {
+  ScopedSaveDirectory dir;
+  fs::path path = dir.path() / "save000.sav.gz";
+
+  SaveWriter writer;
+  writer.Write(path, "archive contents");
+  writer.WaitFor(path);
+
+  EXPECT_FALSE(writer.IsPending(path));
+  EXPECT_EQ("archive contents", ReadCompressedFile(path));
+  EXPECT_EQ(0, writer.failed_writes());
+
+  // The temporary file was renamed into place.
+  int files = 0;
+  for (fs::directory_iterator it(dir.path()); it != fs::directory_iterator();
+       ++it) {
+    ++files;
+  }
+  EXPECT_EQ(1, files);
+}
+
+TEST(SaveWriterTest, CompressesWithTheChosenCodec) {
+  ScopedSaveDirectory dir;
+  fs::path default_path = dir.path() / "save000.sav.gz";
+  fs::path lz_path = dir.path() / "save001.sav.gz";
+  fs::path changed_path = dir.path() / "save002.sav.gz";
+
+  SaveWriter writer;
+  EXPECT_EQ(Serialization::SAVE_COMPRESSION_ZLIB, writer.compression());
+  writer.Write(default_path, "archive contents");
+  writer.Write(
+      lz_path, "archive contents", Serialization::SAVE_COMPRESSION_LZ);
+  writer.set_compression(Serialization::SAVE_COMPRESSION_LZ);
+  writer.Write(changed_path, "archive contents");
+  writer.WaitForAll();
+
+  const struct {
+    fs::path path;
+    Serialization::SaveCompression compression;
+  } expected[] = {{default_path, Serialization::SAVE_COMPRESSION_ZLIB},
+                  {lz_path, Serialization::SAVE_COMPRESSION_LZ},
+                  {changed_path, Serialization::SAVE_COMPRESSION_LZ}};
+  for (const auto& file : expected) {
+    fs::ifstream stream(file.path, std::ios::binary);
+    EXPECT_EQ(file.compression, SaveCodec::Detect(stream).compression())
+        << file.path;
+    EXPECT_EQ("archive contents", ReadCompressedFile(file.path));
+  }
+}
+
+TEST(SaveWriterTest, LastWriteToAPathWins) {
+  ScopedSaveDirectory dir;
+  fs::path path = dir.path() / "save000.sav.gz";
+
+  SaveWriter writer;
+  for (int i = 0; i < 20; ++i)
+    writer.Write(path, "version " + std::to_string(i));
+  writer.WaitForAll();
+
+  EXPECT_EQ("version 19", ReadCompressedFile(path));
+}
+
+TEST(SaveWriterTest, DestructorFinishesQueuedWrites) {
+  ScopedSaveDirectory dir;
+  {
+    SaveWriter writer;
+    for (int i = 0; i < 10; ++i) {
+      writer.Write(dir.path() / ("save00" + std::to_string(i) + ".sav.gz"),
+                   std::string(100000, 'a' + i));
+    }
+  }
+
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(std::string(100000, 'a' + i),
+              ReadCompressedFile(
+                  dir.path() / ("save00" + std::to_string(i) + ".sav.gz")));
+  }
+}
+
+TEST(SaveWriterTest, AppendsInOrderWithWrites) {
+  ScopedSaveDirectory dir;
+  fs::path path = dir.path() / "global.journal";
+
+  SaveWriter writer;
+  writer.Append(path, "one ");
+  writer.Append(path, "two ");
+  writer.Write(dir.path() / "global.sav.gz", "base", [&path](bool succeeded) {
+    EXPECT_TRUE(succeeded);
+    fs::remove(path);
+  });
+  writer.Append(path, "three");
+  writer.WaitFor(path);
+
+  fs::ifstream file(path, std::ios::binary);
+  EXPECT_EQ("three", std::string(std::istreambuf_iterator<char>(file),
+                                 std::istreambuf_iterator<char>()));
+}
+
+TEST(SaveWriterTest, ReportsFailedWrites) {
+  ScopedSaveDirectory dir;
+  fs::path path = dir.path() / "missing" / "save000.sav.gz";
+
+  SaveWriter writer;
+  writer.Write(path, "archive contents");
+  writer.WaitFor(path);
+
+  EXPECT_EQ(1, writer.failed_writes());
+  EXPECT_FALSE(fs::exists(path));
+
+  // The reason is handed over once, for the game to show.
+  std::vector<std::string> failures = writer.TakeFailures();
+  ASSERT_EQ(1u, failures.size());
+  EXPECT_NE(std::string::npos, failures[0].find("save000.sav.gz"))
+      << failures[0];
+  EXPECT_TRUE(writer.TakeFailures().empty());
+}
+
+// What the background writer puts on disk loads like a synchronous save.
+TEST(SaveWriterTest, SnapshotLoadsAsSaveGame) {
+  ScopedSaveDirectory dir;
+  fs::path path = dir.path() / "save000.sav.gz";
+
+  libreallive::Archive arc(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  TestSystem system;
+  RLMachine machine(system, arc);
+  machine.SetIntValue(libreallive::IntMemRef('A', 5), 42);
+  machine.MarkSavepoint();
+
+  std::ostringstream snapshot;
+  Serialization::snapshotGameTo(
+      snapshot, machine, Serialization::SAVE_FORMAT_BINARY);
+  machine.save_writer().Write(path, snapshot.str());
+  machine.save_writer().WaitFor(path);
+
+  RLMachine loaded(system, arc);
+  fs::ifstream file(path, std::ios::binary);
+  Serialization::loadLocalMemoryFrom(file, loaded.memory());
+  EXPECT_EQ(42, loaded.GetIntValue(libreallive::IntMemRef('A', 5)));
+}
+
+// Slot saves and global memory are written in the writer's format, so text
+// archives that older builds of rlvm read can still be asked for.
+TEST(SaveWriterTest, SavesInTheChosenFormat) {
+  ScopedSaveDirectory dir;
+  ScopedHome home(dir.path());
+
+  libreallive::Archive arc(locateTestCase("Module_Str_SEEN/strcpy_0.TXT"));
+  TestSystem system;
+  system.gameexe()("REGNAME") = "SaveWriterTest";
+  RLMachine machine(system, arc);
+  EXPECT_EQ(Serialization::SAVE_FORMAT_BINARY,
+            machine.save_writer().archive_format());
+
+  for (Serialization::SaveFormat format :
+       {Serialization::SAVE_FORMAT_TEXT, Serialization::SAVE_FORMAT_BINARY}) {
+    machine.save_writer().set_archive_format(format);
+    Serialization::saveGameForSlot(machine, 0);
+    Serialization::saveGlobalMemory(machine);
+    machine.save_writer().WaitForAll();
+
+    for (const fs::path& path :
+         {Serialization::buildSaveGameFilename(machine, 0),
+          Serialization::buildGlobalMemoryFilename(machine)}) {
+      std::istringstream archive(ReadCompressedFile(path));
+      EXPECT_EQ(format, Serialization::readSaveFormat(archive)) << path;
+    }
+  }
+}
@@ -99,7 +99,8 @@ void ScriptMachine::PushLongOperation(LongOperation* long_operation) {
           if (save_on_decision_slot_ != -1) {
             cerr << "(Automatically saving to slot " << save_on_decision_slot_
                  << ")" << endl;
-            Serialization::saveGameForSlot(*this, save_on_decision_slot_);
+            Serialization::quickSaveGameForSlot(*this,
+                                                save_on_decision_slot_);
 
             if (increment_on_save_) {
               save_on_decision_slot_++;
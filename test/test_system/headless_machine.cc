@@ -0,0 +1,90 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#include "test_system/headless_machine.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "long_operations/button_object_select_long_operation.h"
+#include "long_operations/select_long_operation.h"
+
+// -----------------------------------------------------------------------
+// HeadlessMachine
+// -----------------------------------------------------------------------
+HeadlessMachine::HeadlessMachine(System& in_system,
+                                 libreallive::Archive& in_archive)
+    : RLMachine(in_system, in_archive),
+      current_decision_(0),
+      selections_(0),
+      unplanned_selections_(0) {}
+
+HeadlessMachine::~HeadlessMachine() {}
+
+void HeadlessMachine::SetDecisionList(
+    const std::vector<std::string>& decisions) {
+  decisions_ = decisions;
+  current_decision_ = 0;
+}
+
+void HeadlessMachine::PushLongOperation(LongOperation* long_operation) {
+  if (SelectLongOperation* sel =
+          dynamic_cast<SelectLongOperation*>(long_operation)) {
+    selections_++;
+    bool found = false;
+    if (current_decision_ < decisions_.size()) {
+      found = sel->SelectByText(decisions_[current_decision_]);
+      if (!found) {
+        std::cerr << "(SEEN" << SceneNumber() << ")(Line " << line_number()
+                  << "): Decision '" << decisions_[current_decision_]
+                  << "' isn't one of the options; taking the first shown one."
+                  << std::endl;
+      }
+      current_decision_++;
+    }
+
+    if (!found) {
+      unplanned_selections_++;
+      for (const std::string& option : sel->GetOptions()) {
+        if (sel->SelectByText(option))
+          break;
+      }
+    }
+  } else if (ButtonObjectSelectLongOperation* sel =
+                 dynamic_cast<ButtonObjectSelectLongOperation*>(
+                     long_operation)) {
+    // As in ScriptMachine, answer button selections with the first button.
+    selections_++;
+    unplanned_selections_++;
+    set_store_register(1);
+    delete sel;
+    return;
+  }
+
+  RLMachine::PushLongOperation(long_operation);
+}
@@ -0,0 +1,65 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#ifndef TEST_TEST_SYSTEM_HEADLESS_MACHINE_H_
+#define TEST_TEST_SYSTEM_HEADLESS_MACHINE_H_
+
+#include <string>
+#include <vector>
+
+#include "machine/rlmachine.h"
+
+// An RLMachine that answers its own selections, for running a game with
+// nobody at the keyboard. Selections are taken from a decision list in order,
+// like ScriptMachine::SetDecisionList(); once the list runs out, or when the
+// next decision isn't one of the options, the first shown option is taken so
+// the run can continue.
+class HeadlessMachine : public RLMachine {
+ public:
+  HeadlessMachine(System& in_system, libreallive::Archive& in_archive);
+  virtual ~HeadlessMachine();
+
+  // Sets the decisions to take, as the UTF-8 text of the options.
+  void SetDecisionList(const std::vector<std::string>& decisions);
+
+  // The number of selections made, and how many of those weren't on the
+  // decision list.
+  int selections() const { return selections_; }
+  int unplanned_selections() const { return unplanned_selections_; }
+
+  // Overridden from RLMachine:
+  virtual void PushLongOperation(LongOperation* long_operation) override;
+
+ private:
+  std::vector<std::string> decisions_;
+  size_t current_decision_;
+
+  int selections_;
+  int unplanned_selections_;
+};
+
+#endif  // TEST_TEST_SYSTEM_HEADLESS_MACHINE_H_
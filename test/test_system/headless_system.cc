@@ -0,0 +1,73 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#include "test_system/headless_system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "machine/rlmachine.h"
+#include "systems/base/graphics_system.h"
+#include "systems/base/sound_system.h"
+#include "systems/base/text_system.h"
+
+// -----------------------------------------------------------------------
+// HeadlessSystem
+// -----------------------------------------------------------------------
+HeadlessSystem::HeadlessSystem(const std::string& gameexe_path,
+                               const std::string& game_root)
+    : TestSystem(gameexe_path), clock_(new VirtualClock) {
+  gameexe()("__GAMEPATH") = game_root;
+  static_cast<TestEventSystem&>(event()).SetMockHandler(clock_);
+  set_force_fast_forward();
+}
+
+HeadlessSystem::~HeadlessSystem() {}
+
+void HeadlessSystem::Run(RLMachine& machine) {
+  text().ExecuteTextSystem();
+  sound().ExecuteSoundSystem();
+  graphics().ExecuteGraphicsSystem(machine);
+}
+
+int HeadlessSystem::RunFrame(RLMachine& machine,
+                             unsigned int frame_ms,
+                             int max_instructions) {
+  Run(machine);
+
+  // A long operation's step isn't an instruction, so allow one more for it.
+  // The slice ends as soon as another long operation starts.
+  int long_operation_steps = machine.CurrentLongOperation() ? 1 : 0;
+  int executed =
+      machine.ExecuteSlice(std::chrono::nanoseconds::max(),
+                           max_instructions + long_operation_steps);
+
+  set_force_wait(false);
+  clock_->Advance(frame_ms);
+  return std::max(0, executed - long_operation_steps);
+}
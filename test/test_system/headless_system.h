@@ -0,0 +1,80 @@
+// -*- Mode: C++; tab-width:2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi:tw=80:et:ts=2:sts=2
+//
+// -----------------------------------------------------------------------
+//
+// This file is part of RLVM, a RealLive virtual machine clone.
+//
+// -----------------------------------------------------------------------
+//
+// Copyright (C) 2016 Elliot Glaysher
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// -----------------------------------------------------------------------
+
+#ifndef TEST_TEST_SYSTEM_HEADLESS_SYSTEM_H_
+#define TEST_TEST_SYSTEM_HEADLESS_SYSTEM_H_
+
+#include <memory>
+#include <string>
+
+#include "test_system/test_event_system.h"
+#include "test_system/test_system.h"
+
+// A clock that only moves when told to. Each frame of a headless run advances
+// it by a fixed step, so everything timed by the event system (waits,
+// animations, object mutators) finishes after the same number of frames on
+// every run, no matter how fast the host is.
+class VirtualClock : public EventSystemMockHandler {
+ public:
+  VirtualClock() : ticks_(0) {}
+
+  virtual unsigned int GetTicks() const override { return ticks_; }
+
+  void Advance(unsigned int milliseconds) { ticks_ += milliseconds; }
+
+ private:
+  unsigned int ticks_;
+};
+
+// A TestSystem that runs a real game with no display or audio device. Unlike
+// TestSystem, Run() gives the text, sound and graphics systems their turn each
+// frame, the way SDLSystem does, and the system is always fast forwarding so
+// that waits, text display and effects complete immediately.
+class HeadlessSystem : public TestSystem {
+ public:
+  // |gameexe_path| is the game's Gameexe.ini; |game_root| is the directory
+  // the game's data is in.
+  HeadlessSystem(const std::string& gameexe_path, const std::string& game_root);
+  virtual ~HeadlessSystem();
+
+  VirtualClock& clock() { return *clock_; }
+
+  // Runs one frame of a headless game: gives the systems their turn with
+  // Run(), executes at most |max_instructions| instructions through
+  // RLMachine::ExecuteSlice(), and then moves the clock on by |frame_ms|.
+  // Returns the number of instructions executed, not counting the step of a
+  // long operation that was running when the frame began.
+  int RunFrame(RLMachine& machine, unsigned int frame_ms, int max_instructions);
+
+  // Implementation of System:
+  virtual void Run(RLMachine& machine) override;
+
+ private:
+  std::shared_ptr<VirtualClock> clock_;
+};
+
+#endif  // TEST_TEST_SYSTEM_HEADLESS_SYSTEM_H_
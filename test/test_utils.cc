@@ -28,6 +28,7 @@
 #include "test_utils.h"
 #include <vector>
 #include <boost/filesystem/operations.hpp>
+#include <algorithm>
 #include <stdexcept>
 #include <sstream>
 #include <string>
@@ -56,6 +57,30 @@ string locateTestCase(const string& baseName) {
   throw std::runtime_error(oss.str());
 }
 
+namespace {
+
+const char* kArchiveDirectories[] = {
+    "ExpressionTest_SEEN", "Module_Jmp_SEEN", "Module_Mem_SEEN",
+    "Module_Str_SEEN",     "Module_Sys_SEEN", NULL};
+
+}  // namespace
+
+std::vector<std::string> AllTestArchives() {
+  std::vector<std::string> archives;
+  for (const char** dir = kArchiveDirectories; *dir; ++dir) {
+    fs::path root(locateTestCase(*dir));
+    fs::directory_iterator end;
+    for (fs::directory_iterator it(root); it != end; ++it) {
+      if (it->path().extension() == ".TXT")
+        archives.push_back(std::string(*dir) + "/" +
+                           it->path().filename().string());
+    }
+  }
+
+  std::sort(archives.begin(), archives.end());
+  return archives;
+}
+
 // -----------------------------------------------------------------------
 
 FullSystemTest::FullSystemTest()
@@ -29,6 +29,7 @@
 #define TEST_TESTUTILS_HPP_
 
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "libreallive/archive.h"
@@ -38,6 +39,10 @@
 // Locates a test file in the test/ directory.
 std::string locateTestCase(const std::string& baseName);
 
+// Returns the relative paths (suitable for locateTestCase()) of every compiled
+// SEEN.TXT archive in the test data directories.
+std::vector<std::string> AllTestArchives();
+
 // A base class for all tests that instantiate an archive, a System and a
 // Machine.
 class FullSystemTest : public ::testing::Test {
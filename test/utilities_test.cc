@@ -26,9 +26,29 @@
 
 #include "gtest/gtest.h"
 
+#include <string>
+#include <vector>
+
 #include "libreallive/gameexe.h"
 #include "systems/base/rect.h"
 #include "utilities/graphics.h"
+#include "utilities/lz_compression.h"
+
+namespace {
+
+// Compresses |input| and checks that it decompresses back to itself.
+std::string LzRoundTrip(const std::string& input) {
+  std::string compressed;
+  LzCompress(input.data(), input.size(), &compressed);
+
+  std::vector<char> output(input.size() + 1);
+  EXPECT_TRUE(LzDecompress(compressed.data(), compressed.size(),
+                           output.data(), input.size()));
+  EXPECT_EQ(input, std::string(output.data(), input.size()));
+  return compressed;
+}
+
+}  // namespace
 
 TEST(UtilitiesTest, ClipDestination_Superset) {
   Rect clip(Point(5, 5), Size(5, 5));
@@ -64,3 +84,46 @@ TEST(UtilitiesTest, ScreenSizeModKey) {
   me.parseLine("#SCREENSIZE_MOD=999,800,600");
   EXPECT_EQ(Size(800, 600), GetScreenSize(me));
 }
+
+TEST(UtilitiesTest, LzRoundTrips) {
+  LzRoundTrip("");
+  LzRoundTrip("abc");
+  LzRoundTrip("abcdabcdabcdabcdabcdabcdx");
+
+  std::string text;
+  for (int i = 0; text.size() < kMaxLzBlockSize; ++i)
+    text += "A line of dialogue " + std::to_string(i % 300) + "\n";
+  text.resize(kMaxLzBlockSize);
+  EXPECT_LT(LzRoundTrip(text).size(), text.size() / 3);
+
+  // A long run is one overlapping back reference.
+  EXPECT_LT(LzRoundTrip(std::string(kMaxLzBlockSize, 'a')).size(), 300u);
+
+  std::string noise(kMaxLzBlockSize, '\0');
+  unsigned int seed = 12345;
+  for (char& c : noise) {
+    seed = seed * 1103515245 + 12345;
+    c = static_cast<char>(seed >> 16);
+  }
+  EXPECT_LT(LzRoundTrip(noise).size(), noise.size() + noise.size() / 200);
+}
+
+TEST(UtilitiesTest, LzRejectsCorruptData) {
+  std::string input;
+  for (int i = 0; i < 1000; ++i)
+    input += "kidoku " + std::to_string(i % 10);
+  std::string compressed;
+  LzCompress(input.data(), input.size(), &compressed);
+
+  std::vector<char> output(input.size());
+  // The wrong size, or cut off.
+  EXPECT_FALSE(LzDecompress(compressed.data(), compressed.size(),
+                            output.data(), input.size() - 1));
+  EXPECT_FALSE(LzDecompress(compressed.data(), compressed.size() / 2,
+                            output.data(), input.size()));
+
+  // A back reference from before the start of the output.
+  const char bad_offset[] = {0x10, 'x', 0x05, 0x00, 0x00};
+  EXPECT_FALSE(LzDecompress(bad_offset, sizeof(bad_offset), output.data(),
+                            output.size()));
+}